@@ -59,6 +59,17 @@ enum filtermethod {
 
 extern const char *filtermethodmap[FILTER_METHOD__MAX];
 
+enum filtertype {
+	FILTER_TYPE_NONE,
+	FILTER_TYPE_SUB,
+	FILTER_TYPE_UP,
+	FILTER_TYPE_AVERAGE,
+	FILTER_TYPE_PAETH,
+	FILTER_TYPE__MAX,
+};
+
+extern const char *filtertypemap[FILTER_TYPE__MAX];
+
 enum interlace_method {
 	INTERLACE_METHOD_STANDARD,
 	INTERLACE_METHOD_ADAM7,
@@ -67,6 +78,16 @@ enum interlace_method {
 
 extern const char *interlacemap[INTERLACE_METHOD__MAX];
 
+/* Origin and spacing of the pixels of each Adam7 pass */
+struct lgpng_adam7 {
+	uint8_t	x;
+	uint8_t	y;
+	uint8_t	dx;
+	uint8_t	dy;
+};
+
+extern const struct lgpng_adam7 lgpng_adam7[7];
+
 struct IHDR {
 	uint32_t	length;
 	uint8_t		type[4];
@@ -237,6 +258,28 @@ struct zTXt {
 	} __attribute__((packed)) data;
 };
 
+/* iTXt chunk */
+struct iTXt {
+	uint32_t	length;
+	uint8_t		type[4];
+	uint32_t	crc;
+	struct {
+		size_t		 keywordz;
+		uint8_t		 keyword[80];
+		uint8_t		 compressed;
+		uint8_t		 compression;
+		size_t		 languagez;
+		uint8_t		*language;
+		size_t		 translatedz;
+		uint8_t		*translated;
+		size_t		 textz;
+		uint8_t		*text;
+		/* Filled on demand by lgpng_iTXt_get_text */
+		size_t		 inflatedz;
+		uint8_t		*inflated;
+	} __attribute__((packed)) data;
+};
+
 /* bKGD chunk */
 struct rgb16 {
 	uint16_t	red;
@@ -646,11 +689,29 @@ struct tpNG {
 	} __attribute__((packed)) data;
 };
 
+enum lgpng_err {
+	LGPNG_OK = 0,
+	LGPNG_INVALID_PARAM,
+	LGPNG_TOO_SHORT,
+	LGPNG_INVALID_CHUNK_LENGTH,
+	LGPNG_INVALID_CHUNK_NAME,
+	LGPNG_ZLIB_ERROR,
+	LGPNG_NOMEM,
+	LGPNG_TOO_LONG,
+	LGPNG_BUDGET_EXCEEDED,
+	/* Generic error, to be refined */
+	LGPNG_ERROR,
+};
+
 /* chunks */
 bool		lgpng_validate_keyword(uint8_t *, size_t);
 bool		lgpng_is_official_keyword(uint8_t *, size_t);
 
 int		lgpng_create_IHDR_from_data(struct IHDR *, uint8_t *, uint32_t);
+uint8_t		lgpng_IHDR_bitsperpixel(struct IHDR *);
+size_t		lgpng_IHDR_rowbytes(struct IHDR *, uint32_t);
+void		lgpng_IHDR_pass_size(struct IHDR *, int, uint32_t *, uint32_t *);
+enum lgpng_err	lgpng_IHDR_raw_size(struct IHDR *, size_t *);
 int		lgpng_create_PLTE_from_data(struct PLTE *, uint8_t *, uint32_t);
 int		lgpng_create_IDAT_from_data(struct IDAT *, uint8_t *, uint32_t);
 int		lgpng_create_tRNS_from_data(struct tRNS *, struct IHDR *, uint8_t *, uint32_t);
@@ -660,7 +721,7 @@ int		lgpng_create_iCCP_from_data(struct iCCP *, uint8_t *, uint32_t);
 int		lgpng_create_sBIT_from_data(struct sBIT *, struct IHDR *, uint8_t *, uint32_t);
 int		lgpng_create_sRGB_from_data(struct sRGB *, uint8_t *, uint32_t);
 int		lgpng_create_cICP_from_data(struct cICP *, uint8_t *, uint32_t);
-/*int		lgpng_create_iTXt_from_data(struct iTXt *, uint8_t *, uint32_t);*/
+int		lgpng_create_iTXt_from_data(struct iTXt *, uint8_t *, uint32_t);
 int		lgpng_create_tEXt_from_data(struct tEXt *, uint8_t *, uint32_t);
 int		lgpng_create_zTXt_from_data(struct zTXt *, uint8_t *, uint32_t);
 int		lgpng_create_bKGD_from_data(struct bKGD *, struct IHDR *, struct PLTE *, uint8_t *, uint32_t);
@@ -687,16 +748,6 @@ int		lgpng_create_waLV_from_data(struct waLV *, uint8_t *, uint32_t);
 int		lgpng_create_msOG_from_data(struct msOG *, uint8_t *, uint32_t);
 int		lgpng_create_tpNG_from_data(struct tpNG *, uint8_t *, uint32_t);
 
-enum lgpng_err {
-	LGPNG_OK = 0,
-	LGPNG_INVALID_PARAM,
-	LGPNG_TOO_SHORT,
-	LGPNG_INVALID_CHUNK_LENGTH,
-	LGPNG_INVALID_CHUNK_NAME,
-	/* Generic error, to be refined */
-	LGPNG_ERROR,
-};
-
 enum lgpng_err	lgpng_data_is_png(uint8_t *, size_t);
 enum lgpng_err	lgpng_data_get_length(uint8_t *, size_t, uint32_t *);
 enum lgpng_err	lgpng_data_get_type(uint8_t *, size_t, uint8_t [4]);
@@ -705,6 +756,281 @@ enum lgpng_err	lgpng_data_get_crc(uint8_t *, size_t, uint32_t *);
 size_t		lgpng_data_write_sig(uint8_t *);
 size_t		lgpng_data_write_chunk(uint8_t *, uint32_t, uint8_t [4], uint8_t *, uint32_t);
 
+/* inflate */
+typedef enum lgpng_err (*lgpng_inflate_sink)(void *, uint8_t *, size_t);
+
+/* Limits on decompression, zero meaning unlimited */
+struct lgpng_budget {
+	size_t		chunk_bytes;	/* Output bytes per stream */
+	size_t		file_bytes;	/* Output bytes for all streams */
+	uint64_t	chunk_usec;	/* CPU time per stream */
+	uint64_t	file_usec;	/* CPU time for all streams */
+	size_t		used_bytes;
+	uint64_t	used_usec;
+};
+
+void		lgpng_budget_init(struct lgpng_budget *, size_t, size_t, uint64_t, uint64_t);
+void		lgpng_budget_reset(struct lgpng_budget *);
+enum lgpng_err	lgpng_inflate_chunk(uint8_t *, size_t, struct lgpng_budget *, lgpng_inflate_sink, void *);
+enum lgpng_err	lgpng_inflate_chunk_alloc(uint8_t *, size_t, struct lgpng_budget *, uint8_t **, size_t *);
+
+/* Whole buffer backend: zlib, zlib-ng or libdeflate */
+extern const char *lgpng_zlib_backend;
+
+enum lgpng_err	lgpng_zlib_inflate(const uint8_t *, size_t, uint8_t *, size_t, size_t *);
+size_t		lgpng_zlib_bound(size_t);
+enum lgpng_err	lgpng_zlib_deflate(int, const uint8_t *, size_t, uint8_t *, size_t, size_t *);
+
+/* Decompression of the image data spread over several IDAT chunks */
+struct lgpng_idat;
+typedef enum lgpng_err (*lgpng_row_fn)(void *, uint32_t, uint8_t *, size_t);
+
+enum lgpng_err	lgpng_idat_new(struct IHDR *, struct lgpng_budget *, struct lgpng_idat **);
+enum lgpng_err	lgpng_idat_new_rows(struct IHDR *, struct lgpng_budget *, lgpng_row_fn, void *, struct lgpng_idat **);
+enum lgpng_err	lgpng_idat_new_count(struct IHDR *, struct lgpng_budget *, struct lgpng_idat **);
+enum lgpng_err	lgpng_idat_limit(struct lgpng_idat *, uint32_t);
+enum lgpng_err	lgpng_idat_feed(struct lgpng_idat *, uint8_t *, size_t);
+enum lgpng_err	lgpng_idat_finish(struct lgpng_idat *, uint8_t **, size_t *);
+enum lgpng_err	lgpng_idat_adler32(struct lgpng_idat *, uint32_t *, uint32_t *);
+void		lgpng_idat_free(struct lgpng_idat *);
+size_t		lgpng_idat_find_restarts(const uint8_t *, size_t, size_t *, size_t);
+enum lgpng_err	lgpng_idat_inflate(struct IHDR *, struct lgpng_budget *, uint8_t *, size_t, uint8_t **, size_t *);
+enum lgpng_err	lgpng_idat_inflate_parallel(struct IHDR *, struct lgpng_budget *, uint8_t *, size_t, unsigned int, uint8_t **, size_t *, size_t *);
+enum lgpng_err	lgpng_idat_inflate_parallel_rows(struct IHDR *, struct lgpng_budget *, uint8_t *, size_t, unsigned int, lgpng_row_fn, void *, size_t *);
+
+/* unfilter */
+typedef void (*lgpng_unfilter_fn)(uint8_t *, const uint8_t *, size_t);
+
+extern const char *lgpng_unfilter_isa;
+
+lgpng_unfilter_fn lgpng_unfilter_select(uint8_t, size_t);
+enum lgpng_err	lgpng_unfilter_row(uint8_t, size_t, uint8_t *, const uint8_t *, size_t);
+enum lgpng_err	lgpng_unfilter_row_scalar(uint8_t, size_t, uint8_t *, const uint8_t *, size_t);
+enum lgpng_err	lgpng_unfilter_image(struct IHDR *, uint8_t *, size_t);
+
+/* filter */
+enum lgpng_heuristic {
+	LGPNG_HEURISTIC_FIXED,
+	LGPNG_HEURISTIC_MINSUM,
+	LGPNG_HEURISTIC_ENTROPY,
+	LGPNG_HEURISTIC_BRUTE,
+	LGPNG_HEURISTIC__MAX,
+};
+
+extern const char *lgpng_heuristicmap[LGPNG_HEURISTIC__MAX];
+
+enum lgpng_err	lgpng_filter_row(uint8_t, size_t, uint8_t *, const uint8_t *, const uint8_t *, size_t);
+enum lgpng_err	lgpng_filter_all(size_t, const uint8_t *, const uint8_t *, size_t, uint8_t *[FILTER_TYPE__MAX], uint64_t [FILTER_TYPE__MAX]);
+uint64_t	lgpng_filter_entropy(const uint8_t *, size_t);
+
+/* adam7 */
+enum lgpng_err	lgpng_adam7_deinterlace(struct IHDR *, const uint8_t *, size_t, uint8_t *, size_t);
+enum lgpng_err	lgpng_adam7_scatter_row(struct IHDR *, int, uint32_t, const uint8_t *, uint8_t *, size_t);
+
+/* convert */
+enum lgpng_format {
+	LGPNG_FORMAT_RGBA8,
+	LGPNG_FORMAT_RGB8,
+	LGPNG_FORMAT_RGBA16,	/* Native endianness */
+	LGPNG_FORMAT_GREY8,
+	LGPNG_FORMAT__MAX,
+};
+
+extern const char *lgpng_formatmap[LGPNG_FORMAT__MAX];
+
+struct lgpng_convert;
+typedef void (*lgpng_convert_fn)(struct lgpng_convert *, uint8_t *, const uint8_t *, uint32_t, uint32_t);
+
+struct lgpng_convert {
+	lgpng_convert_fn	 fn;
+	enum lgpng_format	 format;
+	size_t			 pixelz;
+	bool			 haskey;	/* tRNS colour key */
+	uint16_t		 key[3];
+	uint8_t			 lut[256][8];	/* Final pixels for small samples */
+};
+
+size_t		lgpng_convert_pixelz(enum lgpng_format);
+enum lgpng_err	lgpng_convert_init(struct lgpng_convert *, struct IHDR *, struct PLTE *, struct tRNS *, enum lgpng_format);
+void		lgpng_convert_row(struct lgpng_convert *, uint8_t *, const uint8_t *, uint32_t, uint32_t);
+
+/* decode */
+struct lgpng_decode;
+
+enum lgpng_err	lgpng_decode_new(struct lgpng_budget *, enum lgpng_format, lgpng_row_fn, void *, struct lgpng_decode **);
+enum lgpng_err	lgpng_decode_set_roi(struct lgpng_decode *, uint32_t, uint32_t, uint32_t, uint32_t);
+enum lgpng_err	lgpng_decode_set_threads(struct lgpng_decode *, unsigned int);
+enum lgpng_err	lgpng_decode_chunk(struct lgpng_decode *, uint8_t [4], uint8_t *, uint32_t);
+bool		lgpng_decode_done(struct lgpng_decode *);
+enum lgpng_err	lgpng_decode_finish(struct lgpng_decode *);
+void		lgpng_decode_free(struct lgpng_decode *);
+enum lgpng_err	lgpng_decode_read(struct lgpng_decode *, FILE *);
+enum lgpng_err	lgpng_decode_stream(FILE *, struct lgpng_budget *, enum lgpng_format, lgpng_row_fn, void *);
+
+/* encode */
+struct lgpng_encode;
+
+enum lgpng_err	lgpng_encode_new(FILE *, struct IHDR *, unsigned int, struct lgpng_encode **);
+enum lgpng_err	lgpng_encode_set_level(struct lgpng_encode *, int);
+enum lgpng_err	lgpng_encode_set_restarts(struct lgpng_encode *, bool);
+enum lgpng_err	lgpng_encode_set_filter(struct lgpng_encode *, enum lgpng_heuristic, uint8_t);
+enum lgpng_err	lgpng_encode_row(struct lgpng_encode *, const uint8_t *);
+enum lgpng_err	lgpng_encode_finish(struct lgpng_encode *);
+void		lgpng_encode_free(struct lgpng_encode *);
+
+/* compose */
+struct lgpng_rect {
+	uint32_t	x;
+	uint32_t	y;
+	uint32_t	width;
+	uint32_t	height;
+};
+
+struct lgpng_compose;
+typedef enum lgpng_err (*lgpng_frame_fn)(void *, uint32_t, const uint8_t *, struct lgpng_rect *);
+
+enum lgpng_err	lgpng_compose_new(uint32_t, uint32_t, struct lgpng_compose **);
+enum lgpng_err	lgpng_compose_begin(struct lgpng_compose *, struct fcTL *);
+enum lgpng_err	lgpng_compose_row(void *, uint32_t, uint8_t *, size_t);
+enum lgpng_err	lgpng_compose_canvas(struct lgpng_compose *, const uint8_t **, struct lgpng_rect *);
+void		lgpng_compose_free(struct lgpng_compose *);
+void		lgpng_compose_over(uint8_t *, const uint8_t *, size_t);
+void		lgpng_compose_over_scalar(uint8_t *, const uint8_t *, size_t);
+
+/* apng */
+struct lgpng_apng;
+
+enum lgpng_err	lgpng_apng_index(int, struct lgpng_apng **);
+enum lgpng_err	lgpng_apng_header(struct lgpng_apng *, struct IHDR *, struct acTL *);
+uint32_t	lgpng_apng_frames(struct lgpng_apng *);
+enum lgpng_err	lgpng_apng_frame(struct lgpng_apng *, uint32_t, struct fcTL *);
+enum lgpng_err	lgpng_apng_read_frame(struct lgpng_apng *, uint32_t, uint8_t **, size_t *);
+enum lgpng_err	lgpng_apng_decode_frame(struct lgpng_apng *, uint32_t, struct lgpng_budget *, enum lgpng_format, lgpng_row_fn, void *);
+enum lgpng_err	lgpng_apng_compose(struct lgpng_apng *, struct lgpng_budget *, lgpng_frame_fn, void *);
+enum lgpng_err	lgpng_apng_compose_parallel(struct lgpng_apng *, struct lgpng_budget *, unsigned int, lgpng_frame_fn, void *);
+void		lgpng_apng_free(struct lgpng_apng *);
+
+/* Streaming structure checks, only counters are kept */
+#define LGPNG_APNG_CHECKZ	26	/* Bytes of each chunk looked at */
+
+struct lgpng_apng_check {
+	uint32_t	width;		/* Of the canvas */
+	uint32_t	height;
+	uint32_t	num_frames;	/* As announced by acTL */
+	uint32_t	frames;		/* fcTL seen so far */
+	uint32_t	framedata;	/* Data chunks of the current frame */
+	uint32_t	seq;		/* Next sequence number */
+	bool		hasactl;
+	bool		seenidat;
+	bool		seenfdat;
+	bool		idatframe;	/* The current frame is IDAT */
+};
+
+void		lgpng_apng_check_init(struct lgpng_apng_check *);
+enum lgpng_err	lgpng_apng_check_chunk(struct lgpng_apng_check *, uint8_t [4], uint8_t *, uint32_t, const char **);
+enum lgpng_err	lgpng_apng_check_finish(struct lgpng_apng_check *, const char **);
+
+/* text */
+enum lgpng_err	lgpng_iTXt_get_text(struct iTXt *, struct lgpng_budget *, uint8_t **, size_t *);
+void		lgpng_iTXt_free(struct iTXt *);
+
+/* exif */
+enum exif_tag {
+	EXIF_TAG_MAKE,
+	EXIF_TAG_MODEL,
+	EXIF_TAG_ORIENTATION,
+	EXIF_TAG_SOFTWARE,
+	EXIF_TAG_DATETIME,
+	EXIF_TAG_DATETIME_ORIGINAL,
+	EXIF_TAG_DATETIME_DIGITIZED,
+	EXIF_TAG_EXPOSURE_TIME,
+	EXIF_TAG_FNUMBER,
+	EXIF_TAG_ISO,
+	EXIF_TAG_FOCAL_LENGTH,
+	EXIF_TAG_LENS_MODEL,
+	EXIF_TAG_GPS_LATITUDE_REF,
+	EXIF_TAG_GPS_LATITUDE,
+	EXIF_TAG_GPS_LONGITUDE_REF,
+	EXIF_TAG_GPS_LONGITUDE,
+	EXIF_TAG_GPS_ALTITUDE_REF,
+	EXIF_TAG_GPS_ALTITUDE,
+	EXIF_TAG__MAX,
+};
+
+extern const char *exif_tagmap[EXIF_TAG__MAX];
+
+enum exif_type {
+	EXIF_TYPE_NONE,
+	EXIF_TYPE_BYTE,
+	EXIF_TYPE_ASCII,
+	EXIF_TYPE_SHORT,
+	EXIF_TYPE_LONG,
+	EXIF_TYPE_RATIONAL,
+	EXIF_TYPE_SBYTE,
+	EXIF_TYPE_UNDEFINED,
+	EXIF_TYPE_SSHORT,
+	EXIF_TYPE_SLONG,
+	EXIF_TYPE_SRATIONAL,
+	EXIF_TYPE_FLOAT,
+	EXIF_TYPE_DOUBLE,
+	EXIF_TYPE__MAX,
+};
+
+struct exif_entry {
+	uint16_t	 tag;
+	uint16_t	 type;	/* enum exif_type */
+	uint32_t	 count;
+	uint8_t		*value;	/* Points inside the eXIf data */
+};
+
+struct exif {
+	bool			 bigendian;
+	uint8_t			*data;
+	size_t			 dataz;
+	size_t			 ifds;
+	size_t			 entries;
+	struct exif_entry	 tags[EXIF_TAG__MAX];
+};
+
+enum lgpng_err	lgpng_exif_parse(struct exif *, uint8_t *, size_t);
+struct exif_entry *lgpng_exif_get(struct exif *, enum exif_tag);
+enum lgpng_err	lgpng_exif_get_integer(struct exif *, enum exif_tag, uint32_t, uint32_t *);
+enum lgpng_err	lgpng_exif_get_rational(struct exif *, enum exif_tag, uint32_t, uint32_t *, uint32_t *);
+
+/* icc */
+struct icc_tag {
+	uint8_t		 signature[4];
+	uint32_t	 offset;
+	uint32_t	 size;
+	uint8_t		*data;
+};
+
+struct icc {
+	uint8_t		*profile;	/* Inflated profile */
+	size_t		 profilez;
+	enum lgpng_err	 err;		/* Outcome of the parsing */
+	uint32_t	 size;
+	uint8_t		 cmm[4];
+	uint8_t		 major;
+	uint8_t		 minor;
+	uint8_t		 devclass[4];
+	uint8_t		 colourspace[4];
+	uint8_t		 pcs[4];
+	uint8_t		 platform[4];
+	uint8_t		 manufacturer[4];
+	uint32_t	 intent;
+	uint8_t		 creator[4];
+	uint8_t		 id[16];
+	uint32_t	 tagcount;
+};
+
+uint64_t	lgpng_icc_hash(uint8_t *, size_t);
+enum lgpng_err	lgpng_icc_parse(struct icc *, uint8_t *, size_t);
+enum lgpng_err	lgpng_icc_get_tag(struct icc *, uint32_t, struct icc_tag *);
+enum lgpng_err	lgpng_icc_find_tag(struct icc *, const char *, struct icc_tag *);
+enum lgpng_err	lgpng_icc_get(struct iCCP *, struct lgpng_budget *, struct icc **);
+void		lgpng_icc_cache_flush(void);
+
 /* stream */
 enum lgpng_err	lgpng_stream_is_png(FILE *);
 enum lgpng_err	lgpng_stream_get_length(FILE *, uint32_t *);
@@ -723,6 +1049,7 @@ uint32_t	lgpng_crc_update(uint32_t, uint8_t *, size_t);
 uint32_t	lgpng_crc_finalize(uint32_t);
 uint32_t	lgpng_crc(uint8_t *, size_t);
 bool		lgpng_chunk_crc(uint32_t, uint8_t [4], uint8_t *, uint32_t *);
+uint32_t	lgpng_adler32(uint32_t, const uint8_t *, size_t);
 
 /* helper macro */
 #define MSB16(i) (i & 0xFF00)
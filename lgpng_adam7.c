@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lgpng.h"
+
+struct adam7_pass {
+	const uint8_t	*src;	/* First scanline, after its filter byte */
+	size_t		 srcz;	/* Distance between two scanlines */
+	size_t		 rowz;	/* Useful bytes of a scanline */
+	uint32_t	 width;
+	uint32_t	 height;
+};
+
+typedef void (*adam7_scatter_fn)(uint8_t *, const uint8_t *, uint32_t,
+    uint32_t, uint32_t);
+
+/*
+ * Copy the pixels of one reduced scanline to their place in a full
+ * scanline, starting at column x0 every dx columns.
+ */
+#define ADAM7_SCATTER_BYTES(bpp)					\
+static void								\
+adam7_scatter_##bpp(uint8_t *dst, const uint8_t *src, uint32_t n,	\
+    uint32_t x0, uint32_t dx)						\
+{									\
+	dst += (size_t)x0 * bpp;					\
+	for (uint32_t k = 0; k < n; k++) {				\
+		(void)memcpy(dst, src, bpp);				\
+		dst += (size_t)dx * bpp;				\
+		src += bpp;						\
+	}								\
+}
+
+/*
+ * Same for sub-byte pixels. Destination rows are cleared beforehand so
+ * pixels can simply be or'ed in place.
+ */
+#define ADAM7_SCATTER_BITS(bits)					\
+static void								\
+adam7_scatter_bits##bits(uint8_t *dst, const uint8_t *src, uint32_t n,	\
+    uint32_t x0, uint32_t dx)						\
+{									\
+	const unsigned	 perbyte = 8 / bits;				\
+	const unsigned	 mask = (1 << bits) - 1;			\
+	unsigned	 v, x = x0;					\
+									\
+	for (uint32_t k = 0; k < n; k++, x += dx) {			\
+		v = src[k / perbyte] >> (8 - bits - (k % perbyte) * bits); \
+		v &= mask;						\
+		dst[x / perbyte] |= (uint8_t)(v			\
+		    << (8 - bits - (x % perbyte) * bits));		\
+	}								\
+}
+
+ADAM7_SCATTER_BYTES(1)
+ADAM7_SCATTER_BYTES(2)
+ADAM7_SCATTER_BYTES(3)
+ADAM7_SCATTER_BYTES(4)
+ADAM7_SCATTER_BYTES(6)
+ADAM7_SCATTER_BYTES(8)
+ADAM7_SCATTER_BITS(1)
+ADAM7_SCATTER_BITS(2)
+ADAM7_SCATTER_BITS(4)
+
+static adam7_scatter_fn
+adam7_select(uint8_t bits)
+{
+	switch (bits) {
+	case 1:
+		return(adam7_scatter_bits1);
+	case 2:
+		return(adam7_scatter_bits2);
+	case 4:
+		return(adam7_scatter_bits4);
+	case 8:
+		return(adam7_scatter_1);
+	case 16:
+		return(adam7_scatter_2);
+	case 24:
+		return(adam7_scatter_3);
+	case 32:
+		return(adam7_scatter_4);
+	case 48:
+		return(adam7_scatter_6);
+	case 64:
+		return(adam7_scatter_8);
+	default:
+		return(NULL);
+	}
+}
+
+/*
+ * Rebuild the full resolution image from the seven unfiltered passes
+ * found in raw, as left by lgpng_unfilter_image. Output rows are written
+ * eight at a time, one band of the Adam7 grid, reading every pass
+ * sequentially: the working set stays a few rows wide instead of sweeping
+ * the whole image seven times. Full rows of the last pass are plain
+ * copies.
+ */
+enum lgpng_err
+lgpng_adam7_deinterlace(struct IHDR *ihdr, const uint8_t *raw, size_t rawz,
+    uint8_t *out, size_t stride)
+{
+	uint8_t			 bits;
+	size_t			 needz, offset = 0, rowz;
+	uint32_t		 height, passrow;
+	adam7_scatter_fn	 scatter;
+	struct adam7_pass	 passes[7];
+	const struct lgpng_adam7 *p;
+
+	if (NULL == ihdr || NULL == raw || NULL == out) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (INTERLACE_METHOD_ADAM7 != ihdr->data.interlace) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	bits = lgpng_IHDR_bitsperpixel(ihdr);
+	if (NULL == (scatter = adam7_select(bits))) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	rowz = lgpng_IHDR_rowbytes(ihdr, ihdr->data.width);
+	if (stride < rowz) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (LGPNG_OK != lgpng_IHDR_raw_size(ihdr, &needz) || rawz < needz) {
+		return(LGPNG_TOO_SHORT);
+	}
+	for (int i = 0; i < 7; i++) {
+		lgpng_IHDR_pass_size(ihdr, i, &(passes[i].width),
+		    &(passes[i].height));
+		passes[i].rowz = lgpng_IHDR_rowbytes(ihdr, passes[i].width);
+		passes[i].srcz = passes[i].rowz + 1;
+		passes[i].src = raw + offset + 1;
+		if (0 != passes[i].width) {
+			offset += passes[i].srcz * passes[i].height;
+		}
+	}
+	height = ihdr->data.height;
+	for (uint32_t band = 0; band < height; band += 8) {
+		uint32_t	bandz = height - band < 8 ? height - band : 8;
+
+		if (bits < 8) {
+			for (uint32_t y = band; y < band + bandz; y++) {
+				(void)memset(out + (size_t)y * stride, 0, rowz);
+			}
+		}
+		for (int i = 0; i < 7; i++) {
+			p = &(lgpng_adam7[i]);
+			if (0 == passes[i].width) {
+				continue;
+			}
+			for (uint32_t y = band + p->y; y < band + bandz;
+			    y += p->dy) {
+				passrow = (y - p->y) / p->dy;
+				if (1 == p->dx) {
+					(void)memcpy(out + (size_t)y * stride,
+					    passes[i].src
+					    + passrow * passes[i].srcz, rowz);
+					continue;
+				}
+				scatter(out + (size_t)y * stride,
+				    passes[i].src + passrow * passes[i].srcz,
+				    passes[i].width, p->x, p->dx);
+			}
+		}
+	}
+	return(LGPNG_OK);
+}
+
+/*
+ * Copy the unfiltered scanline passrow of an Adam7 pass to its pixels in
+ * out, laid out as by lgpng_adam7_deinterlace. Sub-byte pixels are or'ed
+ * in place so out must be cleared beforehand. Used when the passes are
+ * not available in a single buffer.
+ */
+enum lgpng_err
+lgpng_adam7_scatter_row(struct IHDR *ihdr, int pass, uint32_t passrow,
+    const uint8_t *row, uint8_t *out, size_t stride)
+{
+	uint32_t		 width, height, y;
+	adam7_scatter_fn	 scatter;
+	const struct lgpng_adam7 *p;
+
+	if (NULL == ihdr || NULL == row || NULL == out || pass < 0
+	    || pass >= 7) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (INTERLACE_METHOD_ADAM7 != ihdr->data.interlace) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (NULL == (scatter = adam7_select(lgpng_IHDR_bitsperpixel(ihdr)))) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (stride < lgpng_IHDR_rowbytes(ihdr, ihdr->data.width)) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	lgpng_IHDR_pass_size(ihdr, pass, &width, &height);
+	if (passrow >= height || 0 == width) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	p = &(lgpng_adam7[pass]);
+	y = p->y + passrow * p->dy;
+	if (1 == p->dx) {
+		(void)memcpy(out + (size_t)y * stride, row,
+		    lgpng_IHDR_rowbytes(ihdr, width));
+	} else {
+		scatter(out + (size_t)y * stride, row, width, p->x, p->dx);
+	}
+	return(LGPNG_OK);
+}
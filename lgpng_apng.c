@@ -0,0 +1,891 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include COMPAT_ENDIAN_H
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lgpng.h"
+
+#define APNG_CONTROLZ	1024
+
+/* The body of an IDAT or fdAT chunk, sequence number excluded */
+struct apng_span {
+	off_t		 offset;
+	uint32_t	 length;
+	bool		 fdat;	/* Preceded by its sequence number */
+};
+
+struct apng_frame {
+	struct fcTL	 fctl;
+	bool		 idat;	/* The default image is the first frame */
+	size_t		 span;	/* First span of the frame */
+	size_t		 spanz;
+	size_t		 zz;	/* Compressed bytes */
+	uint32_t	 maxz;	/* Largest span */
+};
+
+/*
+ * Only the position of the image data is remembered, along with the few
+ * chunks needed to decode a frame on its own.
+ */
+struct lgpng_apng {
+	int			 fd;
+	struct IHDR		 ihdr;
+	uint8_t			 ihdrdata[13];
+	struct acTL		 actl;
+	bool			 hasactl;
+	uint8_t			*plte;
+	uint32_t		 pltez;
+	uint8_t			*trns;
+	uint32_t		 trnsz;
+	struct apng_frame	*frames;
+	uint32_t		 framez;
+	size_t			 framesallocz;
+	struct apng_span	*spans;
+	size_t			 spanz;
+	size_t			 spansallocz;
+};
+
+static enum lgpng_err
+apng_pread(int fd, void *buf, size_t bufz, off_t offset)
+{
+	ssize_t	 n;
+
+	while (0 != bufz) {
+		if (-1 == (n = pread(fd, buf, bufz, offset))) {
+			return(LGPNG_ERROR);
+		}
+		if (0 == n) {
+			return(LGPNG_TOO_SHORT);
+		}
+		buf = (uint8_t *)buf + n;
+		bufz -= (size_t)n;
+		offset += n;
+	}
+	return(LGPNG_OK);
+}
+
+/* Read the body of the chunk at offset in a new buffer and check its CRC */
+static enum lgpng_err
+apng_read_chunk(int fd, off_t offset, uint32_t length, uint8_t type[4],
+    uint8_t **datap)
+{
+	enum lgpng_err	 err;
+	uint32_t	 crc, calc;
+	uint8_t		*data;
+
+	if (NULL == (data = malloc((size_t)length + 4))) {
+		return(LGPNG_NOMEM);
+	}
+	if (LGPNG_OK != (err = apng_pread(fd, data, (size_t)length + 4,
+	    offset))) {
+		free(data);
+		return(err);
+	}
+	(void)memcpy(&crc, data + length, 4);
+	lgpng_chunk_crc(length, type, data, &calc);
+	if (be32toh(crc) != calc) {
+		free(data);
+		return(LGPNG_ERROR);
+	}
+	*datap = data;
+	return(LGPNG_OK);
+}
+
+static enum lgpng_err
+apng_add_frame(struct lgpng_apng *apng, uint8_t *data, uint32_t length)
+{
+	struct apng_frame	*frame;
+
+	if (apng->framez == apng->framesallocz) {
+		size_t	 n = 0 == apng->framesallocz ? 16 :
+		    apng->framesallocz * 2;
+
+		if (NULL == (frame = realloc(apng->frames,
+		    n * sizeof(*frame)))) {
+			return(LGPNG_NOMEM);
+		}
+		apng->frames = frame;
+		apng->framesallocz = n;
+	}
+	frame = &(apng->frames[apng->framez]);
+	(void)memset(frame, 0, sizeof(*frame));
+	if (-1 == lgpng_create_fcTL_from_data(&(frame->fctl), data, length)) {
+		return(LGPNG_ERROR);
+	}
+	frame->span = apng->spanz;
+	apng->framez++;
+	return(LGPNG_OK);
+}
+
+static enum lgpng_err
+apng_add_span(struct lgpng_apng *apng, off_t offset, uint32_t length,
+    bool fdat)
+{
+	struct apng_span	*span;
+	struct apng_frame	*frame;
+
+	if (apng->spanz == apng->spansallocz) {
+		size_t	 n = 0 == apng->spansallocz ? 64 :
+		    apng->spansallocz * 2;
+
+		if (NULL == (span = realloc(apng->spans, n * sizeof(*span)))) {
+			return(LGPNG_NOMEM);
+		}
+		apng->spans = span;
+		apng->spansallocz = n;
+	}
+	span = &(apng->spans[apng->spanz++]);
+	span->offset = offset;
+	span->length = length;
+	span->fdat = fdat;
+	frame = &(apng->frames[apng->framez - 1]);
+	frame->spanz++;
+	frame->zz += length;
+	if (length > frame->maxz) {
+		frame->maxz = length;
+	}
+	return(LGPNG_OK);
+}
+
+static enum lgpng_err
+apng_scan(struct lgpng_apng *apng)
+{
+	enum lgpng_err	 err;
+	bool		 seenidat = false;
+	uint8_t		 hdr[8];
+	uint8_t		*data;
+	uint32_t	 length;
+	off_t		 offset = 8;
+
+	if (LGPNG_OK != (err = apng_pread(apng->fd, hdr, 8, 0))) {
+		return(err);
+	}
+	if (LGPNG_OK != lgpng_data_is_png(hdr, 8)) {
+		return(LGPNG_ERROR);
+	}
+	for (;;) {
+		if (LGPNG_OK != (err = apng_pread(apng->fd, hdr, 8, offset))) {
+			return(err);
+		}
+		(void)memcpy(&length, hdr, 4);
+		length = be32toh(length);
+		if (length > INT32_MAX) {
+			return(LGPNG_INVALID_CHUNK_LENGTH);
+		}
+		if (8 == offset && 0 != memcmp(hdr + 4, "IHDR", 4)) {
+			return(LGPNG_ERROR);
+		}
+		offset += 8;
+		data = NULL;
+		if (0 == memcmp(hdr + 4, "IHDR", 4)
+		    || 0 == memcmp(hdr + 4, "acTL", 4)
+		    || 0 == memcmp(hdr + 4, "fcTL", 4)
+		    || 0 == memcmp(hdr + 4, "PLTE", 4)
+		    || 0 == memcmp(hdr + 4, "tRNS", 4)) {
+			/* None of them can be that large */
+			if (length > APNG_CONTROLZ) {
+				return(LGPNG_INVALID_CHUNK_LENGTH);
+			}
+			if (LGPNG_OK != (err = apng_read_chunk(apng->fd, offset,
+			    length, hdr + 4, &data))) {
+				return(err);
+			}
+		}
+		if (0 == memcmp(hdr + 4, "IHDR", 4)) {
+			if (13 != length || -1 == lgpng_create_IHDR_from_data(
+			    &(apng->ihdr), data, length)) {
+				err = LGPNG_ERROR;
+			} else {
+				(void)memcpy(apng->ihdrdata, data, 13);
+			}
+		} else if (0 == memcmp(hdr + 4, "acTL", 4)) {
+			if (-1 == lgpng_create_acTL_from_data(&(apng->actl),
+			    data, length)) {
+				err = LGPNG_ERROR;
+			}
+			apng->hasactl = true;
+		} else if (0 == memcmp(hdr + 4, "fcTL", 4)) {
+			err = apng_add_frame(apng, data, length);
+		} else if (0 == memcmp(hdr + 4, "PLTE", 4)) {
+			free(apng->plte);
+			apng->plte = data;
+			apng->pltez = length;
+			data = NULL;
+		} else if (0 == memcmp(hdr + 4, "tRNS", 4)) {
+			free(apng->trns);
+			apng->trns = data;
+			apng->trnsz = length;
+			data = NULL;
+		} else if (0 == memcmp(hdr + 4, "IDAT", 4)) {
+			/* A fcTL before IDAT makes it the first frame */
+			if (! seenidat && 1 == apng->framez) {
+				apng->frames[0].idat = true;
+			}
+			seenidat = true;
+			if (1 == apng->framez && apng->frames[0].idat) {
+				err = apng_add_span(apng, offset, length,
+				    false);
+			}
+		} else if (0 == memcmp(hdr + 4, "fdAT", 4)) {
+			if (length < 4 || 0 == apng->framez
+			    || apng->frames[apng->framez - 1].idat) {
+				err = LGPNG_ERROR;
+			} else {
+				err = apng_add_span(apng, offset + 4,
+				    length - 4, true);
+			}
+		} else if (0 == memcmp(hdr + 4, "IEND", 4)) {
+			break;
+		}
+		free(data);
+		if (LGPNG_OK != err) {
+			return(err);
+		}
+		offset += (off_t)length + 4;
+	}
+	return(LGPNG_OK);
+}
+
+/*
+ * Index the frames of the APNG file open as fd. Only the chunk headers
+ * and the small control chunks are read, with pread(2), so the file
+ * offset is left alone and the index can be shared by several threads.
+ * The image data itself is only read, and its CRC checked, when a frame
+ * is asked for. A file without acTL has no frame.
+ */
+enum lgpng_err
+lgpng_apng_index(int fd, struct lgpng_apng **apngp)
+{
+	enum lgpng_err		 err;
+	struct lgpng_apng	*apng;
+
+	if (-1 == fd || NULL == apngp) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (NULL == (apng = calloc(1, sizeof(*apng)))) {
+		return(LGPNG_NOMEM);
+	}
+	apng->fd = fd;
+	if (LGPNG_OK != (err = apng_scan(apng))) {
+		lgpng_apng_free(apng);
+		return(err);
+	}
+	if (! apng->hasactl) {
+		apng->framez = 0;
+	}
+	*apngp = apng;
+	return(LGPNG_OK);
+}
+
+void
+lgpng_apng_free(struct lgpng_apng *apng)
+{
+	if (NULL == apng) {
+		return;
+	}
+	free(apng->plte);
+	free(apng->trns);
+	free(apng->frames);
+	free(apng->spans);
+	free(apng);
+}
+
+/* Give the IHDR and acTL chunks of the file, either may be NULL */
+enum lgpng_err
+lgpng_apng_header(struct lgpng_apng *apng, struct IHDR *ihdr,
+    struct acTL *actl)
+{
+	if (NULL == apng) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (NULL != ihdr) {
+		*ihdr = apng->ihdr;
+	}
+	if (NULL != actl) {
+		*actl = apng->actl;
+	}
+	return(LGPNG_OK);
+}
+
+uint32_t
+lgpng_apng_frames(struct lgpng_apng *apng)
+{
+	if (NULL == apng) {
+		return(0);
+	}
+	return(apng->framez);
+}
+
+/* Give the fcTL chunk of frame n, counted from zero */
+enum lgpng_err
+lgpng_apng_frame(struct lgpng_apng *apng, uint32_t n, struct fcTL *fctl)
+{
+	if (NULL == apng || NULL == fctl || n >= apng->framez) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	*fctl = apng->frames[n].fctl;
+	return(LGPNG_OK);
+}
+
+/* Read one span at buf, buf must have four more bytes for the CRC */
+static enum lgpng_err
+apng_read_span(struct lgpng_apng *apng, struct apng_span *span,
+    uint8_t *buf)
+{
+	enum lgpng_err	 err;
+	uint32_t	 crc;
+	uint8_t		 seq[4];
+
+	crc = lgpng_crc_init();
+	if (span->fdat) {
+		if (LGPNG_OK != (err = apng_pread(apng->fd, seq, 4,
+		    span->offset - 4))) {
+			return(err);
+		}
+		crc = lgpng_crc_update(crc, (uint8_t *)"fdAT", 4);
+		crc = lgpng_crc_update(crc, seq, 4);
+	} else {
+		crc = lgpng_crc_update(crc, (uint8_t *)"IDAT", 4);
+	}
+	if (LGPNG_OK != (err = apng_pread(apng->fd, buf,
+	    (size_t)span->length + 4, span->offset))) {
+		return(err);
+	}
+	crc = lgpng_crc_update(crc, buf, span->length);
+	if (lgpng_crc_finalize(crc) != ((uint32_t)buf[span->length] << 24
+	    | (uint32_t)buf[span->length + 1] << 16
+	    | (uint32_t)buf[span->length + 2] << 8
+	    | buf[span->length + 3])) {
+		return(LGPNG_ERROR);
+	}
+	return(LGPNG_OK);
+}
+
+/*
+ * Read the zlib stream of frame n, from its IDAT or fdAT chunks without
+ * their sequence numbers. Nothing else of the file is read. The buffer
+ * must be released with free(3).
+ */
+enum lgpng_err
+lgpng_apng_read_frame(struct lgpng_apng *apng, uint32_t n, uint8_t **zp,
+    size_t *zzp)
+{
+	enum lgpng_err		 err = LGPNG_OK;
+	size_t			 done = 0;
+	uint8_t			*z;
+	struct apng_frame	*frame;
+
+	if (NULL == apng || NULL == zp || NULL == zzp || n >= apng->framez) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	frame = &(apng->frames[n]);
+	/* The CRC of the last span lands after the data */
+	if (NULL == (z = malloc(frame->zz + 4))) {
+		return(LGPNG_NOMEM);
+	}
+	for (size_t i = 0; LGPNG_OK == err && i < frame->spanz; i++) {
+		err = apng_read_span(apng, &(apng->spans[frame->span + i]),
+		    z + done);
+		done += apng->spans[frame->span + i].length;
+	}
+	if (LGPNG_OK != err) {
+		free(z);
+		return(err);
+	}
+	*zp = z;
+	*zzp = frame->zz;
+	return(LGPNG_OK);
+}
+
+/*
+ * Decode frame n alone, as if it was a PNG file of the size given by its
+ * fcTL chunk: fn sees the rows of the frame, not of the canvas. Only the
+ * chunks of this frame are read, one at a time.
+ */
+enum lgpng_err
+lgpng_apng_decode_frame(struct lgpng_apng *apng, uint32_t n,
+    struct lgpng_budget *budget, enum lgpng_format format, lgpng_row_fn fn,
+    void *arg)
+{
+	enum lgpng_err		 err;
+	uint8_t			 ihdr[13];
+	uint8_t			*buf;
+	uint32_t		 v;
+	struct apng_frame	*frame;
+	struct apng_span	*span;
+	struct lgpng_decode	*dec;
+
+	if (NULL == apng || n >= apng->framez) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	frame = &(apng->frames[n]);
+	if (LGPNG_OK != (err = lgpng_decode_new(budget, format, fn, arg,
+	    &dec))) {
+		return(err);
+	}
+	if (NULL == (buf = malloc((size_t)frame->maxz + 4))) {
+		lgpng_decode_free(dec);
+		return(LGPNG_NOMEM);
+	}
+	/* Same IHDR but for the dimensions */
+	(void)memcpy(ihdr, apng->ihdrdata, sizeof(ihdr));
+	v = htobe32(frame->fctl.data.width);
+	(void)memcpy(ihdr, &v, 4);
+	v = htobe32(frame->fctl.data.height);
+	(void)memcpy(ihdr + 4, &v, 4);
+	err = lgpng_decode_chunk(dec, (uint8_t *)"IHDR", ihdr, sizeof(ihdr));
+	if (LGPNG_OK == err && NULL != apng->plte) {
+		err = lgpng_decode_chunk(dec, (uint8_t *)"PLTE", apng->plte,
+		    apng->pltez);
+	}
+	if (LGPNG_OK == err && NULL != apng->trns) {
+		err = lgpng_decode_chunk(dec, (uint8_t *)"tRNS", apng->trns,
+		    apng->trnsz);
+	}
+	for (size_t i = 0; LGPNG_OK == err && i < frame->spanz; i++) {
+		span = &(apng->spans[frame->span + i]);
+		if (LGPNG_OK != (err = apng_read_span(apng, span, buf))) {
+			break;
+		}
+		err = lgpng_decode_chunk(dec, (uint8_t *)"IDAT", buf,
+		    span->length);
+		if (LGPNG_OK == err && lgpng_decode_done(dec)) {
+			break;
+		}
+	}
+	if (LGPNG_OK == err) {
+		err = lgpng_decode_finish(dec);
+	}
+	free(buf);
+	lgpng_decode_free(dec);
+	return(err);
+}
+
+/*
+ * Render every frame of the animation in order on a canvas of the size
+ * of IHDR. fn is called once a frame is composed with the canvas and the
+ * region that changed since the previous call.
+ */
+enum lgpng_err
+lgpng_apng_compose(struct lgpng_apng *apng, struct lgpng_budget *budget,
+    lgpng_frame_fn fn, void *arg)
+{
+	enum lgpng_err		 err;
+	const uint8_t		*canvas;
+	struct lgpng_rect	 dirty;
+	struct lgpng_compose	*c;
+
+	if (NULL == apng || NULL == fn) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (LGPNG_OK != (err = lgpng_compose_new(apng->ihdr.data.width,
+	    apng->ihdr.data.height, &c))) {
+		return(err);
+	}
+	for (uint32_t n = 0; LGPNG_OK == err && n < apng->framez; n++) {
+		err = lgpng_compose_begin(c, &(apng->frames[n].fctl));
+		if (LGPNG_OK == err) {
+			err = lgpng_apng_decode_frame(apng, n, budget,
+			    LGPNG_FORMAT_RGBA8, lgpng_compose_row, c);
+		}
+		if (LGPNG_OK == err) {
+			(void)lgpng_compose_canvas(c, &canvas, &dirty);
+			err = fn(arg, n, canvas, &dirty);
+		}
+	}
+	lgpng_compose_free(c);
+	return(err);
+}
+
+/* A frame decoded ahead of its turn by a worker */
+struct apng_job {
+	uint8_t		*pixels;	/* RGBA8 rows of the frame */
+	size_t		 rowz;
+	bool		 done;
+	enum lgpng_err	 err;
+};
+
+struct apng_pool {
+	pthread_mutex_t		 lock;
+	pthread_cond_t		 cond;
+	struct lgpng_apng	*apng;
+	struct lgpng_budget	*budget;
+	struct apng_job		*jobs;
+	uint32_t		 next;		/* Frame to decode next */
+	uint32_t		 composed;	/* Frames handed over to fn */
+	uint32_t		 window;	/* Frames decoded in advance */
+	bool			 stop;
+};
+
+static enum lgpng_err
+apng_job_row(void *arg, uint32_t y, uint8_t *row, size_t rowz)
+{
+	struct apng_job	*job = arg;
+
+	if (rowz != job->rowz) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	(void)memcpy(job->pixels + (size_t)y * rowz, row, rowz);
+	return(LGPNG_OK);
+}
+
+/*
+ * Decode one frame with a private copy of the budget, whose consumption
+ * is added to the shared one afterwards under the lock.
+ */
+static enum lgpng_err
+apng_job_decode(struct apng_pool *pool, uint32_t n, struct lgpng_budget *b)
+{
+	uint32_t	 w, h;
+	struct apng_job	*job = &(pool->jobs[n]);
+
+	w = pool->apng->frames[n].fctl.data.width;
+	h = pool->apng->frames[n].fctl.data.height;
+	if (0 == w || 0 == h) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if ((size_t)w > SIZE_MAX / 4 / h) {
+		return(LGPNG_TOO_LONG);
+	}
+	job->rowz = (size_t)w * 4;
+	if (NULL == (job->pixels = malloc(job->rowz * h))) {
+		return(LGPNG_NOMEM);
+	}
+	return(lgpng_apng_decode_frame(pool->apng, n, b, LGPNG_FORMAT_RGBA8,
+	    apng_job_row, job));
+}
+
+/* Take frames in order, never more than window ahead of the compositor */
+static void *
+apng_worker(void *arg)
+{
+	uint32_t		 n;
+	size_t			 startbytes = 0;
+	uint64_t		 startusec = 0;
+	enum lgpng_err		 err;
+	struct lgpng_budget	 local, *b;
+	struct apng_pool	*pool = arg;
+
+	(void)pthread_mutex_lock(&(pool->lock));
+	for (;;) {
+		while (! pool->stop && pool->next < pool->apng->framez
+		    && pool->next - pool->composed >= pool->window) {
+			(void)pthread_cond_wait(&(pool->cond), &(pool->lock));
+		}
+		if (pool->stop || pool->next == pool->apng->framez) {
+			break;
+		}
+		n = pool->next++;
+		b = NULL;
+		if (NULL != pool->budget) {
+			local = *(pool->budget);
+			startbytes = local.used_bytes;
+			startusec = local.used_usec;
+			b = &local;
+		}
+		(void)pthread_mutex_unlock(&(pool->lock));
+		err = apng_job_decode(pool, n, b);
+		(void)pthread_mutex_lock(&(pool->lock));
+		if (NULL != b) {
+			b = pool->budget;
+			b->used_bytes += local.used_bytes - startbytes;
+			b->used_usec += local.used_usec - startusec;
+			if (LGPNG_OK == err && ((0 != b->file_bytes
+			    && b->used_bytes > b->file_bytes)
+			    || (0 != b->file_usec
+			    && b->used_usec > b->file_usec))) {
+				err = LGPNG_BUDGET_EXCEEDED;
+			}
+		}
+		pool->jobs[n].err = err;
+		pool->jobs[n].done = true;
+		(void)pthread_cond_broadcast(&(pool->cond));
+	}
+	(void)pthread_mutex_unlock(&(pool->lock));
+	return(NULL);
+}
+
+/*
+ * Same as lgpng_apng_compose but the frames, each an independent zlib
+ * stream, are inflated and unfiltered by up to threads workers. They are
+ * composed in order on the calling thread, which is also where fn runs,
+ * as soon as they are ready. At most two frames per worker are waiting
+ * in memory at any time.
+ */
+enum lgpng_err
+lgpng_apng_compose_parallel(struct lgpng_apng *apng,
+    struct lgpng_budget *budget, unsigned int threads, lgpng_frame_fn fn,
+    void *arg)
+{
+	enum lgpng_err		 err;
+	unsigned int		 started = 0;
+	const uint8_t		*canvas;
+	pthread_t		*workers;
+	struct apng_job		*job;
+	struct apng_pool	 pool;
+	struct lgpng_rect	 dirty;
+	struct lgpng_compose	*c;
+
+	if (NULL == apng || NULL == fn) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (threads < 2 || apng->framez < 2) {
+		return(lgpng_apng_compose(apng, budget, fn, arg));
+	}
+	if (threads > apng->framez) {
+		threads = apng->framez;
+	}
+	(void)memset(&pool, 0, sizeof(pool));
+	pool.apng = apng;
+	pool.budget = budget;
+	pool.window = threads * 2;
+	if (NULL == (pool.jobs = calloc(apng->framez, sizeof(*pool.jobs)))) {
+		return(LGPNG_NOMEM);
+	}
+	if (NULL == (workers = calloc(threads, sizeof(*workers)))) {
+		free(pool.jobs);
+		return(LGPNG_NOMEM);
+	}
+	if (LGPNG_OK != (err = lgpng_compose_new(apng->ihdr.data.width,
+	    apng->ihdr.data.height, &c))) {
+		free(workers);
+		free(pool.jobs);
+		return(err);
+	}
+	(void)pthread_mutex_init(&(pool.lock), NULL);
+	(void)pthread_cond_init(&(pool.cond), NULL);
+	for (; started < threads; started++) {
+		if (0 != pthread_create(&(workers[started]), NULL,
+		    apng_worker, &pool)) {
+			break;
+		}
+	}
+	/* Not even one thread, fall back to sequential decoding */
+	for (uint32_t n = 0; 0 != started && LGPNG_OK == err
+	    && n < apng->framez; n++) {
+		job = &(pool.jobs[n]);
+		(void)pthread_mutex_lock(&(pool.lock));
+		while (! job->done) {
+			(void)pthread_cond_wait(&(pool.cond), &(pool.lock));
+		}
+		(void)pthread_mutex_unlock(&(pool.lock));
+		if (LGPNG_OK != (err = job->err)) {
+			break;
+		}
+		err = lgpng_compose_begin(c, &(apng->frames[n].fctl));
+		for (uint32_t y = 0; LGPNG_OK == err
+		    && y < apng->frames[n].fctl.data.height; y++) {
+			err = lgpng_compose_row(c, y, job->pixels
+			    + (size_t)y * job->rowz, job->rowz);
+		}
+		if (LGPNG_OK == err) {
+			(void)lgpng_compose_canvas(c, &canvas, &dirty);
+			err = fn(arg, n, canvas, &dirty);
+		}
+		free(job->pixels);
+		job->pixels = NULL;
+		(void)pthread_mutex_lock(&(pool.lock));
+		pool.composed = n + 1;
+		(void)pthread_cond_broadcast(&(pool.cond));
+		(void)pthread_mutex_unlock(&(pool.lock));
+	}
+	(void)pthread_mutex_lock(&(pool.lock));
+	pool.stop = true;
+	(void)pthread_cond_broadcast(&(pool.cond));
+	(void)pthread_mutex_unlock(&(pool.lock));
+	for (unsigned int i = 0; i < started; i++) {
+		(void)pthread_join(workers[i], NULL);
+	}
+	for (uint32_t n = 0; n < apng->framez; n++) {
+		free(pool.jobs[n].pixels);
+	}
+	(void)pthread_cond_destroy(&(pool.cond));
+	(void)pthread_mutex_destroy(&(pool.lock));
+	lgpng_compose_free(c);
+	free(workers);
+	free(pool.jobs);
+	if (0 == started) {
+		return(lgpng_apng_compose(apng, budget, fn, arg));
+	}
+	return(err);
+}
+
+/*
+ * Structure checks done on the fly, in a single pass over the chunks and
+ * with nothing but counters: sequence numbers of fcTL and fdAT chunks go
+ * up by one from zero, frames fit in the canvas, every frame has data and
+ * their number matches acTL. Only the first LGPNG_APNG_CHECKZ bytes of a
+ * chunk are looked at, so fdAT bodies never need to be read. Each call
+ * reports at most one problem in errstr and checking can go on after it.
+ */
+void
+lgpng_apng_check_init(struct lgpng_apng_check *check)
+{
+	(void)memset(check, 0, sizeof(*check));
+}
+
+static enum lgpng_err
+apng_check_seq(struct lgpng_apng_check *check, uint32_t seq,
+    const char **errstr)
+{
+	if (seq != check->seq) {
+		*errstr = "sequence number out of order";
+		/* Resynchronise so only the culprit is reported */
+		check->seq = seq + 1;
+		return(LGPNG_ERROR);
+	}
+	check->seq++;
+	return(LGPNG_OK);
+}
+
+static enum lgpng_err
+apng_check_fcTL(struct lgpng_apng_check *check, uint8_t *data,
+    uint32_t length, const char **errstr)
+{
+	struct fcTL	 fctl;
+
+	if (! check->hasactl) {
+		*errstr = "fcTL without acTL";
+		return(LGPNG_ERROR);
+	}
+	if (-1 == lgpng_create_fcTL_from_data(&fctl, data, length)) {
+		*errstr = "invalid fcTL";
+		return(LGPNG_ERROR);
+	}
+	if (0 != check->frames && 0 == check->framedata) {
+		*errstr = "frame without data";
+		check->framedata = 1;
+		return(LGPNG_ERROR);
+	}
+	check->frames++;
+	check->framedata = 0;
+	check->idatframe = ! check->seenidat;
+	if (LGPNG_OK != apng_check_seq(check, fctl.data.sequence_number,
+	    errstr)) {
+		return(LGPNG_ERROR);
+	}
+	if (fctl.data.x_offset > check->width
+	    || fctl.data.width > check->width - fctl.data.x_offset
+	    || fctl.data.y_offset > check->height
+	    || fctl.data.height > check->height - fctl.data.y_offset) {
+		*errstr = "frame outside of the canvas";
+		return(LGPNG_ERROR);
+	}
+	if (check->idatframe && (fctl.data.width != check->width
+	    || fctl.data.height != check->height)) {
+		*errstr = "default image smaller than the canvas";
+		return(LGPNG_ERROR);
+	}
+	return(LGPNG_OK);
+}
+
+enum lgpng_err
+lgpng_apng_check_chunk(struct lgpng_apng_check *check, uint8_t type[4],
+    uint8_t *data, uint32_t length, const char **errstr)
+{
+	struct IHDR	 ihdr;
+	struct acTL	 actl;
+	struct fdAT	 fdat;
+
+	if (NULL == check || NULL == type || NULL == errstr
+	    || (NULL == data && 0 != length)) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	*errstr = NULL;
+	if (0 == memcmp(type, "IHDR", 4)) {
+		if (-1 == lgpng_create_IHDR_from_data(&ihdr, data, length)) {
+			*errstr = "invalid IHDR";
+			return(LGPNG_ERROR);
+		}
+		check->width = ihdr.data.width;
+		check->height = ihdr.data.height;
+	} else if (0 == memcmp(type, "acTL", 4)) {
+		if (check->hasactl) {
+			*errstr = "multiple acTL";
+			return(LGPNG_ERROR);
+		}
+		if (check->seenidat) {
+			*errstr = "acTL after IDAT";
+			return(LGPNG_ERROR);
+		}
+		if (-1 == lgpng_create_acTL_from_data(&actl, data, length)) {
+			*errstr = "invalid acTL";
+			return(LGPNG_ERROR);
+		}
+		check->hasactl = true;
+		check->num_frames = actl.data.num_frames;
+	} else if (0 == memcmp(type, "fcTL", 4)) {
+		return(apng_check_fcTL(check, data, length, errstr));
+	} else if (0 == memcmp(type, "IDAT", 4)) {
+		if (check->seenfdat) {
+			*errstr = "IDAT after fdAT";
+			return(LGPNG_ERROR);
+		}
+		check->seenidat = true;
+		if (check->idatframe) {
+			check->framedata++;
+		}
+	} else if (0 == memcmp(type, "fdAT", 4)) {
+		check->seenfdat = true;
+		if (! check->hasactl) {
+			*errstr = "fdAT without acTL";
+			return(LGPNG_ERROR);
+		}
+		if (-1 == lgpng_create_fdAT_from_data(&fdat, data, length)) {
+			*errstr = "invalid fdAT";
+			return(LGPNG_ERROR);
+		}
+		if (! check->seenidat) {
+			*errstr = "fdAT before IDAT";
+			return(LGPNG_ERROR);
+		}
+		if (0 == check->frames || check->idatframe) {
+			*errstr = "fdAT without fcTL";
+			return(LGPNG_ERROR);
+		}
+		check->framedata++;
+		return(apng_check_seq(check, fdat.data.sequence_number,
+		    errstr));
+	}
+	return(LGPNG_OK);
+}
+
+/* Once every chunk was seen, check the frame count */
+enum lgpng_err
+lgpng_apng_check_finish(struct lgpng_apng_check *check, const char **errstr)
+{
+	if (NULL == check || NULL == errstr) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	*errstr = NULL;
+	if (0 != check->frames && 0 == check->framedata) {
+		*errstr = "frame without data";
+		return(LGPNG_ERROR);
+	}
+	if (check->hasactl && check->frames != check->num_frames) {
+		*errstr = "number of frames different from acTL";
+		return(LGPNG_ERROR);
+	}
+	return(LGPNG_OK);
+}
@@ -44,6 +44,14 @@ const char *filtermethodmap[FILTER_METHOD__MAX] = {
 	"adaptive",
 };
 
+const char *filtertypemap[FILTER_TYPE__MAX] = {
+	"none",
+	"sub",
+	"up",
+	"average",
+	"paeth",
+};
+
 const char *interlacemap[INTERLACE_METHOD__MAX] = {
 	"standard",
 	"adam7",
@@ -98,6 +106,16 @@ const char *user_inputmap[USER_INPUT__MAX] = {
 	"user input is expected",
 };
 
+const struct lgpng_adam7 lgpng_adam7[7] = {
+	{ 0, 0, 8, 8 },
+	{ 4, 0, 8, 8 },
+	{ 0, 4, 4, 8 },
+	{ 2, 0, 4, 4 },
+	{ 0, 2, 2, 4 },
+	{ 1, 0, 2, 2 },
+	{ 0, 1, 1, 2 },
+};
+
 bool
 lgpng_validate_keyword(uint8_t *keyword, size_t keywordz)
 {
@@ -161,6 +179,110 @@ lgpng_create_IHDR_from_data(struct IHDR *ihdr, uint8_t *data, uint32_t length)
 	return(0);
 }
 
+/*
+ * Number of bits used by one pixel, or 0 for an invalid combination of
+ * colour type and bit depth.
+ */
+uint8_t
+lgpng_IHDR_bitsperpixel(struct IHDR *ihdr)
+{
+	uint8_t	depth = ihdr->data.bitdepth;
+
+	switch (ihdr->data.colourtype) {
+	case COLOUR_TYPE_GREYSCALE:
+		if (1 != depth && 2 != depth && 4 != depth && 8 != depth
+		    && 16 != depth) {
+			return(0);
+		}
+		return(depth);
+	case COLOUR_TYPE_INDEXED:
+		if (1 != depth && 2 != depth && 4 != depth && 8 != depth) {
+			return(0);
+		}
+		return(depth);
+	case COLOUR_TYPE_TRUECOLOUR:
+	case COLOUR_TYPE_GREYSCALE_ALPHA:
+	case COLOUR_TYPE_TRUECOLOUR_ALPHA:
+		if (8 != depth && 16 != depth) {
+			return(0);
+		}
+		if (COLOUR_TYPE_TRUECOLOUR == ihdr->data.colourtype) {
+			return((uint8_t)(depth * 3));
+		}
+		if (COLOUR_TYPE_GREYSCALE_ALPHA == ihdr->data.colourtype) {
+			return((uint8_t)(depth * 2));
+		}
+		return((uint8_t)(depth * 4));
+	default:
+		return(0);
+	}
+}
+
+/* Bytes in a scanline of the given width, filter byte excluded */
+size_t
+lgpng_IHDR_rowbytes(struct IHDR *ihdr, uint32_t width)
+{
+	return(((size_t)width * lgpng_IHDR_bitsperpixel(ihdr) + 7) / 8);
+}
+
+/*
+ * Dimensions of the reduced image transmitted by one of the seven Adam7
+ * passes, or of the whole image for pass 0 of a non interlaced one.
+ */
+void
+lgpng_IHDR_pass_size(struct IHDR *ihdr, int pass, uint32_t *width,
+    uint32_t *height)
+{
+	const struct lgpng_adam7	*p;
+
+	if (INTERLACE_METHOD_ADAM7 != ihdr->data.interlace) {
+		*width = ihdr->data.width;
+		*height = ihdr->data.height;
+		return;
+	}
+	p = &(lgpng_adam7[pass]);
+	*width = 0;
+	*height = 0;
+	if (ihdr->data.width > p->x && ihdr->data.height > p->y) {
+		*width = (ihdr->data.width - p->x + p->dx - 1) / p->dx;
+		*height = (ihdr->data.height - p->y + p->dy - 1) / p->dy;
+	}
+}
+
+/*
+ * Exact size of the decompressed image data: every scanline of every pass
+ * along with its filter byte.
+ */
+enum lgpng_err
+lgpng_IHDR_raw_size(struct IHDR *ihdr, size_t *rawz)
+{
+	int		 passes;
+	uint32_t	 width, height;
+	uint64_t	 total = 0;
+
+	if (NULL == ihdr || NULL == rawz) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (0 == ihdr->data.width || 0 == ihdr->data.height
+	    || 0 == lgpng_IHDR_bitsperpixel(ihdr)
+	    || ihdr->data.interlace >= INTERLACE_METHOD__MAX) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	passes = INTERLACE_METHOD_ADAM7 == ihdr->data.interlace ? 7 : 1;
+	for (int pass = 0; pass < passes; pass++) {
+		lgpng_IHDR_pass_size(ihdr, pass, &width, &height);
+		if (0 == width || 0 == height) {
+			continue;
+		}
+		total += (uint64_t)height * (1 + lgpng_IHDR_rowbytes(ihdr, width));
+	}
+	if (total > SIZE_MAX) {
+		return(LGPNG_TOO_LONG);
+	}
+	*rawz = (size_t)total;
+	return(LGPNG_OK);
+}
+
 int
 lgpng_create_PLTE_from_data(struct PLTE *plte, uint8_t *data, uint32_t length)
 {
@@ -218,9 +340,9 @@ lgpng_create_tRNS_from_data(struct tRNS *trns, struct IHDR *ihdr, uint8_t *data,
 		}
 		(void)memcpy(&(trns->data.red), data, 2);
 		trns->data.red = be16toh(trns->data.red);
-		(void)memcpy(&(trns->data.green), data, 2);
+		(void)memcpy(&(trns->data.green), data + 2, 2);
 		trns->data.green = be16toh(trns->data.green);
-		(void)memcpy(&(trns->data.blue), data, 2);
+		(void)memcpy(&(trns->data.blue), data + 4, 2);
 		trns->data.blue = be16toh(trns->data.blue);
 		break;
 	case COLOUR_TYPE_INDEXED:
@@ -509,6 +631,122 @@ lgpng_create_zTXt_from_data(struct zTXt *ztxt, uint8_t *data, uint32_t length)
 	return(0);
 }
 
+int
+lgpng_create_iTXt_from_data(struct iTXt *itxt, uint8_t *data, uint32_t length)
+{
+	size_t	 offset;
+	uint8_t	*nul;
+
+	itxt->length = length;
+	(void)memcpy(&(itxt->type), "iTXt", 4);
+	itxt->data.inflatedz = 0;
+	itxt->data.inflated = NULL;
+	if (NULL == (nul = memchr(data, '\0', length < 80 ? length : 80))) {
+		return(-1);
+	}
+	offset = (size_t)(nul - data);
+	(void)memset(itxt->data.keyword, 0, sizeof(itxt->data.keyword));
+	(void)memcpy(itxt->data.keyword, data, offset);
+	itxt->data.keywordz = offset;
+	if (1 > offset || 79 < offset) {
+		return(-1);
+	}
+	if (!lgpng_validate_keyword(itxt->data.keyword, offset)) {
+		return(-1);
+	}
+	/*
+	 * The compression flag and method follow the null separator
+	 */
+	if (offset + 3 > length) {
+		return(-1);
+	}
+	itxt->data.compressed = data[offset + 1];
+	itxt->data.compression = data[offset + 2];
+	if (0 != itxt->data.compressed && 1 != itxt->data.compressed) {
+		return(-1);
+	}
+	/* The method of uncompressed text is to be ignored */
+	if (1 == itxt->data.compressed
+	    && COMPRESSION_TYPE_DEFLATE != itxt->data.compression) {
+		return(-1);
+	}
+	offset += 3;
+	/*
+	 * Language tag and translated keyword are only referenced,
+	 * both of them can be empty.
+	 */
+	if (NULL == (nul = memchr(data + offset, '\0', length - offset))) {
+		return(-1);
+	}
+	itxt->data.language = data + offset;
+	itxt->data.languagez = (size_t)(nul - itxt->data.language);
+	for (size_t i = 0; i < itxt->data.languagez; i++) {
+		if (0 == isalnum(itxt->data.language[i])
+		    && '-' != itxt->data.language[i]) {
+			return(-1);
+		}
+	}
+	offset += itxt->data.languagez + 1;
+	if (NULL == (nul = memchr(data + offset, '\0', length - offset))) {
+		return(-1);
+	}
+	itxt->data.translated = data + offset;
+	itxt->data.translatedz = (size_t)(nul - itxt->data.translated);
+	offset += itxt->data.translatedz + 1;
+	/*
+	 * The text itself is not decompressed here, see lgpng_iTXt_get_text
+	 */
+	itxt->data.text = data + offset;
+	itxt->data.textz = length - offset;
+	return(0);
+}
+
+/*
+ * Inflate the text of an iTXt chunk the first time it is requested and
+ * keep the result around for subsequent calls. Uncompressed text is
+ * returned as is.
+ */
+enum lgpng_err
+lgpng_iTXt_get_text(struct iTXt *itxt, struct lgpng_budget *budget,
+    uint8_t **text, size_t *textz)
+{
+	enum lgpng_err	 err;
+	size_t		 outz;
+	uint8_t		*out;
+
+	if (NULL == itxt || NULL == text || NULL == textz) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (0 == itxt->data.compressed) {
+		*text = itxt->data.text;
+		*textz = itxt->data.textz;
+		return(LGPNG_OK);
+	}
+	if (NULL == itxt->data.inflated) {
+		err = lgpng_inflate_chunk_alloc(itxt->data.text,
+		    itxt->data.textz, budget, &out, &outz);
+		if (LGPNG_OK != err) {
+			return(err);
+		}
+		itxt->data.inflated = out;
+		itxt->data.inflatedz = outz;
+	}
+	*text = itxt->data.inflated;
+	*textz = itxt->data.inflatedz;
+	return(LGPNG_OK);
+}
+
+void
+lgpng_iTXt_free(struct iTXt *itxt)
+{
+	if (NULL == itxt) {
+		return;
+	}
+	free(itxt->data.inflated);
+	itxt->data.inflated = NULL;
+	itxt->data.inflatedz = 0;
+}
+
 int
 lgpng_create_bKGD_from_data(struct bKGD *bkgd, struct IHDR *ihdr, struct PLTE *plte, uint8_t *data, uint32_t length)
 {
@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#include "lgpng.h"
+
+/*
+ * Composition of APNG frames on a RGBA8 canvas. Only the area of the
+ * current frame is blended and only the area of the previous one is
+ * disposed of, so the work done for each frame is proportional to the
+ * pixels it changes. The region overwritten by a DISPOSE_OP_PREVIOUS
+ * frame is saved on its own, never the whole canvas.
+ */
+struct lgpng_compose {
+	uint32_t		 width;
+	uint32_t		 height;
+	size_t			 stride;
+	uint8_t			*canvas;
+	uint32_t		 frames;	/* Begun so far */
+	struct lgpng_rect	 frame;		/* Current frame */
+	uint8_t			 dispose;
+	uint8_t			 blend;
+	struct lgpng_rect	 dirty;
+	uint8_t			*saved;		/* For DISPOSE_OP_PREVIOUS */
+	size_t			 savedallocz;
+};
+
+/* Non-premultiplied alpha, as given by the APNG specification */
+static inline void
+compose_over_pixel(uint8_t *dst, const uint8_t *src)
+{
+	uint32_t	 u, v, al;
+
+	if (255 == src[3]) {
+		(void)memcpy(dst, src, 4);
+		return;
+	}
+	if (0 == src[3]) {
+		return;
+	}
+	u = src[3] * 255U;
+	v = (255U - src[3]) * dst[3];
+	al = u + v;
+	for (int c = 0; c < 3; c++) {
+		dst[c] = (uint8_t)((src[c] * u + dst[c] * v) / al);
+	}
+	dst[3] = (uint8_t)(al / 255);
+}
+
+/* Same as lgpng_compose_over without any vector code, for testing */
+void
+lgpng_compose_over_scalar(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+	for (size_t i = 0; i < pixels; i++) {
+		compose_over_pixel(dst + i * 4, src + i * 4);
+	}
+}
+
+#if defined(__SSE2__)
+
+/*
+ * Blend four pixels over an opaque background. The exact formula then
+ * becomes (s * a + d * (255 - a)) / 255 which fits in 16 bits, and the
+ * division is done as (x + 1 + (x >> 8)) >> 8, exact up to 255 * 255.
+ */
+static inline __m128i
+compose_over_opaque(__m128i s, __m128i d)
+{
+	__m128i	 zero = _mm_setzero_si128();
+	__m128i	 k255 = _mm_set1_epi16(255);
+	__m128i	 one = _mm_set1_epi16(1);
+	__m128i	 sl, sh, dl, dh, al, ah, lo, hi;
+
+	sl = _mm_unpacklo_epi8(s, zero);
+	sh = _mm_unpackhi_epi8(s, zero);
+	dl = _mm_unpacklo_epi8(d, zero);
+	dh = _mm_unpackhi_epi8(d, zero);
+	al = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sl,
+	    _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	ah = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sh,
+	    _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+	lo = _mm_add_epi16(_mm_mullo_epi16(sl, al),
+	    _mm_mullo_epi16(dl, _mm_sub_epi16(k255, al)));
+	hi = _mm_add_epi16(_mm_mullo_epi16(sh, ah),
+	    _mm_mullo_epi16(dh, _mm_sub_epi16(k255, ah)));
+	lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one),
+	    _mm_srli_epi16(lo, 8)), 8);
+	hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one),
+	    _mm_srli_epi16(hi, 8)), 8);
+	return(_mm_packus_epi16(lo, hi));
+}
+
+/*
+ * Four pixels at a time. Runs of opaque or fully transparent source
+ * pixels, the common case in animations, are a single store or nothing
+ * at all. Translucent pixels over an opaque canvas are blended in vector
+ * registers, anything else goes through the scalar code.
+ */
+void
+lgpng_compose_over(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+	__m128i	 amask = _mm_set1_epi32((int)0xff000000U);
+	__m128i	 zero = _mm_setzero_si128();
+	__m128i	 s, d, sa;
+	size_t	 i = 0;
+
+	for (; i + 4 <= pixels; i += 4) {
+		s = _mm_loadu_si128((const __m128i *)(src + i * 4));
+		sa = _mm_and_si128(s, amask);
+		if (0xffff == _mm_movemask_epi8(_mm_cmpeq_epi32(sa, amask))) {
+			_mm_storeu_si128((__m128i *)(dst + i * 4), s);
+			continue;
+		}
+		if (0xffff == _mm_movemask_epi8(_mm_cmpeq_epi32(sa, zero))) {
+			continue;
+		}
+		d = _mm_loadu_si128((const __m128i *)(dst + i * 4));
+		if (0xffff == _mm_movemask_epi8(_mm_cmpeq_epi32(
+		    _mm_and_si128(d, amask), amask))) {
+			d = _mm_or_si128(compose_over_opaque(s, d), amask);
+			_mm_storeu_si128((__m128i *)(dst + i * 4), d);
+			continue;
+		}
+		lgpng_compose_over_scalar(dst + i * 4, src + i * 4, 4);
+	}
+	lgpng_compose_over_scalar(dst + i * 4, src + i * 4, pixels - i);
+}
+
+#else /* __SSE2__ */
+
+void
+lgpng_compose_over(uint8_t *dst, const uint8_t *src, size_t pixels)
+{
+	lgpng_compose_over_scalar(dst, src, pixels);
+}
+
+#endif /* __SSE2__ */
+
+static inline uint8_t *
+compose_at(struct lgpng_compose *c, uint32_t x, uint32_t y)
+{
+	return(c->canvas + (size_t)y * c->stride + (size_t)x * 4);
+}
+
+static void
+compose_union(struct lgpng_rect *r, struct lgpng_rect *o)
+{
+	uint32_t	 x1, y1;
+
+	if (0 == o->width || 0 == o->height) {
+		return;
+	}
+	if (0 == r->width || 0 == r->height) {
+		*r = *o;
+		return;
+	}
+	x1 = r->x + r->width > o->x + o->width ? r->x + r->width :
+	    o->x + o->width;
+	y1 = r->y + r->height > o->y + o->height ? r->y + r->height :
+	    o->y + o->height;
+	r->x = r->x < o->x ? r->x : o->x;
+	r->y = r->y < o->y ? r->y : o->y;
+	r->width = x1 - r->x;
+	r->height = y1 - r->y;
+}
+
+/* Move the region r between the canvas and a packed buffer */
+static void
+compose_copy(struct lgpng_compose *c, struct lgpng_rect *r, uint8_t *buf,
+    bool save)
+{
+	size_t		 rowz = (size_t)r->width * 4;
+	uint8_t		*p;
+
+	for (uint32_t y = 0; y < r->height; y++) {
+		p = compose_at(c, r->x, r->y + y);
+		if (save) {
+			(void)memcpy(buf + y * rowz, p, rowz);
+		} else {
+			(void)memcpy(p, buf + y * rowz, rowz);
+		}
+	}
+}
+
+enum lgpng_err
+lgpng_compose_new(uint32_t width, uint32_t height, struct lgpng_compose **cp)
+{
+	struct lgpng_compose	*c;
+
+	if (NULL == cp || 0 == width || 0 == height) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if ((size_t)width > SIZE_MAX / 4 / height) {
+		return(LGPNG_TOO_LONG);
+	}
+	if (NULL == (c = calloc(1, sizeof(*c)))) {
+		return(LGPNG_NOMEM);
+	}
+	c->width = width;
+	c->height = height;
+	c->stride = (size_t)width * 4;
+	/* The canvas starts fully transparent black */
+	if (NULL == (c->canvas = calloc(height, c->stride))) {
+		free(c);
+		return(LGPNG_NOMEM);
+	}
+	*cp = c;
+	return(LGPNG_OK);
+}
+
+/*
+ * Dispose of the previous frame and get ready for a new one, whose rows
+ * are then given to lgpng_compose_row.
+ */
+enum lgpng_err
+lgpng_compose_begin(struct lgpng_compose *c, struct fcTL *fctl)
+{
+	size_t			 areaz;
+	struct lgpng_rect	 r;
+
+	if (NULL == c || NULL == fctl) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	r.x = fctl->data.x_offset;
+	r.y = fctl->data.y_offset;
+	r.width = fctl->data.width;
+	r.height = fctl->data.height;
+	if (0 == r.width || 0 == r.height || r.x > c->width
+	    || r.width > c->width - r.x || r.y > c->height
+	    || r.height > c->height - r.y
+	    || fctl->data.dispose_op >= DISPOSE_OP__MAX
+	    || fctl->data.blend_op >= BLEND_OP__MAX) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	c->dirty.width = c->dirty.height = 0;
+	if (0 != c->frames) {
+		switch (c->dispose) {
+		case DISPOSE_OP_BACKGROUND:
+			for (uint32_t y = 0; y < c->frame.height; y++) {
+				(void)memset(compose_at(c, c->frame.x,
+				    c->frame.y + y), 0,
+				    (size_t)c->frame.width * 4);
+			}
+			c->dirty = c->frame;
+			break;
+		case DISPOSE_OP_PREVIOUS:
+			compose_copy(c, &(c->frame), c->saved, false);
+			c->dirty = c->frame;
+			break;
+		default:
+			break;
+		}
+	}
+	c->frame = r;
+	c->blend = fctl->data.blend_op;
+	c->dispose = fctl->data.dispose_op;
+	if (0 == c->frames && DISPOSE_OP_PREVIOUS == c->dispose) {
+		c->dispose = DISPOSE_OP_BACKGROUND;
+	}
+	if (DISPOSE_OP_PREVIOUS == c->dispose) {
+		areaz = (size_t)r.width * r.height * 4;
+		if (areaz > c->savedallocz) {
+			free(c->saved);
+			if (NULL == (c->saved = malloc(areaz))) {
+				c->savedallocz = 0;
+				return(LGPNG_NOMEM);
+			}
+			c->savedallocz = areaz;
+		}
+		compose_copy(c, &r, c->saved, true);
+	}
+	if (0 == c->frames) {
+		c->dirty.x = c->dirty.y = 0;
+		c->dirty.width = c->width;
+		c->dirty.height = c->height;
+	} else {
+		compose_union(&(c->dirty), &r);
+	}
+	c->frames++;
+	return(LGPNG_OK);
+}
+
+/* A lgpng_row_fn taking the RGBA8 rows of the current frame */
+enum lgpng_err
+lgpng_compose_row(void *arg, uint32_t y, uint8_t *row, size_t rowz)
+{
+	struct lgpng_compose	*c = arg;
+	uint8_t			*dst;
+
+	if (NULL == c || NULL == row || 0 == c->frames
+	    || y >= c->frame.height || rowz != (size_t)c->frame.width * 4) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	dst = compose_at(c, c->frame.x, c->frame.y + y);
+	if (BLEND_OP_SOURCE == c->blend) {
+		(void)memcpy(dst, row, rowz);
+	} else {
+		lgpng_compose_over(dst, row, c->frame.width);
+	}
+	return(LGPNG_OK);
+}
+
+/*
+ * The canvas, width * 4 bytes per row, and the region that changed since
+ * the previous frame. It stays valid until the next lgpng_compose_begin.
+ */
+enum lgpng_err
+lgpng_compose_canvas(struct lgpng_compose *c, const uint8_t **canvasp,
+    struct lgpng_rect *dirty)
+{
+	if (NULL == c || NULL == canvasp) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	*canvasp = c->canvas;
+	if (NULL != dirty) {
+		*dirty = c->dirty;
+	}
+	return(LGPNG_OK);
+}
+
+void
+lgpng_compose_free(struct lgpng_compose *c)
+{
+	if (NULL == c) {
+		return;
+	}
+	free(c->canvas);
+	free(c->saved);
+	free(c);
+}
@@ -0,0 +1,548 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+# include <tmmintrin.h>
+#endif
+
+#include "lgpng.h"
+
+const char *lgpng_formatmap[LGPNG_FORMAT__MAX] = {
+	"rgba8",
+	"rgb8",
+	"rgba16",
+	"grey8",
+};
+
+static const size_t convert_pixelz[LGPNG_FORMAT__MAX] = { 4, 3, 8, 1 };
+
+size_t
+lgpng_convert_pixelz(enum lgpng_format format)
+{
+	if (format >= LGPNG_FORMAT__MAX) {
+		return(0);
+	}
+	return(convert_pixelz[format]);
+}
+
+/* Rec. 709 luma with 15 bits weights, as used by libpng */
+static inline uint16_t
+convert_luma(uint32_t r, uint32_t g, uint32_t b)
+{
+	return((uint16_t)((r * 6968 + g * 23434 + b * 2366 + 16384) >> 15));
+}
+
+/* Store one pixel given as 16 bits channels in the requested format */
+static inline void
+convert_put(uint8_t *dst, enum lgpng_format format, bool grey, uint16_t r,
+    uint16_t g, uint16_t b, uint16_t a)
+{
+	uint16_t	wide[4];
+
+	switch (format) {
+	case LGPNG_FORMAT_RGBA8:
+		dst[3] = (uint8_t)(a >> 8);
+		/* FALLTHROUGH */
+	case LGPNG_FORMAT_RGB8:
+		dst[0] = (uint8_t)(r >> 8);
+		dst[1] = (uint8_t)(g >> 8);
+		dst[2] = (uint8_t)(b >> 8);
+		break;
+	case LGPNG_FORMAT_RGBA16:
+		wide[0] = r;
+		wide[1] = g;
+		wide[2] = b;
+		wide[3] = a;
+		(void)memcpy(dst, wide, sizeof(wide));
+		break;
+	default:
+		dst[0] = (uint8_t)((grey ? r : convert_luma(r, g, b)) >> 8);
+		break;
+	}
+}
+
+/*
+ * Pixels of at most 8 bits with a single channel, that is greyscale and
+ * indexed ones, are looked up in a table holding their final form with
+ * the tRNS transparency already applied.
+ */
+#define CONVERT_LUT(bits, pz)						\
+static void								\
+convert_lut##bits##_##pz(struct lgpng_convert *cv, uint8_t *dst,	\
+    const uint8_t *src, uint32_t x0, uint32_t n)			\
+{									\
+	const unsigned	 perbyte = 8 / bits;				\
+	const unsigned	 mask = (1 << bits) - 1;			\
+	unsigned	 v;						\
+									\
+	for (uint32_t x = x0; x < x0 + n; x++) {			\
+		v = src[x / perbyte] >> (8 - bits - (x % perbyte) * bits); \
+		(void)memcpy(dst, cv->lut[v & mask], pz);		\
+		dst += pz;						\
+	}								\
+}
+
+CONVERT_LUT(1, 1)
+CONVERT_LUT(1, 3)
+CONVERT_LUT(1, 4)
+CONVERT_LUT(1, 8)
+CONVERT_LUT(2, 1)
+CONVERT_LUT(2, 3)
+CONVERT_LUT(2, 4)
+CONVERT_LUT(2, 8)
+CONVERT_LUT(4, 1)
+CONVERT_LUT(4, 3)
+CONVERT_LUT(4, 4)
+CONVERT_LUT(4, 8)
+CONVERT_LUT(8, 1)
+CONVERT_LUT(8, 3)
+CONVERT_LUT(8, 4)
+CONVERT_LUT(8, 8)
+
+#define CONVERT_LUT_SIZES(bits) {					\
+	convert_lut##bits##_4, convert_lut##bits##_3,			\
+	convert_lut##bits##_8, convert_lut##bits##_1,			\
+}
+
+/* Indexed by log2 of the bit depth then by format */
+static const lgpng_convert_fn convert_lut_table[4][LGPNG_FORMAT__MAX] = {
+	CONVERT_LUT_SIZES(1),
+	CONVERT_LUT_SIZES(2),
+	CONVERT_LUT_SIZES(4),
+	CONVERT_LUT_SIZES(8),
+};
+
+/*
+ * Every other layout: ch channels of 8 or 16 bits. The loop is written
+ * once and instantiated for each combination so the compiler can drop the
+ * tests on the constants and vectorize what it can.
+ */
+static inline void
+convert_generic(struct lgpng_convert *cv, uint8_t *dst, const uint8_t *src,
+    uint32_t x0, uint32_t n, unsigned ch, bool wide, enum lgpng_format format)
+{
+	const size_t	 srcz = ch * (wide ? 2 : 1);
+	uint16_t	 c[4], a;
+
+	src += (size_t)x0 * srcz;
+	for (uint32_t k = 0; k < n; k++) {
+		for (unsigned i = 0; i < ch; i++) {
+			if (wide) {
+				c[i] = (uint16_t)(src[2 * i] << 8
+				    | src[2 * i + 1]);
+			} else {
+				c[i] = src[i];
+			}
+		}
+		a = 0xffff;
+		if (2 == ch || 4 == ch) {
+			a = wide ? c[ch - 1] : (uint16_t)(c[ch - 1] * 257);
+		} else if (cv->haskey) {
+			if (c[0] == cv->key[0] && (1 == ch
+			    || (c[1] == cv->key[1] && c[2] == cv->key[2]))) {
+				a = 0;
+			}
+		}
+		if (! wide) {
+			for (unsigned i = 0; i < ch; i++) {
+				c[i] = (uint16_t)(c[i] * 257);
+			}
+		}
+		if (ch < 3) {
+			convert_put(dst, format, true, c[0], c[0], c[0], a);
+		} else {
+			convert_put(dst, format, false, c[0], c[1], c[2], a);
+		}
+		src += srcz;
+		dst += convert_pixelz[format];
+	}
+}
+
+#define CONVERT_GENERIC(ch, depth, format)				\
+static void								\
+convert_##ch##x##depth##_##format(struct lgpng_convert *cv,		\
+    uint8_t *dst, const uint8_t *src, uint32_t x0, uint32_t n)		\
+{									\
+	convert_generic(cv, dst, src, x0, n, ch, 16 == depth,		\
+	    LGPNG_FORMAT_##format);					\
+}
+
+#define CONVERT_GENERIC_FORMATS(ch, depth)				\
+CONVERT_GENERIC(ch, depth, RGBA8)					\
+CONVERT_GENERIC(ch, depth, RGB8)					\
+CONVERT_GENERIC(ch, depth, RGBA16)					\
+CONVERT_GENERIC(ch, depth, GREY8)
+
+CONVERT_GENERIC_FORMATS(1, 16)
+CONVERT_GENERIC_FORMATS(2, 8)
+CONVERT_GENERIC_FORMATS(2, 16)
+CONVERT_GENERIC_FORMATS(3, 8)
+CONVERT_GENERIC_FORMATS(3, 16)
+CONVERT_GENERIC_FORMATS(4, 8)
+CONVERT_GENERIC_FORMATS(4, 16)
+
+#define CONVERT_GENERIC_TABLE(ch, depth) {				\
+	convert_##ch##x##depth##_RGBA8, convert_##ch##x##depth##_RGB8,	\
+	convert_##ch##x##depth##_RGBA16, convert_##ch##x##depth##_GREY8, \
+}
+
+/* Indexed by number of channels minus one, then depth, then format */
+static const lgpng_convert_fn convert_generic_table[4][2][LGPNG_FORMAT__MAX] = {
+	{ { NULL, NULL, NULL, NULL }, CONVERT_GENERIC_TABLE(1, 16) },
+	{ CONVERT_GENERIC_TABLE(2, 8), CONVERT_GENERIC_TABLE(2, 16) },
+	{ CONVERT_GENERIC_TABLE(3, 8), CONVERT_GENERIC_TABLE(3, 16) },
+	{ CONVERT_GENERIC_TABLE(4, 8), CONVERT_GENERIC_TABLE(4, 16) },
+};
+
+/* Same layout on both sides */
+static void
+convert_copy(struct lgpng_convert *cv, uint8_t *dst, const uint8_t *src,
+    uint32_t x0, uint32_t n)
+{
+	(void)memcpy(dst, src + (size_t)x0 * cv->pixelz,
+	    (size_t)n * cv->pixelz);
+}
+
+#if defined(__SSE2__)
+/* Keep the most significant byte of big endian 16 bits samples */
+static void
+convert_16to8_sse2(struct lgpng_convert *cv, uint8_t *dst,
+    const uint8_t *src, uint32_t x0, uint32_t n)
+{
+	size_t		 i = 0, count = (size_t)n * cv->pixelz;
+	const __m128i	 mask = _mm_set1_epi16(0x00ff);
+	__m128i		 lo, hi;
+
+	src += (size_t)x0 * cv->pixelz * 2;
+	for (; i + 16 <= count; i += 16) {
+		lo = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+		hi = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(
+		    _mm_and_si128(lo, mask), _mm_and_si128(hi, mask)));
+	}
+	for (; i < count; i++) {
+		dst[i] = src[2 * i];
+	}
+}
+
+/* Big endian to native 16 bits samples, for little endian hosts */
+static void
+convert_swap16_sse2(struct lgpng_convert *cv, uint8_t *dst,
+    const uint8_t *src, uint32_t x0, uint32_t n)
+{
+	size_t	 i = 0, count = (size_t)n * cv->pixelz;
+	__m128i	 x;
+
+	src += (size_t)x0 * cv->pixelz;
+	for (; i + 16 <= count; i += 16) {
+		x = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(
+		    _mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8)));
+	}
+	for (; i < count; i += 2) {
+		dst[i] = src[i + 1];
+		dst[i + 1] = src[i];
+	}
+}
+#endif
+
+#if defined(__SSSE3__)
+/* Four RGB pixels become four RGBA ones with a single shuffle */
+static void
+convert_rgb_rgba_ssse3(struct lgpng_convert *cv, uint8_t *dst,
+    const uint8_t *src, uint32_t x0, uint32_t n)
+{
+	uint32_t	 k = 0;
+	const __m128i	 shuf = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1,
+			    6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i	 alpha = _mm_set1_epi32((int)0xff000000);
+	__m128i		 x;
+
+	src += (size_t)x0 * 3;
+	/* The load reads 16 bytes, only 12 are needed */
+	for (; k + 6 <= n; k += 4) {
+		x = _mm_loadu_si128((const __m128i *)(src + 3 * k));
+		x = _mm_or_si128(_mm_shuffle_epi8(x, shuf), alpha);
+		_mm_storeu_si128((__m128i *)(dst + 4 * k), x);
+	}
+	convert_3x8_RGBA8(cv, dst + 4 * k, src, k, n - k);
+}
+
+/* Same with the tRNS colour key compared four pixels at a time */
+static void
+convert_rgb_rgba_key_ssse3(struct lgpng_convert *cv, uint8_t *dst,
+    const uint8_t *src, uint32_t x0, uint32_t n)
+{
+	uint32_t	 k = 0;
+	const __m128i	 shuf = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1,
+			    6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i	 alpha = _mm_set1_epi32((int)0xff000000);
+	const __m128i	 key = _mm_set1_epi32(cv->key[0] | cv->key[1] << 8
+			    | cv->key[2] << 16);
+	__m128i		 x, hit;
+
+	src += (size_t)x0 * 3;
+	for (; k + 6 <= n; k += 4) {
+		x = _mm_loadu_si128((const __m128i *)(src + 3 * k));
+		x = _mm_shuffle_epi8(x, shuf);
+		hit = _mm_cmpeq_epi32(x, key);
+		x = _mm_or_si128(x, _mm_andnot_si128(hit, alpha));
+		_mm_storeu_si128((__m128i *)(dst + 4 * k), x);
+	}
+	convert_3x8_RGBA8(cv, dst + 4 * k, src, k, n - k);
+}
+
+/*
+ * Split 16 bytes of 4 bits samples into two vectors of 16 indexes each,
+ * in pixel order, ready for a 16 entries table lookup.
+ */
+static inline void
+convert_nibbles(const uint8_t *src, __m128i *i0, __m128i *i1)
+{
+	const __m128i	 mask = _mm_set1_epi8(0x0f);
+	__m128i		 x, hi, lo;
+
+	x = _mm_loadu_si128((const __m128i *)src);
+	hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+	lo = _mm_and_si128(x, mask);
+	*i0 = _mm_unpacklo_epi8(hi, lo);
+	*i1 = _mm_unpackhi_epi8(hi, lo);
+}
+
+/* 4 bits samples to RGBA8, one table per channel */
+static void
+convert_lut4_4_ssse3(struct lgpng_convert *cv, uint8_t *dst,
+    const uint8_t *src, uint32_t x0, uint32_t n)
+{
+	uint32_t	 k = 0;
+	uint8_t		 planes[4][16];
+	__m128i		 t[4], idx[2], r, g, b, a, rg, ba;
+
+	if (0 != x0 % 2 && 0 != n) {
+		convert_lut4_4(cv, dst, src, x0, 1);
+		dst += 4;
+		x0++;
+		n--;
+	}
+	for (unsigned v = 0; v < 16; v++) {
+		for (unsigned c = 0; c < 4; c++) {
+			planes[c][v] = cv->lut[v][c];
+		}
+	}
+	for (unsigned c = 0; c < 4; c++) {
+		t[c] = _mm_loadu_si128((const __m128i *)planes[c]);
+	}
+	for (; k + 32 <= n; k += 32) {
+		convert_nibbles(src + (x0 + k) / 2, &idx[0], &idx[1]);
+		for (unsigned j = 0; j < 2; j++) {
+			uint8_t	*out = dst + 4 * (k + 16 * j);
+
+			r = _mm_shuffle_epi8(t[0], idx[j]);
+			g = _mm_shuffle_epi8(t[1], idx[j]);
+			b = _mm_shuffle_epi8(t[2], idx[j]);
+			a = _mm_shuffle_epi8(t[3], idx[j]);
+			rg = _mm_unpacklo_epi8(r, g);
+			ba = _mm_unpacklo_epi8(b, a);
+			_mm_storeu_si128((__m128i *)out,
+			    _mm_unpacklo_epi16(rg, ba));
+			_mm_storeu_si128((__m128i *)(out + 16),
+			    _mm_unpackhi_epi16(rg, ba));
+			rg = _mm_unpackhi_epi8(r, g);
+			ba = _mm_unpackhi_epi8(b, a);
+			_mm_storeu_si128((__m128i *)(out + 32),
+			    _mm_unpacklo_epi16(rg, ba));
+			_mm_storeu_si128((__m128i *)(out + 48),
+			    _mm_unpackhi_epi16(rg, ba));
+		}
+	}
+	convert_lut4_4(cv, dst + 4 * k, src, x0 + k, n - k);
+}
+
+/* 4 bits samples to GREY8, a single table */
+static void
+convert_lut4_1_ssse3(struct lgpng_convert *cv, uint8_t *dst,
+    const uint8_t *src, uint32_t x0, uint32_t n)
+{
+	uint32_t	 k = 0;
+	uint8_t		 plane[16];
+	__m128i		 t, idx[2];
+
+	if (0 != x0 % 2 && 0 != n) {
+		convert_lut4_1(cv, dst, src, x0, 1);
+		dst++;
+		x0++;
+		n--;
+	}
+	for (unsigned v = 0; v < 16; v++) {
+		plane[v] = cv->lut[v][0];
+	}
+	t = _mm_loadu_si128((const __m128i *)plane);
+	for (; k + 32 <= n; k += 32) {
+		convert_nibbles(src + (x0 + k) / 2, &idx[0], &idx[1]);
+		_mm_storeu_si128((__m128i *)(dst + k),
+		    _mm_shuffle_epi8(t, idx[0]));
+		_mm_storeu_si128((__m128i *)(dst + k + 16),
+		    _mm_shuffle_epi8(t, idx[1]));
+	}
+	convert_lut4_1(cv, dst + k, src, x0 + k, n - k);
+}
+#endif
+
+/*
+ * Choose the conversion routine for an image once and for all. The
+ * palette is needed for indexed images; transparency is optional. Rows
+ * given to lgpng_convert_row are unfiltered and deinterlaced.
+ */
+enum lgpng_err
+lgpng_convert_init(struct lgpng_convert *cv, struct IHDR *ihdr,
+    struct PLTE *plte, struct tRNS *trns, enum lgpng_format format)
+{
+	unsigned	 ch, depth, log2, max;
+	uint8_t		 colour;
+	bool		 wide;
+
+	if (NULL == cv || NULL == ihdr || format >= LGPNG_FORMAT__MAX) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (0 == lgpng_IHDR_bitsperpixel(ihdr)) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	(void)memset(cv, 0, sizeof(*cv));
+	cv->format = format;
+	colour = ihdr->data.colourtype;
+	depth = ihdr->data.bitdepth;
+	if (COLOUR_TYPE_INDEXED == colour && NULL == plte) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (NULL != trns && (COLOUR_TYPE_GREYSCALE == colour
+	    || COLOUR_TYPE_TRUECOLOUR == colour)) {
+		cv->haskey = true;
+		cv->key[0] = COLOUR_TYPE_GREYSCALE == colour ?
+		    trns->data.gray : trns->data.red;
+		cv->key[1] = trns->data.green;
+		cv->key[2] = trns->data.blue;
+	}
+	if ((COLOUR_TYPE_GREYSCALE == colour && depth <= 8)
+	    || COLOUR_TYPE_INDEXED == colour) {
+		max = (1u << depth) - 1;
+		for (unsigned v = 0; v <= max; v++) {
+			uint16_t	r, g, b, a = 0xffff;
+
+			if (COLOUR_TYPE_INDEXED == colour) {
+				if (v < plte->data.entries) {
+					r = (uint16_t)(plte->data.entry[v].red * 257);
+					g = (uint16_t)(plte->data.entry[v].green * 257);
+					b = (uint16_t)(plte->data.entry[v].blue * 257);
+				} else {
+					r = g = b = 0;
+				}
+				if (NULL != trns && v < trns->data.entries) {
+					a = (uint16_t)(trns->data.palette[v] * 257);
+				}
+			} else {
+				r = g = b = (uint16_t)(v * 0xffff / max);
+				if (cv->haskey && v == cv->key[0]) {
+					a = 0;
+				}
+			}
+			convert_put(cv->lut[v], format,
+			    COLOUR_TYPE_GREYSCALE == colour, r, g, b, a);
+		}
+		for (log2 = 0; (1u << log2) < depth; log2++)
+			continue;
+		cv->fn = convert_lut_table[log2][format];
+#if defined(__SSSE3__)
+		if (4 == depth && LGPNG_FORMAT_RGBA8 == format) {
+			cv->fn = convert_lut4_4_ssse3;
+		}
+		if (4 == depth && LGPNG_FORMAT_GREY8 == format) {
+			cv->fn = convert_lut4_1_ssse3;
+		}
+#endif
+		return(LGPNG_OK);
+	}
+	switch (colour) {
+	case COLOUR_TYPE_GREYSCALE:
+		ch = 1;
+		break;
+	case COLOUR_TYPE_GREYSCALE_ALPHA:
+		ch = 2;
+		break;
+	case COLOUR_TYPE_TRUECOLOUR:
+		ch = 3;
+		break;
+	default:
+		ch = 4;
+		break;
+	}
+	wide = 16 == depth;
+	cv->fn = convert_generic_table[ch - 1][wide][format];
+	cv->pixelz = ch * (wide ? 2 : 1);
+	/* Faster paths for the most common layouts */
+	if (cv->haskey) {
+#if defined(__SSSE3__)
+		/* A key above 255 cannot match 8 bits samples */
+		if (! wide && 3 == ch && LGPNG_FORMAT_RGBA8 == format) {
+			cv->fn = convert_rgb_rgba_key_ssse3;
+			if (cv->key[0] > 255 || cv->key[1] > 255
+			    || cv->key[2] > 255) {
+				cv->fn = convert_rgb_rgba_ssse3;
+			}
+		}
+#endif
+		return(LGPNG_OK);
+	}
+	if (! wide && ((4 == ch && LGPNG_FORMAT_RGBA8 == format)
+	    || (3 == ch && LGPNG_FORMAT_RGB8 == format))) {
+		cv->fn = convert_copy;
+	}
+#if defined(__SSSE3__)
+	if (! wide && 3 == ch && LGPNG_FORMAT_RGBA8 == format) {
+		cv->fn = convert_rgb_rgba_ssse3;
+	}
+#endif
+#if defined(__SSE2__)
+	if (wide && ((4 == ch && LGPNG_FORMAT_RGBA8 == format)
+	    || (3 == ch && LGPNG_FORMAT_RGB8 == format))) {
+		cv->pixelz = ch;
+		cv->fn = convert_16to8_sse2;
+	}
+	if (wide && 4 == ch && LGPNG_FORMAT_RGBA16 == format) {
+		cv->fn = convert_swap16_sse2;
+	}
+#endif
+	return(LGPNG_OK);
+}
+
+/*
+ * Convert n pixels of an unfiltered scanline starting at column x0. The
+ * destination receives n * lgpng_convert_pixelz(format) bytes.
+ */
+void
+lgpng_convert_row(struct lgpng_convert *cv, uint8_t *dst, const uint8_t *src,
+    uint32_t x0, uint32_t n)
+{
+	cv->fn(cv, dst, src, x0, n);
+}
@@ -14,6 +14,17 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+# include <tmmintrin.h>
+#endif
+
 #include "lgpng.h"
 
 uint32_t lgpng_crc_table[256] = {
@@ -108,3 +119,123 @@ lgpng_chunk_crc(uint32_t length, uint8_t type[4], uint8_t *data, uint32_t *crc)
 	return(true);
 }
 
+
+/*
+ * Adler-32 as used by the zlib format. Sums are reduced modulo BASE every
+ * ADLER_NMAX bytes, the largest run that cannot overflow 32 bits.
+ */
+#define ADLER_BASE	65521U
+#define ADLER_NMAX	5552
+
+static uint32_t
+adler_scalar(uint32_t *s1, uint32_t *s2, const uint8_t *data, size_t dataz)
+{
+	size_t	 n;
+
+	while (0 != dataz) {
+		n = dataz < ADLER_NMAX ? dataz : ADLER_NMAX;
+		dataz -= n;
+		while (n--) {
+			*s1 += *data++;
+			*s2 += *s1;
+		}
+		*s1 %= ADLER_BASE;
+		*s2 %= ADLER_BASE;
+	}
+	return(*s2 << 16 | *s1);
+}
+
+#if defined(__SSE2__)
+
+/*
+ * 32 bytes per round. s1 is kept as the byte sums of each half, s2 as the
+ * sums weighted by the distance to the end of the round plus, in ps, the
+ * previous value of s1 for each round to come. Rounds are reduced every
+ * ADLER_ROUNDS, lower than allowed by ADLER_NMAX to keep some room in the
+ * horizontal sums.
+ */
+#define ADLER_ROUNDS	128
+
+static inline uint32_t
+adler_hsum(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return((uint32_t)_mm_cvtsi128_si32(v));
+}
+
+uint32_t
+lgpng_adler32(uint32_t adler, const uint8_t *data, size_t dataz)
+{
+	uint32_t	 s1 = adler & 0xffff, s2 = adler >> 16;
+	size_t		 rounds, n;
+	const __m128i	 zero = _mm_setzero_si128();
+#if defined(__SSSE3__)
+	const __m128i	 tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25,
+			    24, 23, 22, 21, 20, 19, 18, 17);
+	const __m128i	 tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9,
+			    8, 7, 6, 5, 4, 3, 2, 1);
+	const __m128i	 ones = _mm_set1_epi16(1);
+#else
+	const __m128i	 tap1 = _mm_setr_epi16(32, 31, 30, 29, 28, 27, 26, 25);
+	const __m128i	 tap2 = _mm_setr_epi16(24, 23, 22, 21, 20, 19, 18, 17);
+	const __m128i	 tap3 = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+	const __m128i	 tap4 = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+#endif
+
+	if (NULL == data) {
+		return(1);
+	}
+	rounds = dataz / 32;
+	while (0 != rounds) {
+		__m128i	 v_s1, v_s2, v_ps, a, b;
+
+		n = rounds < ADLER_ROUNDS ? rounds : ADLER_ROUNDS;
+		rounds -= n;
+		v_ps = _mm_cvtsi32_si128((int)(s1 * n));
+		v_s2 = _mm_cvtsi32_si128((int)s2);
+		v_s1 = zero;
+		do {
+			a = _mm_loadu_si128((const __m128i *)data);
+			b = _mm_loadu_si128((const __m128i *)(data + 16));
+			v_ps = _mm_add_epi32(v_ps, v_s1);
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(a, zero));
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b, zero));
+#if defined(__SSSE3__)
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+			    _mm_maddubs_epi16(a, tap1), ones));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+			    _mm_maddubs_epi16(b, tap2), ones));
+#else
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+			    _mm_unpacklo_epi8(a, zero), tap1));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+			    _mm_unpackhi_epi8(a, zero), tap2));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+			    _mm_unpacklo_epi8(b, zero), tap3));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+			    _mm_unpackhi_epi8(b, zero), tap4));
+#endif
+			data += 32;
+		} while (--n);
+		v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+		s1 = (s1 + adler_hsum(v_s1)) % ADLER_BASE;
+		s2 = adler_hsum(v_s2) % ADLER_BASE;
+	}
+	return(adler_scalar(&s1, &s2, data, dataz % 32));
+}
+
+#else /* __SSE2__ */
+
+uint32_t
+lgpng_adler32(uint32_t adler, const uint8_t *data, size_t dataz)
+{
+	uint32_t	 s1 = adler & 0xffff, s2 = adler >> 16;
+
+	if (NULL == data) {
+		return(1);
+	}
+	return(adler_scalar(&s1, &s2, data, dataz));
+}
+
+#endif /* __SSE2__ */
@@ -0,0 +1,551 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lgpng.h"
+
+struct lgpng_decode {
+	enum lgpng_format	 format;
+	struct lgpng_budget	*budget;
+	lgpng_row_fn		 fn;
+	void			*arg;
+	struct IHDR		 ihdr;
+	struct PLTE		 plte;
+	struct tRNS		 trns;
+	bool			 hasihdr;
+	bool			 hasplte;
+	bool			 hastrns;
+	bool			 started;
+	bool			 finished;
+	bool			 hasroi;
+	uint32_t		 x0;	/* Region of interest, [x0, x1) */
+	uint32_t		 y0;
+	uint32_t		 x1;
+	uint32_t		 y1;
+	uint32_t		 rows;	/* Rows unfiltered so far */
+	struct lgpng_idat	*idat;
+	unsigned int		 threads;
+	uint8_t			*z;	/* Several threads: the zlib stream */
+	size_t			 zz;
+	size_t			 zallocz;
+	struct lgpng_convert	 cv;
+	size_t			 bpp;	/* Bytes per pixel, for unfiltering */
+	uint8_t			*prev;	/* Previous unfiltered row */
+	uint8_t			*line;	/* One converted row */
+	size_t			 linez;
+	/* Interlaced images inflated by several threads */
+	uint8_t			*image;	/* Rebuilt from the passes */
+	size_t			 stride;
+	int			 pass;
+	uint32_t		 passrow;
+	uint32_t		 passrows;
+};
+
+/*
+ * Create a decoder handing every row of the image, converted to format,
+ * to fn. It is fed with the chunks read by the caller, so metadata and
+ * pixels are handled in a single pass over the file.
+ */
+enum lgpng_err
+lgpng_decode_new(struct lgpng_budget *budget, enum lgpng_format format,
+    lgpng_row_fn fn, void *arg, struct lgpng_decode **decp)
+{
+	struct lgpng_decode	*dec;
+
+	if (NULL == fn || NULL == decp || format >= LGPNG_FORMAT__MAX) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (NULL == (dec = calloc(1, sizeof(*dec)))) {
+		return(LGPNG_NOMEM);
+	}
+	dec->format = format;
+	dec->budget = budget;
+	dec->fn = fn;
+	dec->arg = arg;
+	dec->threads = 1;
+	*decp = dec;
+	return(LGPNG_OK);
+}
+
+void
+lgpng_decode_free(struct lgpng_decode *dec)
+{
+	if (NULL == dec) {
+		return;
+	}
+	lgpng_idat_free(dec->idat);
+	free(dec->z);
+	free(dec->image);
+	free(dec->line);
+	free(dec);
+}
+
+/*
+ * Only hand out rows [y0, y1) and columns [x0, x1) of the image. Must be
+ * called before the first IDAT chunk. For progressive images inflating
+ * stops right after row y1 - 1, the rest of the IDAT stream is not even
+ * read by lgpng_decode_stream.
+ */
+enum lgpng_err
+lgpng_decode_set_roi(struct lgpng_decode *dec, uint32_t x0, uint32_t y0,
+    uint32_t x1, uint32_t y1)
+{
+	if (NULL == dec || dec->started || x0 >= x1 || y0 >= y1) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	dec->hasroi = true;
+	dec->x0 = x0;
+	dec->y0 = y0;
+	dec->x1 = x1;
+	dec->y1 = y1;
+	return(LGPNG_OK);
+}
+
+/*
+ * Inflate the image with up to threads workers, see
+ * lgpng_idat_inflate_parallel_rows. Must be called before the first IDAT
+ * chunk. With more than one thread the zlib stream is gathered and only
+ * inflated on IEND, unless a region of interest ends before the bottom of
+ * a progressive image: stopping early is worth more. With one thread,
+ * the default, IDAT chunks are inflated as they are read.
+ */
+enum lgpng_err
+lgpng_decode_set_threads(struct lgpng_decode *dec, unsigned int threads)
+{
+	if (NULL == dec || dec->started) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	dec->threads = 0 == threads ? 1 : threads;
+	return(LGPNG_OK);
+}
+
+/*
+ * Tell if every requested row was handed out. When the window reaches the
+ * bottom of the image the end of the zlib stream, with its verified
+ * Adler-32, is also needed.
+ */
+bool
+lgpng_decode_done(struct lgpng_decode *dec)
+{
+	uint32_t	 computed, stored;
+
+	if (NULL == dec || ! dec->started) {
+		return(false);
+	}
+	if (dec->finished) {
+		return(true);
+	}
+	if (NULL == dec->idat || dec->rows != dec->y1) {
+		return(false);
+	}
+	return(dec->y1 < dec->ihdr.data.height
+	    || LGPNG_OK == lgpng_idat_adler32(dec->idat, &computed, &stored));
+}
+
+static enum lgpng_err
+decode_emit(struct lgpng_decode *dec, uint32_t y, const uint8_t *row)
+{
+	lgpng_convert_row(&(dec->cv), dec->line, row, dec->x0,
+	    dec->x1 - dec->x0);
+	return(dec->fn(dec->arg, y, dec->line, dec->linez));
+}
+
+/* Progressive images: unfilter in place and convert each row at once */
+static enum lgpng_err
+decode_row(void *arg, uint32_t y, uint8_t *row, size_t rowz)
+{
+	enum lgpng_err		 err;
+	struct lgpng_decode	*dec = arg;
+
+	err = lgpng_unfilter_row(row[0], dec->bpp, row + 1,
+	    0 == y ? NULL : dec->prev, rowz - 1);
+	if (LGPNG_OK != err) {
+		return(err);
+	}
+	dec->prev = row + 1;
+	dec->rows++;
+	/* Rows above the region are still needed to unfilter it */
+	if (y < dec->y0) {
+		return(LGPNG_OK);
+	}
+	return(decode_emit(dec, y, row + 1));
+}
+
+/* Move to the next non empty Adam7 pass */
+static void
+decode_next_pass(struct lgpng_decode *dec)
+{
+	uint32_t	width = 0, height = 0;
+
+	while (++dec->pass < 7) {
+		lgpng_IHDR_pass_size(&(dec->ihdr), dec->pass, &width, &height);
+		if (0 != width && 0 != height) {
+			break;
+		}
+	}
+	dec->passrow = 0;
+	dec->passrows = dec->pass < 7 ? height : 0;
+}
+
+/*
+ * Interlaced images inflated by several threads: unfilter each row of a
+ * pass in place and put its pixels in the rebuilt image.
+ */
+static enum lgpng_err
+decode_pass_row(void *arg, uint32_t y, uint8_t *row, size_t rowz)
+{
+	enum lgpng_err		 err;
+	struct lgpng_decode	*dec = arg;
+
+	(void)y;
+	err = lgpng_unfilter_row(row[0], dec->bpp, row + 1,
+	    0 == dec->passrow ? NULL : dec->prev, rowz - 1);
+	if (LGPNG_OK != err) {
+		return(err);
+	}
+	dec->prev = row + 1;
+	err = lgpng_adam7_scatter_row(&(dec->ihdr), dec->pass, dec->passrow,
+	    row + 1, dec->image, dec->stride);
+	if (LGPNG_OK != err) {
+		return(err);
+	}
+	if (++dec->passrow == dec->passrows) {
+		decode_next_pass(dec);
+	}
+	return(LGPNG_OK);
+}
+
+/* Hand out the rows of the region from the rebuilt interlaced image */
+static enum lgpng_err
+decode_emit_image(struct lgpng_decode *dec, const uint8_t *image,
+    size_t stride)
+{
+	enum lgpng_err	 err = LGPNG_OK;
+
+	for (uint32_t y = dec->y0; LGPNG_OK == err && y < dec->y1; y++) {
+		err = decode_emit(dec, y, image + (size_t)y * stride);
+	}
+	return(err);
+}
+
+/* Interlaced images inflated as they were read */
+static enum lgpng_err
+decode_deinterlace(struct lgpng_decode *dec, uint8_t *raw, size_t rawz)
+{
+	enum lgpng_err	 err;
+	size_t		 rowz;
+	uint8_t		*image;
+
+	if (LGPNG_OK != (err = lgpng_unfilter_image(&(dec->ihdr), raw,
+	    rawz))) {
+		return(err);
+	}
+	rowz = lgpng_IHDR_rowbytes(&(dec->ihdr), dec->ihdr.data.width);
+	if (NULL == (image = calloc(dec->ihdr.data.height, rowz))) {
+		return(LGPNG_NOMEM);
+	}
+	err = lgpng_adam7_deinterlace(&(dec->ihdr), raw, rawz, image, rowz);
+	if (LGPNG_OK == err) {
+		err = decode_emit_image(dec, image, rowz);
+	}
+	free(image);
+	return(err);
+}
+
+static enum lgpng_err
+decode_start(struct lgpng_decode *dec)
+{
+	enum lgpng_err	 err;
+
+	if (! dec->hasihdr) {
+		return(LGPNG_ERROR);
+	}
+	if (! dec->hasroi) {
+		dec->x1 = dec->ihdr.data.width;
+		dec->y1 = dec->ihdr.data.height;
+	} else if (dec->x1 > dec->ihdr.data.width
+	    || dec->y1 > dec->ihdr.data.height) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (COLOUR_TYPE_INDEXED == dec->ihdr.data.colourtype
+	    && ! dec->hasplte) {
+		return(LGPNG_ERROR);
+	}
+	err = lgpng_convert_init(&(dec->cv), &(dec->ihdr),
+	    dec->hasplte ? &(dec->plte) : NULL,
+	    dec->hastrns ? &(dec->trns) : NULL, dec->format);
+	if (LGPNG_OK != err) {
+		return(err);
+	}
+	dec->bpp = ((size_t)lgpng_IHDR_bitsperpixel(&(dec->ihdr)) + 7) / 8;
+	dec->linez = (size_t)(dec->x1 - dec->x0)
+	    * lgpng_convert_pixelz(dec->format);
+	if (NULL == (dec->line = malloc(dec->linez))) {
+		return(LGPNG_NOMEM);
+	}
+	/* Without an idat the zlib stream is gathered for the threads */
+	if (dec->threads > 1
+	    && (INTERLACE_METHOD_ADAM7 == dec->ihdr.data.interlace
+	    || dec->y1 == dec->ihdr.data.height)) {
+		return(LGPNG_OK);
+	}
+	/*
+	 * Adam7 needs every pass before the first row can be rebuilt, so
+	 * interlaced images are inflated whole and handed out on IEND.
+	 */
+	if (INTERLACE_METHOD_ADAM7 == dec->ihdr.data.interlace) {
+		return(lgpng_idat_new(&(dec->ihdr), dec->budget, &(dec->idat)));
+	}
+	err = lgpng_idat_new_rows(&(dec->ihdr), dec->budget, decode_row,
+	    dec, &(dec->idat));
+	if (LGPNG_OK != err) {
+		return(err);
+	}
+	/* A full decode drains the stream up to its trailer */
+	if (dec->y1 < dec->ihdr.data.height) {
+		return(lgpng_idat_limit(dec->idat, dec->y1));
+	}
+	return(LGPNG_OK);
+}
+
+/* Append the body of an IDAT chunk to the zlib stream */
+static enum lgpng_err
+decode_gather(struct lgpng_decode *dec, uint8_t *data, uint32_t length)
+{
+	size_t		 allocz;
+	uint8_t		*tmp;
+
+	if (dec->finished) {
+		return(LGPNG_OK);
+	}
+	if (length > SIZE_MAX - dec->zz) {
+		return(LGPNG_TOO_LONG);
+	}
+	if (dec->zz + length > dec->zallocz) {
+		allocz = 0 == dec->zallocz ? 65536 : dec->zallocz;
+		while (allocz < dec->zz + length) {
+			allocz = allocz > SIZE_MAX / 2 ?
+			    dec->zz + length : allocz * 2;
+		}
+		if (NULL == (tmp = realloc(dec->z, allocz))) {
+			return(LGPNG_NOMEM);
+		}
+		dec->z = tmp;
+		dec->zallocz = allocz;
+	}
+	if (0 != length) {
+		(void)memcpy(dec->z + dec->zz, data, length);
+	}
+	dec->zz += length;
+	return(LGPNG_OK);
+}
+
+/*
+ * Give one chunk to the decoder. Only IHDR, PLTE, tRNS and IDAT matter,
+ * other chunks are ignored. The data is not kept after the call.
+ */
+enum lgpng_err
+lgpng_decode_chunk(struct lgpng_decode *dec, uint8_t type[4], uint8_t *data,
+    uint32_t length)
+{
+	enum lgpng_err	err;
+
+	if (NULL == dec || NULL == type || (NULL == data && 0 != length)) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (0 == memcmp(type, "IHDR", 4)) {
+		if (dec->hasihdr) {
+			return(LGPNG_ERROR);
+		}
+		if (-1 == lgpng_create_IHDR_from_data(&(dec->ihdr), data,
+		    length)) {
+			return(LGPNG_ERROR);
+		}
+		dec->hasihdr = true;
+	} else if (0 == memcmp(type, "PLTE", 4) && ! dec->started) {
+		if (-1 == lgpng_create_PLTE_from_data(&(dec->plte), data,
+		    length)) {
+			return(LGPNG_ERROR);
+		}
+		dec->hasplte = true;
+	} else if (0 == memcmp(type, "tRNS", 4) && ! dec->started) {
+		if (! dec->hasihdr) {
+			return(LGPNG_ERROR);
+		}
+		if (-1 == lgpng_create_tRNS_from_data(&(dec->trns),
+		    &(dec->ihdr), data, length)) {
+			return(LGPNG_ERROR);
+		}
+		dec->hastrns = true;
+	} else if (0 == memcmp(type, "IDAT", 4)) {
+		if (! dec->started) {
+			if (LGPNG_OK != (err = decode_start(dec))) {
+				return(err);
+			}
+			dec->started = true;
+		}
+		if (NULL != dec->idat) {
+			return(lgpng_idat_feed(dec->idat, data, length));
+		}
+		return(decode_gather(dec, data, length));
+	}
+	return(LGPNG_OK);
+}
+
+/*
+ * Signal the end of the image data, usually on IEND. Interlaced images
+ * are only unfiltered, rebuilt and handed out at this point, as are all
+ * images inflated by several threads.
+ */
+enum lgpng_err
+lgpng_decode_finish(struct lgpng_decode *dec)
+{
+	enum lgpng_err	 err;
+	size_t		 rawz;
+	uint8_t		*raw;
+
+	if (NULL == dec) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (! dec->started) {
+		return(LGPNG_TOO_SHORT);
+	}
+	if (dec->finished) {
+		return(LGPNG_OK);
+	}
+	dec->finished = true;
+	if (NULL != dec->idat) {
+		if (INTERLACE_METHOD_ADAM7 != dec->ihdr.data.interlace) {
+			return(lgpng_idat_finish(dec->idat, NULL, NULL));
+		}
+		/* The buffer belongs to idat */
+		if (LGPNG_OK != (err = lgpng_idat_finish(dec->idat, &raw,
+		    &rawz))) {
+			return(err);
+		}
+		return(decode_deinterlace(dec, raw, rawz));
+	}
+	if (0 == dec->zz) {
+		return(LGPNG_TOO_SHORT);
+	}
+	if (INTERLACE_METHOD_STANDARD == dec->ihdr.data.interlace) {
+		err = lgpng_idat_inflate_parallel_rows(&(dec->ihdr),
+		    dec->budget, dec->z, dec->zz, dec->threads, decode_row, dec,
+		    NULL);
+	} else {
+		dec->stride = lgpng_IHDR_rowbytes(&(dec->ihdr),
+		    dec->ihdr.data.width);
+		if (NULL == (dec->image = calloc(dec->ihdr.data.height,
+		    dec->stride))) {
+			err = LGPNG_NOMEM;
+		} else {
+			dec->pass = -1;
+			decode_next_pass(dec);
+			err = lgpng_idat_inflate_parallel_rows(&(dec->ihdr),
+			    dec->budget, dec->z, dec->zz, dec->threads,
+			    decode_pass_row, dec, NULL);
+		}
+		if (LGPNG_OK == err) {
+			err = decode_emit_image(dec, dec->image, dec->stride);
+		}
+		free(dec->image);
+		dec->image = NULL;
+	}
+	free(dec->z);
+	dec->z = NULL;
+	return(err);
+}
+
+/*
+ * Feed dec with the chunks of a PNG file read from src, after its
+ * signature, until IEND or until every requested row was handed out.
+ * Chunks are read one at a time in a buffer that only grows to the
+ * largest one.
+ */
+enum lgpng_err
+lgpng_decode_read(struct lgpng_decode *dec, FILE *src)
+{
+	enum lgpng_err		 err;
+	uint32_t		 length, crc, calc;
+	size_t			 dataz = 0;
+	uint8_t			*data = NULL, *tmp;
+	uint8_t			 type[4];
+
+	if (NULL == dec || NULL == src) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	for (;;) {
+		if (LGPNG_OK != (err = lgpng_stream_get_length(src, &length))
+		    || LGPNG_OK != (err = lgpng_stream_get_type(src, type))) {
+			break;
+		}
+		if ((size_t)length + 1 > dataz) {
+			if (NULL == (tmp = realloc(data, (size_t)length + 1))) {
+				err = LGPNG_NOMEM;
+				break;
+			}
+			data = tmp;
+			dataz = (size_t)length + 1;
+		}
+		if (LGPNG_OK != (err = lgpng_stream_get_data(src, length,
+		    &data)) || LGPNG_OK != (err = lgpng_stream_get_crc(src,
+		    &crc))) {
+			break;
+		}
+		lgpng_chunk_crc(length, type, data, &calc);
+		if (crc != calc) {
+			err = LGPNG_ERROR;
+			break;
+		}
+		if (0 == memcmp(type, "IEND", 4)) {
+			err = lgpng_decode_finish(dec);
+			break;
+		}
+		if (LGPNG_OK != (err = lgpng_decode_chunk(dec, type, data,
+		    length))) {
+			break;
+		}
+		if (lgpng_decode_done(dec)) {
+			err = lgpng_decode_finish(dec);
+			break;
+		}
+	}
+	free(data);
+	return(err);
+}
+
+/* Decode a whole PNG file read from src, after its signature */
+enum lgpng_err
+lgpng_decode_stream(FILE *src, struct lgpng_budget *budget,
+    enum lgpng_format format, lgpng_row_fn fn, void *arg)
+{
+	enum lgpng_err		 err;
+	struct lgpng_decode	*dec;
+
+	if (LGPNG_OK != (err = lgpng_decode_new(budget, format, fn, arg,
+	    &dec))) {
+		return(err);
+	}
+	err = lgpng_decode_read(dec, src);
+	lgpng_decode_free(dec);
+	return(err);
+}
@@ -0,0 +1,472 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "lgpng.h"
+
+#define ENCODE_BLOCKZ	(128 * 1024)	/* Filtered bytes per IDAT chunk */
+#define ENCODE_DICTZ	32768		/* Deflate window */
+#define ENCODE_SAMPLE	16		/* Rows between two brute force tries */
+
+/*
+ * One block of filtered scanlines, deflated on its own thread. The input
+ * starts with the tail of the previous block, used as a dictionary so the
+ * compression ratio barely suffers from the cut.
+ */
+struct encode_job {
+	pthread_t	 thread;
+	bool		 running;
+	bool		 first;
+	bool		 last;
+	int		 level;
+	uint8_t		*buf;	/* Allocation holding in */
+	uint8_t		*in;
+	size_t		 dictz;
+	size_t		 inz;	/* Block size, after the dictionary */
+	uint8_t		*out;
+	size_t		 outz;
+	uLong		 adler;	/* Of the block alone */
+	uint32_t	 crc;	/* Running CRC of the IDAT chunk */
+	enum lgpng_err	 err;
+};
+
+struct lgpng_encode {
+	FILE			*dst;
+	struct IHDR		 ihdr;
+	size_t			 rowz;
+	size_t			 bpp;
+	uint32_t		 y;
+	int			 level;
+	enum lgpng_heuristic	 heuristic;
+	uint8_t			 filter;	/* Fixed or last brute force */
+	uint8_t			*prev;	/* Previous row, unfiltered */
+	uint8_t			*cand[FILTER_TYPE__MAX];
+	z_stream		 brute;
+	bool			 hasbrute;
+	uint8_t			*brutebuf;
+	size_t			 brutez;
+	bool			 restarts;
+	unsigned int		 threads;
+	struct encode_job	*jobs;	/* Ring of threads jobs */
+	size_t			 head;	/* Oldest job */
+	size_t			 count;	/* Jobs in flight */
+	uint8_t			*block;	/* Dictionary room, then rows */
+	size_t			 blockz;
+	size_t			 dictz;
+	uLong			 adler;
+	bool			 first;
+	bool			 finished;
+	enum lgpng_err		 err;
+};
+
+/*
+ * Prepare the compression of the image data described by ihdr, written
+ * as IDAT chunks to dst. The caller writes everything before, like the
+ * signature and IHDR, and everything after, like IEND. Up to threads
+ * blocks are deflated at the same time. Interlaced images are not
+ * supported.
+ */
+enum lgpng_err
+lgpng_encode_new(FILE *dst, struct IHDR *ihdr, unsigned int threads,
+    struct lgpng_encode **encp)
+{
+	size_t			 rawz;
+	struct lgpng_encode	*enc;
+
+	if (NULL == dst || NULL == ihdr || NULL == encp) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (INTERLACE_METHOD_STANDARD != ihdr->data.interlace) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (LGPNG_OK != lgpng_IHDR_raw_size(ihdr, &rawz)) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (NULL == (enc = calloc(1, sizeof(*enc)))) {
+		return(LGPNG_NOMEM);
+	}
+	enc->dst = dst;
+	enc->ihdr = *ihdr;
+	enc->rowz = lgpng_IHDR_rowbytes(ihdr, ihdr->data.width);
+	enc->bpp = ((size_t)lgpng_IHDR_bitsperpixel(ihdr) + 7) / 8;
+	enc->level = Z_DEFAULT_COMPRESSION;
+	/* As recommended by the specification */
+	if (COLOUR_TYPE_INDEXED == ihdr->data.colourtype
+	    || ihdr->data.bitdepth < 8) {
+		enc->heuristic = LGPNG_HEURISTIC_FIXED;
+		enc->filter = FILTER_TYPE_NONE;
+	} else {
+		enc->heuristic = LGPNG_HEURISTIC_MINSUM;
+	}
+	enc->threads = 0 == threads ? 1 : threads;
+	enc->adler = adler32(0L, Z_NULL, 0);
+	enc->first = true;
+	enc->jobs = calloc(enc->threads, sizeof(*(enc->jobs)));
+	enc->block = malloc(ENCODE_DICTZ + ENCODE_BLOCKZ + 1 + enc->rowz);
+	enc->prev = malloc(enc->rowz);
+	enc->cand[0] = malloc(FILTER_TYPE__MAX * enc->rowz);
+	if (NULL == enc->jobs || NULL == enc->block || NULL == enc->prev
+	    || NULL == enc->cand[0]) {
+		lgpng_encode_free(enc);
+		return(LGPNG_NOMEM);
+	}
+	for (int f = 1; f < FILTER_TYPE__MAX; f++) {
+		enc->cand[f] = enc->cand[f - 1] + enc->rowz;
+	}
+	*encp = enc;
+	return(LGPNG_OK);
+}
+
+/* Compression level, from 0 to 9 as in zlib */
+enum lgpng_err
+lgpng_encode_set_level(struct lgpng_encode *enc, int level)
+{
+	if (NULL == enc || level < Z_DEFAULT_COMPRESSION || level > 9) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (enc->hasbrute && Z_OK != deflateParams(&(enc->brute), level,
+	    Z_DEFAULT_STRATEGY)) {
+		return(LGPNG_ZLIB_ERROR);
+	}
+	enc->level = level;
+	return(LGPNG_OK);
+}
+
+/*
+ * Make every IDAT chunk an independent deflate segment starting on a
+ * scanline, at the cost of a slightly bigger file. Such streams can be
+ * inflated by lgpng_idat_inflate_parallel.
+ */
+enum lgpng_err
+lgpng_encode_set_restarts(struct lgpng_encode *enc, bool restarts)
+{
+	if (NULL == enc || ! enc->first) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	enc->restarts = restarts;
+	return(LGPNG_OK);
+}
+
+/*
+ * Choose how scanlines are filtered: always with filter when heuristic
+ * is LGPNG_HEURISTIC_FIXED, otherwise per row with the lowest sum of
+ * absolute differences, the lowest entropy estimate, or the smallest
+ * deflated size tried once every few rows. Can be changed between rows.
+ */
+enum lgpng_err
+lgpng_encode_set_filter(struct lgpng_encode *enc,
+    enum lgpng_heuristic heuristic, uint8_t filter)
+{
+	if (NULL == enc || heuristic >= LGPNG_HEURISTIC__MAX
+	    || filter >= FILTER_TYPE__MAX) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (LGPNG_HEURISTIC_BRUTE == heuristic && ! enc->hasbrute) {
+		if (Z_OK != deflateInit2(&(enc->brute), enc->level, Z_DEFLATED,
+		    -15, 8, Z_DEFAULT_STRATEGY)) {
+			return(LGPNG_ZLIB_ERROR);
+		}
+		enc->brutez = deflateBound(&(enc->brute), enc->rowz);
+		if (NULL == (enc->brutebuf = malloc(enc->brutez))) {
+			(void)deflateEnd(&(enc->brute));
+			return(LGPNG_NOMEM);
+		}
+		enc->hasbrute = true;
+	}
+	enc->heuristic = heuristic;
+	enc->filter = filter;
+	return(LGPNG_OK);
+}
+
+/* Deflated size of a filtered row, compressed on its own */
+static size_t
+encode_brute_size(struct lgpng_encode *enc, uint8_t *data)
+{
+	(void)deflateReset(&(enc->brute));
+	enc->brute.next_in = data;
+	enc->brute.avail_in = (uInt)enc->rowz;
+	enc->brute.next_out = enc->brutebuf;
+	enc->brute.avail_out = (uInt)enc->brutez;
+	if (Z_STREAM_END != deflate(&(enc->brute), Z_FINISH)) {
+		return(SIZE_MAX);
+	}
+	return(enc->brute.total_out);
+}
+
+/* Filter row into dst, preceded by its filter type */
+static void
+encode_filter(struct lgpng_encode *enc, uint8_t *dst, const uint8_t *row)
+{
+	const uint8_t	*prev = 0 == enc->y ? NULL : enc->prev;
+	uint64_t	 cost[FILTER_TYPE__MAX];
+	uint8_t		 best = 0;
+
+	if (LGPNG_HEURISTIC_FIXED == enc->heuristic
+	    || (LGPNG_HEURISTIC_BRUTE == enc->heuristic
+	    && 0 != enc->y % ENCODE_SAMPLE)) {
+		dst[0] = enc->filter;
+		(void)lgpng_filter_row(enc->filter, enc->bpp, dst + 1, row,
+		    prev, enc->rowz);
+		return;
+	}
+	/* All five cost barely more than one, and minsum comes for free */
+	(void)lgpng_filter_all(enc->bpp, row, prev, enc->rowz, enc->cand, cost);
+	for (int f = 0; f < FILTER_TYPE__MAX; f++) {
+		if (LGPNG_HEURISTIC_ENTROPY == enc->heuristic) {
+			cost[f] = lgpng_filter_entropy(enc->cand[f], enc->rowz);
+		} else if (LGPNG_HEURISTIC_BRUTE == enc->heuristic) {
+			cost[f] = encode_brute_size(enc, enc->cand[f]);
+		}
+		if (cost[f] < cost[best]) {
+			best = (uint8_t)f;
+		}
+	}
+	enc->filter = best;
+	dst[0] = best;
+	(void)memcpy(dst + 1, enc->cand[best], enc->rowz);
+}
+
+static void *
+encode_job_run(void *arg)
+{
+	int			 zret, flevel;
+	uint8_t			 cmf = 0x78, flg;
+	size_t			 boundz;
+	z_stream		 strm;
+	struct encode_job	*job = arg;
+
+	(void)memset(&strm, 0, sizeof(strm));
+	if (Z_OK != deflateInit2(&strm, job->level, Z_DEFLATED, -15, 8,
+	    Z_DEFAULT_STRATEGY)) {
+		job->err = LGPNG_ZLIB_ERROR;
+		return(NULL);
+	}
+	if (0 != job->dictz && Z_OK != deflateSetDictionary(&strm,
+	    job->in, (uInt)job->dictz)) {
+		job->err = LGPNG_ZLIB_ERROR;
+		goto out;
+	}
+	/* Room for the zlib header, a sync marker and the trailer */
+	boundz = deflateBound(&strm, job->inz) + 2 + 6 + 4;
+	if (NULL == (job->out = malloc(boundz))) {
+		job->err = LGPNG_NOMEM;
+		goto out;
+	}
+	if (job->first) {
+		if (0 == job->level || 1 == job->level) {
+			flevel = 0;
+		} else if (job->level < 6 && Z_DEFAULT_COMPRESSION != job->level) {
+			flevel = 1;
+		} else if (job->level <= 6) {
+			flevel = 2;
+		} else {
+			flevel = 3;
+		}
+		flg = (uint8_t)(flevel << 6);
+		flg = (uint8_t)(flg + 31 - (cmf * 256 + flg) % 31);
+		job->out[job->outz++] = cmf;
+		job->out[job->outz++] = flg;
+	}
+	strm.next_in = job->in + job->dictz;
+	strm.avail_in = (uInt)job->inz;
+	strm.next_out = job->out + job->outz;
+	strm.avail_out = (uInt)(boundz - job->outz - 4);
+	zret = deflate(&strm, job->last ? Z_FINISH : Z_SYNC_FLUSH);
+	if ((job->last && Z_STREAM_END != zret)
+	    || (! job->last && Z_OK != zret) || 0 != strm.avail_in) {
+		job->err = LGPNG_ZLIB_ERROR;
+		goto out;
+	}
+	job->outz = (size_t)(strm.next_out - job->out);
+	job->adler = lgpng_adler32(1, job->in + job->dictz, job->inz);
+	/* The chunk CRC is computed while the output is still hot */
+	job->crc = lgpng_crc_update(lgpng_crc_init(), (uint8_t *)"IDAT", 4);
+	job->crc = lgpng_crc_update(job->crc, job->out, job->outz);
+out:
+	(void)deflateEnd(&strm);
+	return(NULL);
+}
+
+/* Wait for the oldest job and write its IDAT chunk */
+static enum lgpng_err
+encode_retire(struct lgpng_encode *enc)
+{
+	enum lgpng_err		 err;
+	uint8_t			*trailer;
+	struct encode_job	*job = &(enc->jobs[enc->head]);
+
+	if (job->running) {
+		(void)pthread_join(job->thread, NULL);
+		job->running = false;
+	}
+	err = job->err;
+	if (LGPNG_OK == err) {
+		enc->adler = adler32_combine(enc->adler, job->adler,
+		    (z_off_t)job->inz);
+		if (job->last) {
+			trailer = job->out + job->outz;
+			trailer[0] = (uint8_t)(enc->adler >> 24);
+			trailer[1] = (uint8_t)(enc->adler >> 16);
+			trailer[2] = (uint8_t)(enc->adler >> 8);
+			trailer[3] = (uint8_t)enc->adler;
+			job->crc = lgpng_crc_update(job->crc, trailer, 4);
+			job->outz += 4;
+		}
+		err = lgpng_stream_write_chunk(enc->dst, (uint32_t)job->outz,
+		    (uint8_t *)"IDAT", job->out,
+		    lgpng_crc_finalize(job->crc));
+	}
+	free(job->buf);
+	free(job->out);
+	(void)memset(job, 0, sizeof(*job));
+	enc->head = (enc->head + 1) % enc->threads;
+	enc->count--;
+	return(err);
+}
+
+/* Hand the current block to a new job, the block buffer is replaced */
+static enum lgpng_err
+encode_dispatch(struct lgpng_encode *enc, bool last)
+{
+	enum lgpng_err		 err;
+	uint8_t			*next;
+	size_t			 tailz;
+	struct encode_job	*job;
+
+	if (enc->count == enc->threads
+	    && LGPNG_OK != (err = encode_retire(enc))) {
+		return(err);
+	}
+	next = malloc(ENCODE_DICTZ + ENCODE_BLOCKZ + 1 + enc->rowz);
+	if (NULL == next) {
+		return(LGPNG_NOMEM);
+	}
+	/* The next dictionary is the tail of the old one and this block */
+	tailz = enc->dictz + enc->blockz;
+	if (tailz > ENCODE_DICTZ) {
+		tailz = ENCODE_DICTZ;
+	}
+	if (! enc->restarts) {
+		(void)memcpy(next + ENCODE_DICTZ - tailz,
+		    enc->block + ENCODE_DICTZ + enc->blockz - tailz, tailz);
+	}
+	job = &(enc->jobs[(enc->head + enc->count) % enc->threads]);
+	job->first = enc->first;
+	job->last = last;
+	job->level = enc->level;
+	job->buf = enc->block;
+	job->in = enc->block + ENCODE_DICTZ - enc->dictz;
+	job->dictz = enc->dictz;
+	job->inz = enc->blockz;
+	enc->count++;
+	enc->block = next;
+	enc->blockz = 0;
+	enc->dictz = enc->restarts ? 0 : tailz;
+	enc->first = false;
+	if (0 == pthread_create(&(job->thread), NULL, encode_job_run, job)) {
+		job->running = true;
+	} else {
+		(void)encode_job_run(job);
+	}
+	return(LGPNG_OK);
+}
+
+/*
+ * Add the next scanline of the image, unfiltered and packed as in the
+ * IHDR. Blocks are cut at scanline boundaries.
+ */
+enum lgpng_err
+lgpng_encode_row(struct lgpng_encode *enc, const uint8_t *row)
+{
+	uint8_t	*dst;
+
+	if (NULL == enc || NULL == row) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (LGPNG_OK != enc->err) {
+		return(enc->err);
+	}
+	if (enc->y == enc->ihdr.data.height) {
+		return(LGPNG_TOO_LONG);
+	}
+	dst = enc->block + ENCODE_DICTZ + enc->blockz;
+	encode_filter(enc, dst, row);
+	(void)memcpy(enc->prev, row, enc->rowz);
+	enc->blockz += 1 + enc->rowz;
+	enc->y++;
+	if (enc->blockz >= ENCODE_BLOCKZ && enc->y != enc->ihdr.data.height) {
+		enc->err = encode_dispatch(enc, false);
+	}
+	return(enc->err);
+}
+
+/* Compress the last rows and write every pending IDAT chunk */
+enum lgpng_err
+lgpng_encode_finish(struct lgpng_encode *enc)
+{
+	enum lgpng_err	err;
+
+	if (NULL == enc) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (LGPNG_OK != enc->err || enc->finished) {
+		return(enc->err);
+	}
+	if (enc->y != enc->ihdr.data.height) {
+		return(LGPNG_TOO_SHORT);
+	}
+	enc->finished = true;
+	err = encode_dispatch(enc, true);
+	while (LGPNG_OK == err && 0 != enc->count) {
+		err = encode_retire(enc);
+	}
+	enc->err = err;
+	return(err);
+}
+
+void
+lgpng_encode_free(struct lgpng_encode *enc)
+{
+	if (NULL == enc) {
+		return;
+	}
+	if (NULL != enc->jobs) {
+		for (unsigned int i = 0; i < enc->threads; i++) {
+			if (enc->jobs[i].running) {
+				(void)pthread_join(enc->jobs[i].thread, NULL);
+			}
+			free(enc->jobs[i].buf);
+			free(enc->jobs[i].out);
+		}
+	}
+	if (enc->hasbrute) {
+		(void)deflateEnd(&(enc->brute));
+	}
+	free(enc->jobs);
+	free(enc->block);
+	free(enc->prev);
+	free(enc->cand[0]);
+	free(enc->brutebuf);
+	free(enc);
+}
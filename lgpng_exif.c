@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lgpng.h"
+
+/* Upper bound on the number of IFDs visited, guards against loops */
+#define EXIF_MAX_IFD	16
+
+enum exif_ifd {
+	EXIF_IFD_MAIN,
+	EXIF_IFD_EXIF,
+	EXIF_IFD_GPS,
+	EXIF_IFD_THUMBNAIL,
+};
+
+const char *exif_tagmap[EXIF_TAG__MAX] = {
+	"make",
+	"model",
+	"orientation",
+	"software",
+	"date time",
+	"date time original",
+	"date time digitized",
+	"exposure time",
+	"f-number",
+	"iso speed",
+	"focal length",
+	"lens model",
+	"gps latitude ref",
+	"gps latitude",
+	"gps longitude ref",
+	"gps longitude",
+	"gps altitude ref",
+	"gps altitude",
+};
+
+/* Size in bytes of one element of each TIFF field type */
+static const uint8_t exif_typez[EXIF_TYPE__MAX] = {
+	0, 1, 1, 2, 4, 8, 1, 1, 2, 4, 8, 4, 8,
+};
+
+static uint16_t
+exif_u16(struct exif *exif, uint8_t *p)
+{
+	if (exif->bigendian) {
+		return((uint16_t)(p[0] << 8 | p[1]));
+	}
+	return((uint16_t)(p[1] << 8 | p[0]));
+}
+
+static uint32_t
+exif_u32(struct exif *exif, uint8_t *p)
+{
+	if (exif->bigendian) {
+		return((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16
+		    | (uint32_t)p[2] << 8 | (uint32_t)p[3]);
+	}
+	return((uint32_t)p[3] << 24 | (uint32_t)p[2] << 16
+	    | (uint32_t)p[1] << 8 | (uint32_t)p[0]);
+}
+
+/*
+ * Map a tag found in a given IFD to its slot in the index, GPS tags
+ * reuse small numbers and thus need to be told apart. The thumbnail IFD
+ * repeats tags of the primary image with its own values, none is kept.
+ */
+static int
+exif_slot(enum exif_ifd ifd, uint16_t tag)
+{
+	if (EXIF_IFD_THUMBNAIL == ifd) {
+		return(-1);
+	}
+	if (EXIF_IFD_GPS == ifd) {
+		switch (tag) {
+		case 0x0001: return(EXIF_TAG_GPS_LATITUDE_REF);
+		case 0x0002: return(EXIF_TAG_GPS_LATITUDE);
+		case 0x0003: return(EXIF_TAG_GPS_LONGITUDE_REF);
+		case 0x0004: return(EXIF_TAG_GPS_LONGITUDE);
+		case 0x0005: return(EXIF_TAG_GPS_ALTITUDE_REF);
+		case 0x0006: return(EXIF_TAG_GPS_ALTITUDE);
+		default: return(-1);
+		}
+	}
+	switch (tag) {
+	case 0x010f: return(EXIF_TAG_MAKE);
+	case 0x0110: return(EXIF_TAG_MODEL);
+	case 0x0112: return(EXIF_TAG_ORIENTATION);
+	case 0x0131: return(EXIF_TAG_SOFTWARE);
+	case 0x0132: return(EXIF_TAG_DATETIME);
+	case 0x829a: return(EXIF_TAG_EXPOSURE_TIME);
+	case 0x829d: return(EXIF_TAG_FNUMBER);
+	case 0x8827: return(EXIF_TAG_ISO);
+	case 0x9003: return(EXIF_TAG_DATETIME_ORIGINAL);
+	case 0x9004: return(EXIF_TAG_DATETIME_DIGITIZED);
+	case 0x920a: return(EXIF_TAG_FOCAL_LENGTH);
+	case 0xa434: return(EXIF_TAG_LENS_MODEL);
+	default: return(-1);
+	}
+}
+
+/*
+ * Walk the TIFF structure stored in an eXIf chunk without copying
+ * anything. Every IFD reachable from the header, through the chain of
+ * next pointers or through the Exif and GPS sub-IFDs, is visited once and
+ * the interesting tags of IFD0 and its sub-IFDs are recorded in the index
+ * of the exif structure.
+ * Entries keep pointers into the original data.
+ */
+enum lgpng_err
+lgpng_exif_parse(struct exif *exif, uint8_t *data, size_t dataz)
+{
+	size_t		 pending = 0, visited = 0;
+	uint32_t	 offsets[EXIF_MAX_IFD], seen[EXIF_MAX_IFD];
+	enum exif_ifd	 kinds[EXIF_MAX_IFD];
+
+	if (NULL == exif || NULL == data) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	(void)memset(exif, 0, sizeof(*exif));
+	if (dataz < 8) {
+		return(LGPNG_TOO_SHORT);
+	}
+	if (0 == memcmp(data, "MM\0*", 4)) {
+		exif->bigendian = true;
+	} else if (0 == memcmp(data, "II*\0", 4)) {
+		exif->bigendian = false;
+	} else {
+		return(LGPNG_ERROR);
+	}
+	exif->data = data;
+	exif->dataz = dataz;
+	offsets[pending] = exif_u32(exif, data + 4);
+	kinds[pending] = EXIF_IFD_MAIN;
+	pending++;
+	while (pending > 0) {
+		size_t		 i;
+		uint8_t		*ifd;
+		uint16_t	 count;
+		uint32_t	 offset, next;
+		enum exif_ifd	 kind;
+
+		pending--;
+		offset = offsets[pending];
+		kind = kinds[pending];
+		if (0 == offset) {
+			continue;
+		}
+		/* Silently stop on loops, what was indexed so far is valid */
+		for (i = 0; i < visited; i++) {
+			if (seen[i] == offset) {
+				break;
+			}
+		}
+		if (i != visited || visited == EXIF_MAX_IFD) {
+			continue;
+		}
+		seen[visited++] = offset;
+		if ((uint64_t)offset + 2 > dataz) {
+			return(LGPNG_TOO_SHORT);
+		}
+		ifd = data + offset;
+		count = exif_u16(exif, ifd);
+		if ((uint64_t)offset + 2 + (uint64_t)count * 12 > dataz) {
+			return(LGPNG_TOO_SHORT);
+		}
+		for (i = 0; i < count; i++) {
+			uint8_t			*entry = ifd + 2 + i * 12;
+			uint16_t		 tag, type;
+			uint32_t		 n, valoff;
+			uint64_t		 valz;
+			int			 slot;
+			struct exif_entry	*e;
+
+			tag = exif_u16(exif, entry);
+			type = exif_u16(exif, entry + 2);
+			n = exif_u32(exif, entry + 4);
+			exif->entries++;
+			if (0 == type || type >= EXIF_TYPE__MAX) {
+				continue;
+			}
+			if (EXIF_IFD_MAIN == kind
+			    && (0x8769 == tag || 0x8825 == tag)) {
+				if (pending == EXIF_MAX_IFD) {
+					continue;
+				}
+				offsets[pending] = exif_u32(exif, entry + 8);
+				kinds[pending] = 0x8769 == tag ?
+				    EXIF_IFD_EXIF : EXIF_IFD_GPS;
+				pending++;
+				continue;
+			}
+			if (-1 == (slot = exif_slot(kind, tag))) {
+				continue;
+			}
+			/* Small values are stored in the offset field itself */
+			valz = (uint64_t)n * exif_typez[type];
+			if (valz <= 4) {
+				valoff = offset + 2 + (uint32_t)i * 12 + 8;
+			} else {
+				valoff = exif_u32(exif, entry + 8);
+				if ((uint64_t)valoff + valz > dataz) {
+					continue;
+				}
+			}
+			e = &(exif->tags[slot]);
+			e->tag = tag;
+			e->type = type;
+			e->count = n;
+			e->value = data + valoff;
+		}
+		/*
+		 * Only the main chain has next pointers worth following, every
+		 * IFD after IFD0 describes the thumbnail.
+		 */
+		if (EXIF_IFD_MAIN == kind || EXIF_IFD_THUMBNAIL == kind) {
+			next = offset + 2 + (uint32_t)count * 12;
+			if ((uint64_t)next + 4 <= dataz && pending < EXIF_MAX_IFD) {
+				offsets[pending] = exif_u32(exif, data + next);
+				kinds[pending] = EXIF_IFD_THUMBNAIL;
+				pending++;
+			}
+		}
+		exif->ifds++;
+	}
+	return(LGPNG_OK);
+}
+
+struct exif_entry *
+lgpng_exif_get(struct exif *exif, enum exif_tag tag)
+{
+	if (NULL == exif || tag >= EXIF_TAG__MAX) {
+		return(NULL);
+	}
+	if (NULL == exif->tags[tag].value) {
+		return(NULL);
+	}
+	return(&(exif->tags[tag]));
+}
+
+/*
+ * Read the idx-th element of a BYTE, SHORT or LONG entry.
+ */
+enum lgpng_err
+lgpng_exif_get_integer(struct exif *exif, enum exif_tag tag, uint32_t idx,
+    uint32_t *value)
+{
+	struct exif_entry	*e;
+
+	if (NULL == value) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (NULL == (e = lgpng_exif_get(exif, tag))) {
+		return(LGPNG_ERROR);
+	}
+	if (idx >= e->count) {
+		return(LGPNG_TOO_SHORT);
+	}
+	switch (e->type) {
+	case EXIF_TYPE_BYTE:
+		*value = e->value[idx];
+		break;
+	case EXIF_TYPE_SHORT:
+		*value = exif_u16(exif, e->value + idx * 2);
+		break;
+	case EXIF_TYPE_LONG:
+		*value = exif_u32(exif, e->value + idx * 4);
+		break;
+	default:
+		return(LGPNG_ERROR);
+	}
+	return(LGPNG_OK);
+}
+
+/*
+ * Read the idx-th element of a RATIONAL entry.
+ */
+enum lgpng_err
+lgpng_exif_get_rational(struct exif *exif, enum exif_tag tag, uint32_t idx,
+    uint32_t *num, uint32_t *den)
+{
+	struct exif_entry	*e;
+
+	if (NULL == num || NULL == den) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (NULL == (e = lgpng_exif_get(exif, tag))) {
+		return(LGPNG_ERROR);
+	}
+	if (idx >= e->count) {
+		return(LGPNG_TOO_SHORT);
+	}
+	if (EXIF_TYPE_RATIONAL != e->type) {
+		return(LGPNG_ERROR);
+	}
+	*num = exif_u32(exif, e->value + idx * 8);
+	*den = exif_u32(exif, e->value + idx * 8 + 4);
+	return(LGPNG_OK);
+}
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+# include <tmmintrin.h>
+#endif
+
+#include "lgpng.h"
+
+const char *lgpng_heuristicmap[LGPNG_HEURISTIC__MAX] = {
+	"fixed",
+	"minsum",
+	"entropy",
+	"brute",
+};
+
+static inline uint8_t
+filter_paeth_predictor(int a, int b, int c)
+{
+	int	p, pa, pb, pc;
+
+	p = a + b - c;
+	pa = abs(p - a);
+	pb = abs(p - b);
+	pc = abs(p - c);
+	if (pa <= pb && pa <= pc) {
+		return((uint8_t)a);
+	} else if (pb <= pc) {
+		return((uint8_t)b);
+	}
+	return((uint8_t)c);
+}
+
+/* Cost of a residual, seen as a signed byte */
+static inline unsigned
+filter_cost(uint8_t r)
+{
+	return(r < 128 ? r : 256u - r);
+}
+
+/*
+ * Reference implementation, written after the specification. A missing
+ * previous row is read as zeroes.
+ */
+static void
+filter_ref(uint8_t filter, size_t bpp, uint8_t *dst, const uint8_t *row,
+    const uint8_t *prev, size_t rowz, size_t from)
+{
+	int	 a, b, c;
+
+	for (size_t i = from; i < rowz; i++) {
+		a = i >= bpp ? row[i - bpp] : 0;
+		b = NULL != prev ? prev[i] : 0;
+		c = NULL != prev && i >= bpp ? prev[i - bpp] : 0;
+		switch (filter) {
+		case FILTER_TYPE_SUB:
+			dst[i] = (uint8_t)(row[i] - a);
+			break;
+		case FILTER_TYPE_UP:
+			dst[i] = (uint8_t)(row[i] - b);
+			break;
+		case FILTER_TYPE_AVERAGE:
+			dst[i] = (uint8_t)(row[i] - ((a + b) >> 1));
+			break;
+		case FILTER_TYPE_PAETH:
+			dst[i] = (uint8_t)(row[i]
+			    - filter_paeth_predictor(a, b, c));
+			break;
+		default:
+			dst[i] = row[i];
+			break;
+		}
+	}
+}
+
+#if defined(__SSE2__)
+
+static inline __m128i
+filter_abs16(__m128i x)
+{
+#if defined(__SSSE3__)
+	return(_mm_abs_epi16(x));
+#else
+	return(_mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x)));
+#endif
+}
+
+static inline __m128i
+filter_select(__m128i mask, __m128i t, __m128i f)
+{
+	return(_mm_or_si128(_mm_and_si128(mask, t), _mm_andnot_si128(mask, f)));
+}
+
+/* Paeth predictor of eight pixels held in 16 bits lanes */
+static inline __m128i
+filter_paeth8(__m128i a, __m128i b, __m128i c)
+{
+	__m128i	 pa, pb, pc, nota, usec;
+
+	pa = _mm_sub_epi16(b, c);
+	pb = _mm_sub_epi16(a, c);
+	pc = filter_abs16(_mm_add_epi16(pa, pb));
+	pa = filter_abs16(pa);
+	pb = filter_abs16(pb);
+	nota = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+	usec = _mm_cmpgt_epi16(pb, pc);
+	return(filter_select(nota, filter_select(usec, c, b), a));
+}
+
+static inline __m128i
+filter_paeth16(__m128i a, __m128i b, __m128i c)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i	 lo, hi;
+
+	lo = filter_paeth8(_mm_unpacklo_epi8(a, zero),
+	    _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+	hi = filter_paeth8(_mm_unpackhi_epi8(a, zero),
+	    _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+	return(_mm_packus_epi16(lo, hi));
+}
+
+/* Sum of the residuals seen as signed bytes, in two 64 bits lanes */
+static inline __m128i
+filter_sad(__m128i r)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	return(_mm_sad_epu8(_mm_min_epu8(r, _mm_sub_epi8(zero, r)), zero));
+}
+
+static uint64_t
+filter_sum(__m128i x)
+{
+	uint64_t	v[2];
+
+	_mm_storeu_si128((__m128i *)v, x);
+	return(v[0] + v[1]);
+}
+
+/*
+ * Forward filters only read the original samples, so unlike the inverse
+ * filters every byte is independent and 16 of them are done at once
+ * whatever the pixel size. The first pixel is done by filter_ref.
+ */
+static void
+filter_all(size_t bpp, const uint8_t *row, const uint8_t *prev, size_t rowz,
+    uint8_t *out[FILTER_TYPE__MAX], uint64_t cost[FILTER_TYPE__MAX])
+{
+	size_t		 i = bpp;
+	const __m128i	 one = _mm_set1_epi8(1);
+	__m128i		 x, a, b, c, r, sum[FILTER_TYPE__MAX];
+
+	for (int f = 0; f < FILTER_TYPE__MAX; f++) {
+		sum[f] = _mm_setzero_si128();
+	}
+	for (; i + 16 <= rowz; i += 16) {
+		x = _mm_loadu_si128((const __m128i *)(row + i));
+		a = _mm_loadu_si128((const __m128i *)(row + i - bpp));
+		b = _mm_loadu_si128((const __m128i *)(prev + i));
+		c = _mm_loadu_si128((const __m128i *)(prev + i - bpp));
+
+		_mm_storeu_si128((__m128i *)(out[FILTER_TYPE_NONE] + i), x);
+		sum[FILTER_TYPE_NONE] = _mm_add_epi64(sum[FILTER_TYPE_NONE],
+		    filter_sad(x));
+
+		r = _mm_sub_epi8(x, a);
+		_mm_storeu_si128((__m128i *)(out[FILTER_TYPE_SUB] + i), r);
+		sum[FILTER_TYPE_SUB] = _mm_add_epi64(sum[FILTER_TYPE_SUB],
+		    filter_sad(r));
+
+		r = _mm_sub_epi8(x, b);
+		_mm_storeu_si128((__m128i *)(out[FILTER_TYPE_UP] + i), r);
+		sum[FILTER_TYPE_UP] = _mm_add_epi64(sum[FILTER_TYPE_UP],
+		    filter_sad(r));
+
+		r = _mm_sub_epi8(x, _mm_sub_epi8(_mm_avg_epu8(a, b),
+		    _mm_and_si128(_mm_xor_si128(a, b), one)));
+		_mm_storeu_si128((__m128i *)(out[FILTER_TYPE_AVERAGE] + i), r);
+		sum[FILTER_TYPE_AVERAGE] = _mm_add_epi64(
+		    sum[FILTER_TYPE_AVERAGE], filter_sad(r));
+
+		r = _mm_sub_epi8(x, filter_paeth16(a, b, c));
+		_mm_storeu_si128((__m128i *)(out[FILTER_TYPE_PAETH] + i), r);
+		sum[FILTER_TYPE_PAETH] = _mm_add_epi64(sum[FILTER_TYPE_PAETH],
+		    filter_sad(r));
+	}
+	for (int f = 0; f < FILTER_TYPE__MAX; f++) {
+		filter_ref((uint8_t)f, bpp, out[f], row, prev, rowz, i);
+		cost[f] = filter_sum(sum[f]);
+		for (size_t j = i; j < rowz; j++) {
+			cost[f] += filter_cost(out[f][j]);
+		}
+	}
+}
+
+#else /* __SSE2__ */
+
+static void
+filter_all(size_t bpp, const uint8_t *row, const uint8_t *prev, size_t rowz,
+    uint8_t *out[FILTER_TYPE__MAX], uint64_t cost[FILTER_TYPE__MAX])
+{
+	for (int f = 0; f < FILTER_TYPE__MAX; f++) {
+		filter_ref((uint8_t)f, bpp, out[f], row, prev, rowz, bpp);
+		cost[f] = 0;
+		for (size_t i = bpp; i < rowz; i++) {
+			cost[f] += filter_cost(out[f][i]);
+		}
+	}
+}
+
+#endif /* __SSE2__ */
+
+/*
+ * Apply one filter to a scanline, without its filter type byte, into
+ * dst. The previous row is NULL for the first scanline of an image.
+ */
+enum lgpng_err
+lgpng_filter_row(uint8_t filter, size_t bpp, uint8_t *dst, const uint8_t *row,
+    const uint8_t *prev, size_t rowz)
+{
+	if (NULL == dst || NULL == row || filter >= FILTER_TYPE__MAX
+	    || 0 == bpp || bpp > 8) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	filter_ref(filter, bpp, dst, row, prev, rowz, 0);
+	return(LGPNG_OK);
+}
+
+/*
+ * Apply the five filters to a scanline in a single pass, writing each
+ * result in out and its cost in cost: the sum of the residuals taken as
+ * signed bytes, the classic minimum sum of absolute differences.
+ */
+enum lgpng_err
+lgpng_filter_all(size_t bpp, const uint8_t *row, const uint8_t *prev,
+    size_t rowz, uint8_t *out[FILTER_TYPE__MAX],
+    uint64_t cost[FILTER_TYPE__MAX])
+{
+	if (NULL == row || NULL == out || NULL == cost || 0 == bpp || bpp > 8) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (rowz < bpp) {
+		bpp = rowz;
+	}
+	for (int f = 0; f < FILTER_TYPE__MAX; f++) {
+		filter_ref((uint8_t)f, bpp, out[f], row, prev, bpp, 0);
+	}
+	if (NULL == prev) {
+		/* Only the first row, not worth a dedicated kernel */
+		for (int f = 0; f < FILTER_TYPE__MAX; f++) {
+			filter_ref((uint8_t)f, bpp, out[f], row, NULL, rowz, bpp);
+		}
+		for (int f = 0; f < FILTER_TYPE__MAX; f++) {
+			cost[f] = 0;
+		}
+	} else {
+		filter_all(bpp, row, prev, rowz, out, cost);
+	}
+	for (int f = 0; f < FILTER_TYPE__MAX; f++) {
+		if (NULL == prev) {
+			for (size_t i = bpp; i < rowz; i++) {
+				cost[f] += filter_cost(out[f][i]);
+			}
+		}
+		for (size_t i = 0; i < bpp; i++) {
+			cost[f] += filter_cost(out[f][i]);
+		}
+	}
+	return(LGPNG_OK);
+}
+
+/* Cheap log2, good to a few percents, enough to compare costs */
+static inline float
+filter_log2(float x)
+{
+	uint32_t	bits;
+	float		m;
+
+	(void)memcpy(&bits, &x, sizeof(bits));
+	m = (float)(bits & 0x7fffff) / (float)0x800000;
+	return((float)((int)(bits >> 23) - 127) + m * (1.3465f - 0.3465f * m));
+}
+
+/*
+ * Estimate the number of bits needed to code a filtered row with an
+ * order zero entropy coder: n log2 n - sum c log2 c over the byte
+ * histogram.
+ */
+uint64_t
+lgpng_filter_entropy(const uint8_t *data, size_t dataz)
+{
+	uint32_t	 hist[4][256];
+	size_t		 i = 0;
+	float		 bits;
+
+	if (NULL == data || 0 == dataz) {
+		return(0);
+	}
+	/* Four tables break the dependency between consecutive equal bytes */
+	(void)memset(hist, 0, sizeof(hist));
+	for (; i + 4 <= dataz; i += 4) {
+		hist[0][data[i]]++;
+		hist[1][data[i + 1]]++;
+		hist[2][data[i + 2]]++;
+		hist[3][data[i + 3]]++;
+	}
+	for (; i < dataz; i++) {
+		hist[0][data[i]]++;
+	}
+	bits = (float)dataz * filter_log2((float)dataz);
+	for (int v = 0; v < 256; v++) {
+		uint32_t	c;
+
+		c = hist[0][v] + hist[1][v] + hist[2][v] + hist[3][v];
+		if (c > 1) {
+			bits -= (float)c * filter_log2((float)c);
+		}
+	}
+	return(bits < 0 ? 0 : (uint64_t)bits);
+}
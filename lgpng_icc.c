@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lgpng.h"
+
+#define ICC_HEADERZ	128
+#define ICC_TAGZ	12
+
+/* Number of distinct profiles kept, must be a power of two */
+#define ICC_CACHE_MAX	64
+
+struct icc_cache_entry {
+	uint64_t	 hash;
+	uint8_t		*compressed;	/* Private copy, rules out collisions */
+	size_t		 compressedz;
+	struct icc	 icc;
+};
+
+/*
+ * Process-wide, not thread safe. Most files carry one of a handful of
+ * well-known profiles so a small open addressing table is plenty.
+ */
+static struct icc_cache_entry	icc_cache[ICC_CACHE_MAX];
+static size_t			icc_cache_used;
+
+static uint32_t
+icc_u32(uint8_t *p)
+{
+	return((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16
+	    | (uint32_t)p[2] << 8 | (uint32_t)p[3]);
+}
+
+static uint64_t
+icc_rotl(uint64_t x, int r)
+{
+	return(x << r | x >> (64 - r));
+}
+
+/*
+ * Multiply-rotate hash working on eight bytes at a time. It is not meant
+ * to resist malicious input, entries are confirmed with memcmp anyway.
+ */
+uint64_t
+lgpng_icc_hash(uint8_t *data, size_t dataz)
+{
+	uint64_t	 h, w;
+	size_t		 i;
+	const uint64_t	 k1 = 0x9e3779b185ebca87ULL;
+	const uint64_t	 k2 = 0xc2b2ae3d27d4eb4fULL;
+
+	h = k2 ^ (uint64_t)dataz;
+	for (i = 0; i + 8 <= dataz; i += 8) {
+		(void)memcpy(&w, data + i, sizeof(w));
+		h ^= icc_rotl(w * k1, 31) * k2;
+		h = icc_rotl(h, 27) * k1 + 0x52dce729;
+	}
+	w = 0;
+	(void)memcpy(&w, data + i, dataz - i);
+	h ^= icc_rotl(w * k1, 31) * k2;
+	h ^= h >> 33;
+	h *= k1;
+	h ^= h >> 29;
+	return(h);
+}
+
+/*
+ * Decode the 128 bytes header and locate the tag table of an inflated
+ * profile. Nothing is copied, the tag table is read on demand.
+ */
+enum lgpng_err
+lgpng_icc_parse(struct icc *icc, uint8_t *profile, size_t profilez)
+{
+	if (NULL == icc || NULL == profile) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	(void)memset(icc, 0, sizeof(*icc));
+	if (profilez < ICC_HEADERZ + 4) {
+		return(LGPNG_TOO_SHORT);
+	}
+	if (0 != memcmp(profile + 36, "acsp", 4)) {
+		return(LGPNG_ERROR);
+	}
+	icc->profile = profile;
+	icc->profilez = profilez;
+	icc->size = icc_u32(profile);
+	(void)memcpy(icc->cmm, profile + 4, 4);
+	icc->major = profile[8];
+	icc->minor = profile[9] >> 4;
+	(void)memcpy(icc->devclass, profile + 12, 4);
+	(void)memcpy(icc->colourspace, profile + 16, 4);
+	(void)memcpy(icc->pcs, profile + 20, 4);
+	(void)memcpy(icc->platform, profile + 40, 4);
+	(void)memcpy(icc->manufacturer, profile + 48, 4);
+	icc->intent = icc_u32(profile + 64);
+	(void)memcpy(icc->creator, profile + 80, 4);
+	(void)memcpy(icc->id, profile + 84, 16);
+	if (icc->size > profilez) {
+		return(LGPNG_TOO_SHORT);
+	}
+	icc->tagcount = icc_u32(profile + ICC_HEADERZ);
+	if ((uint64_t)ICC_HEADERZ + 4 + (uint64_t)icc->tagcount * ICC_TAGZ
+	    > profilez) {
+		return(LGPNG_TOO_SHORT);
+	}
+	return(LGPNG_OK);
+}
+
+enum lgpng_err
+lgpng_icc_get_tag(struct icc *icc, uint32_t idx, struct icc_tag *tag)
+{
+	uint8_t	*entry;
+
+	if (NULL == icc || NULL == tag || NULL == icc->profile) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (idx >= icc->tagcount) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	entry = icc->profile + ICC_HEADERZ + 4 + idx * ICC_TAGZ;
+	(void)memcpy(tag->signature, entry, 4);
+	tag->offset = icc_u32(entry + 4);
+	tag->size = icc_u32(entry + 8);
+	if ((uint64_t)tag->offset + tag->size > icc->profilez) {
+		tag->data = NULL;
+		return(LGPNG_TOO_SHORT);
+	}
+	tag->data = icc->profile + tag->offset;
+	return(LGPNG_OK);
+}
+
+enum lgpng_err
+lgpng_icc_find_tag(struct icc *icc, const char *signature,
+    struct icc_tag *tag)
+{
+	uint8_t	*entry;
+
+	if (NULL == icc || NULL == signature || NULL == tag) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	for (uint32_t i = 0; i < icc->tagcount; i++) {
+		entry = icc->profile + ICC_HEADERZ + 4 + i * ICC_TAGZ;
+		if (0 == memcmp(entry, signature, 4)) {
+			return(lgpng_icc_get_tag(icc, i, tag));
+		}
+	}
+	return(LGPNG_ERROR);
+}
+
+void
+lgpng_icc_cache_flush(void)
+{
+	for (size_t i = 0; i < ICC_CACHE_MAX; i++) {
+		free(icc_cache[i].compressed);
+		free(icc_cache[i].icc.profile);
+	}
+	(void)memset(icc_cache, 0, sizeof(icc_cache));
+	icc_cache_used = 0;
+}
+
+/*
+ * Return the parsed profile of an iCCP chunk. Identical compressed
+ * profiles are inflated and parsed only once, later calls are served
+ * from the cache and do not count against the budget. The returned
+ * structure belongs to the cache: it stays valid until the next call to
+ * lgpng_icc_get or lgpng_icc_cache_flush.
+ */
+enum lgpng_err
+lgpng_icc_get(struct iCCP *iccp, struct lgpng_budget *budget,
+    struct icc **icc)
+{
+	enum lgpng_err		 err;
+	uint64_t		 hash;
+	size_t			 i, compressedz, profilez;
+	uint8_t			*compressed, *profile;
+	struct icc_cache_entry	*entry;
+
+	if (NULL == iccp || NULL == icc) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	compressed = iccp->data.profile;
+	compressedz = iccp->data.profilez;
+	hash = lgpng_icc_hash(compressed, compressedz);
+	i = (size_t)hash & (ICC_CACHE_MAX - 1);
+	for (;;) {
+		entry = &(icc_cache[i]);
+		if (NULL == entry->compressed) {
+			break;
+		}
+		if (entry->hash == hash && entry->compressedz == compressedz
+		    && 0 == memcmp(entry->compressed, compressed, compressedz)) {
+			*icc = &(entry->icc);
+			return(entry->icc.err);
+		}
+		i = (i + 1) & (ICC_CACHE_MAX - 1);
+	}
+	err = lgpng_inflate_chunk_alloc(compressed, compressedz, budget,
+	    &profile, &profilez);
+	if (LGPNG_OK != err) {
+		return(err);
+	}
+	/* Keep the load factor low, start over when half full */
+	if (icc_cache_used == ICC_CACHE_MAX / 2) {
+		lgpng_icc_cache_flush();
+		i = (size_t)hash & (ICC_CACHE_MAX - 1);
+		entry = &(icc_cache[i]);
+	}
+	if (NULL == (entry->compressed = malloc(compressedz + 1))) {
+		free(profile);
+		return(LGPNG_NOMEM);
+	}
+	(void)memcpy(entry->compressed, compressed, compressedz);
+	entry->compressedz = compressedz;
+	entry->hash = hash;
+	icc_cache_used++;
+	/* Invalid profiles are cached too, along with their error */
+	err = lgpng_icc_parse(&(entry->icc), profile, profilez);
+	entry->icc.profile = profile;
+	entry->icc.profilez = profilez;
+	entry->icc.err = err;
+	*icc = &(entry->icc);
+	return(err);
+}
@@ -0,0 +1,1175 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "lgpng.h"
+
+#define INFLATE_CHUNKZ	16384
+#define IDAT_COUNTZ	(64 * 1024)
+
+struct inflate_buffer {
+	uint8_t	*data;
+	size_t	 dataz;
+	size_t	 allocz;
+};
+
+void
+lgpng_budget_init(struct lgpng_budget *budget, size_t chunk_bytes,
+    size_t file_bytes, uint64_t chunk_usec, uint64_t file_usec)
+{
+	budget->chunk_bytes = chunk_bytes;
+	budget->file_bytes = file_bytes;
+	budget->chunk_usec = chunk_usec;
+	budget->file_usec = file_usec;
+	lgpng_budget_reset(budget);
+}
+
+/* Forget the resources consumed so far, typically before a new file */
+void
+lgpng_budget_reset(struct lgpng_budget *budget)
+{
+	budget->used_bytes = 0;
+	budget->used_usec = 0;
+}
+
+static uint64_t
+inflate_cputime(void)
+{
+	struct timespec	ts;
+
+	if (-1 == clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) {
+		return(0);
+	}
+	return((uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000);
+}
+
+/*
+ * Check the budget after every piece of output. The CPU clock is only
+ * read when a time limit was requested.
+ */
+static enum lgpng_err
+inflate_budget_check(struct lgpng_budget *budget, size_t chunkbytes,
+    uint64_t start)
+{
+	uint64_t	elapsed;
+
+	if (0 != budget->chunk_bytes && chunkbytes > budget->chunk_bytes) {
+		return(LGPNG_BUDGET_EXCEEDED);
+	}
+	if (0 != budget->file_bytes
+	    && budget->used_bytes + chunkbytes > budget->file_bytes) {
+		return(LGPNG_BUDGET_EXCEEDED);
+	}
+	if (0 == budget->chunk_usec && 0 == budget->file_usec) {
+		return(LGPNG_OK);
+	}
+	elapsed = inflate_cputime() - start;
+	if (0 != budget->chunk_usec && elapsed > budget->chunk_usec) {
+		return(LGPNG_BUDGET_EXCEEDED);
+	}
+	if (0 != budget->file_usec
+	    && budget->used_usec + elapsed > budget->file_usec) {
+		return(LGPNG_BUDGET_EXCEEDED);
+	}
+	return(LGPNG_OK);
+}
+
+static enum lgpng_err
+inflate_zerr(int zret)
+{
+	switch (zret) {
+	case Z_MEM_ERROR:
+		return(LGPNG_NOMEM);
+	case Z_BUF_ERROR:
+		/* No progress possible: the input ended too early */
+		return(LGPNG_TOO_SHORT);
+	default:
+		return(LGPNG_ZLIB_ERROR);
+	}
+}
+
+/*
+ * Inflate a complete zlib stream such as the ones found in zTXt, iCCP or
+ * iTXt chunks. The output is handed to the sink in pieces of at most
+ * INFLATE_CHUNKZ bytes as soon as it is produced, the decompression is
+ * never restarted. If a budget is given the decompression stops with
+ * LGPNG_BUDGET_EXCEEDED as soon as one of its limits is crossed, and the
+ * resources used are charged to it in any case.
+ */
+enum lgpng_err
+lgpng_inflate_chunk(uint8_t *src, size_t srcz, struct lgpng_budget *budget,
+    lgpng_inflate_sink sink, void *arg)
+{
+	int		 zret;
+	enum lgpng_err	 err = LGPNG_OK;
+	size_t		 produced;
+	uint64_t	 start = 0;
+	uint8_t		 out[INFLATE_CHUNKZ];
+	z_stream	 strm;
+
+	if (NULL == src || NULL == sink) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (srcz > UINT32_MAX) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	(void)memset(&strm, 0, sizeof(strm));
+	if (Z_OK != inflateInit(&strm)) {
+		return(LGPNG_ZLIB_ERROR);
+	}
+	if (NULL != budget
+	    && (0 != budget->chunk_usec || 0 != budget->file_usec)) {
+		start = inflate_cputime();
+	}
+	strm.next_in = src;
+	strm.avail_in = (uInt)srcz;
+	do {
+		strm.next_out = out;
+		strm.avail_out = sizeof(out);
+		zret = inflate(&strm, Z_NO_FLUSH);
+		if (Z_OK != zret && Z_STREAM_END != zret) {
+			err = inflate_zerr(zret);
+			break;
+		}
+		produced = sizeof(out) - strm.avail_out;
+		if (NULL != budget) {
+			err = inflate_budget_check(budget, strm.total_out, start);
+			if (LGPNG_OK != err) {
+				break;
+			}
+		}
+		if (0 != produced) {
+			if (LGPNG_OK != (err = sink(arg, out, produced))) {
+				break;
+			}
+		}
+	} while (Z_STREAM_END != zret);
+	if (NULL != budget) {
+		budget->used_bytes += strm.total_out;
+		if (0 != start) {
+			budget->used_usec += inflate_cputime() - start;
+		}
+	}
+	(void)inflateEnd(&strm);
+	return(err);
+}
+
+static enum lgpng_err
+inflate_buffer_sink(void *arg, uint8_t *data, size_t dataz)
+{
+	size_t			 newz;
+	uint8_t			*tmp;
+	struct inflate_buffer	*buf = arg;
+
+	/* Keep one extra byte for the final NUL */
+	if (buf->dataz + dataz + 1 > buf->allocz) {
+		newz = buf->allocz;
+		while (buf->dataz + dataz + 1 > newz) {
+			newz *= 2;
+		}
+		if (NULL == (tmp = realloc(buf->data, newz))) {
+			return(LGPNG_NOMEM);
+		}
+		buf->data = tmp;
+		buf->allocz = newz;
+	}
+	(void)memcpy(buf->data + buf->dataz, data, dataz);
+	buf->dataz += dataz;
+	return(LGPNG_OK);
+}
+
+/*
+ * Same as lgpng_inflate_chunk but collect the output in a newly
+ * allocated, NUL terminated buffer that grows geometrically.
+ */
+enum lgpng_err
+lgpng_inflate_chunk_alloc(uint8_t *src, size_t srcz,
+    struct lgpng_budget *budget, uint8_t **out, size_t *outz)
+{
+	enum lgpng_err		err;
+	struct inflate_buffer	buf;
+
+	if (NULL == out || NULL == outz) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	/* Text and ICC profiles usually compress by a factor of 2 to 4 */
+	buf.allocz = srcz * 4 + 1;
+	if (NULL != budget && 0 != budget->chunk_bytes
+	    && buf.allocz > budget->chunk_bytes + 1) {
+		buf.allocz = budget->chunk_bytes + 1;
+	}
+	buf.dataz = 0;
+	if (NULL == (buf.data = malloc(buf.allocz))) {
+		return(LGPNG_NOMEM);
+	}
+	err = lgpng_inflate_chunk(src, srcz, budget, inflate_buffer_sink,
+	    &buf);
+	if (LGPNG_OK != err) {
+		free(buf.data);
+		return(err);
+	}
+	buf.data[buf.dataz] = '\0';
+	*out = buf.data;
+	*outz = buf.dataz;
+	return(LGPNG_OK);
+}
+
+struct lgpng_idat {
+	z_stream		 strm;
+	struct lgpng_budget	*budget;
+	uint8_t			*out;
+	size_t			 outz;	/* Whole image, or two rows */
+	size_t			 done;	/* Bytes produced so far */
+	size_t			 rawz;	/* Bytes expected in total */
+	uint64_t		 usec;	/* CPU time spent so far */
+	bool			 ended;
+	/* Adler-32 of the output and the last four bytes of input */
+	uint32_t		 adler;
+	uint8_t			 tail[4];
+	bool			 checked;
+	bool			 count;	/* Output thrown away */
+	/* Row mode only */
+	struct IHDR		 ihdr;
+	lgpng_row_fn		 rowfn;
+	void			*rowarg;
+	int			 pass;
+	uint32_t		 passrows;	/* Rows left in the pass */
+	size_t			 rowz;		/* Filter byte included */
+	size_t			 filled;	/* Bytes of the current row */
+	uint32_t		 y;		/* Rows handed out */
+	uint32_t		 last;		/* Rows wanted, 0 for all */
+};
+
+static enum lgpng_err
+idat_alloc(struct IHDR *ihdr, struct lgpng_budget *budget,
+    struct lgpng_idat **idatp, size_t *rawz)
+{
+	enum lgpng_err		 err;
+	struct lgpng_idat	*idat;
+
+	if (NULL == idatp) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (LGPNG_OK != (err = lgpng_IHDR_raw_size(ihdr, rawz))) {
+		return(err);
+	}
+	/* No need to start if the image cannot fit */
+	if (NULL != budget) {
+		if (0 != budget->chunk_bytes && *rawz > budget->chunk_bytes) {
+			return(LGPNG_BUDGET_EXCEEDED);
+		}
+		if (0 != budget->file_bytes
+		    && budget->used_bytes + *rawz > budget->file_bytes) {
+			return(LGPNG_BUDGET_EXCEEDED);
+		}
+	}
+	if (NULL == (idat = calloc(1, sizeof(*idat)))) {
+		return(LGPNG_NOMEM);
+	}
+	if (Z_OK != inflateInit(&(idat->strm))) {
+		free(idat);
+		return(LGPNG_ZLIB_ERROR);
+	}
+#if ZLIB_VERNUM >= 0x1290
+	/* The trailer is checked by lgpng_adler32, which is faster */
+	(void)inflateValidate(&(idat->strm), 0);
+#endif
+	idat->adler = 1;
+	idat->budget = budget;
+	idat->rawz = *rawz;
+	idat->ihdr = *ihdr;
+	*idatp = idat;
+	return(LGPNG_OK);
+}
+
+/*
+ * Prepare the decompression of the IDAT stream of an image. The output
+ * buffer is allocated once with the exact size derived from the IHDR
+ * chunk, it is never reallocated.
+ */
+enum lgpng_err
+lgpng_idat_new(struct IHDR *ihdr, struct lgpng_budget *budget,
+    struct lgpng_idat **idatp)
+{
+	enum lgpng_err		 err;
+	size_t			 rawz;
+	struct lgpng_idat	*idat;
+
+	if (LGPNG_OK != (err = idat_alloc(ihdr, budget, &idat, &rawz))) {
+		return(err);
+	}
+	if (NULL == (idat->out = malloc(rawz))) {
+		lgpng_idat_free(idat);
+		return(LGPNG_NOMEM);
+	}
+	idat->outz = rawz;
+	*idatp = idat;
+	return(LGPNG_OK);
+}
+
+/*
+ * Same as lgpng_idat_new but the output is only counted: it goes to a
+ * small buffer overwritten again and again, and the stream is allowed to
+ * grow past the size announced by IHDR so its true length is known. The
+ * Adler-32 trailer is still verified. lgpng_idat_finish gives the count.
+ */
+enum lgpng_err
+lgpng_idat_new_count(struct IHDR *ihdr, struct lgpng_budget *budget,
+    struct lgpng_idat **idatp)
+{
+	enum lgpng_err		 err;
+	size_t			 rawz;
+	struct lgpng_idat	*idat;
+
+	if (LGPNG_OK != (err = idat_alloc(ihdr, budget, &idat, &rawz))) {
+		return(err);
+	}
+	idat->outz = IDAT_COUNTZ;
+	if (NULL == (idat->out = malloc(idat->outz))) {
+		lgpng_idat_free(idat);
+		return(LGPNG_NOMEM);
+	}
+	idat->count = true;
+	*idatp = idat;
+	return(LGPNG_OK);
+}
+
+/* Move to the next non empty Adam7 pass, or past the last one */
+static void
+idat_next_pass(struct lgpng_idat *idat)
+{
+	uint32_t	width = 0, height = 0;
+	int		passes;
+
+	passes = INTERLACE_METHOD_ADAM7 == idat->ihdr.data.interlace ? 7 : 1;
+	while (++idat->pass < passes) {
+		lgpng_IHDR_pass_size(&(idat->ihdr), idat->pass, &width, &height);
+		if (0 != width && 0 != height) {
+			break;
+		}
+	}
+	idat->passrows = idat->pass < passes ? height : 0;
+	idat->rowz = idat->pass < passes ?
+	    1 + lgpng_IHDR_rowbytes(&(idat->ihdr), width) : 0;
+}
+
+/*
+ * Same as lgpng_idat_new but only two scanlines are kept: each one is
+ * handed to fn as soon as it is complete, filter type byte first. Rows
+ * live in a two slots ring so the previous row is still intact while fn
+ * runs and rows can be unfiltered in place. Adam7 passes follow each
+ * other, fn sees the rows in file order.
+ */
+enum lgpng_err
+lgpng_idat_new_rows(struct IHDR *ihdr, struct lgpng_budget *budget,
+    lgpng_row_fn fn, void *arg, struct lgpng_idat **idatp)
+{
+	enum lgpng_err		 err;
+	size_t			 rawz;
+	struct lgpng_idat	*idat;
+
+	if (NULL == fn) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (LGPNG_OK != (err = idat_alloc(ihdr, budget, &idat, &rawz))) {
+		return(err);
+	}
+	/* The widest scanline is the one of the full image */
+	idat->outz = 2 * (1 + lgpng_IHDR_rowbytes(ihdr, ihdr->data.width));
+	if (NULL == (idat->out = malloc(idat->outz))) {
+		lgpng_idat_free(idat);
+		return(LGPNG_NOMEM);
+	}
+	idat->rowfn = fn;
+	idat->rowarg = arg;
+	idat->pass = -1;
+	idat_next_pass(idat);
+	*idatp = idat;
+	return(LGPNG_OK);
+}
+
+/*
+ * In row mode, stop inflating once rows scanlines were handed out, in
+ * file order. Following IDAT data is ignored and lgpng_idat_finish does
+ * not expect the rest of the image.
+ */
+enum lgpng_err
+lgpng_idat_limit(struct lgpng_idat *idat, uint32_t rows)
+{
+	if (NULL == idat || NULL == idat->rowfn || 0 != idat->done) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	idat->last = rows;
+	return(LGPNG_OK);
+}
+
+/* Where the next inflated bytes go, and how many are expected there */
+static uint8_t *
+idat_window(struct lgpng_idat *idat, size_t *left)
+{
+	if (idat->count) {
+		*left = idat->outz;
+		return(idat->out);
+	}
+	if (NULL == idat->rowfn) {
+		*left = idat->outz - idat->done;
+		return(idat->out + idat->done);
+	}
+	if (0 == idat->passrows) {
+		*left = 0;
+		return(NULL);
+	}
+	*left = idat->rowz - idat->filled;
+	return(idat->out + (idat->y & 1) * (idat->outz / 2) + idat->filled);
+}
+
+/* Hand a complete scanline to the row callback and move to the next */
+static enum lgpng_err
+idat_row(struct lgpng_idat *idat, uint8_t *row)
+{
+	enum lgpng_err	 err;
+
+	if (LGPNG_OK != (err = idat->rowfn(idat->rowarg, idat->y, row,
+	    idat->rowz))) {
+		return(err);
+	}
+	idat->y++;
+	idat->filled = 0;
+	if (idat->y == idat->last) {
+		idat->ended = true;
+		return(LGPNG_OK);
+	}
+	if (0 == --idat->passrows) {
+		idat_next_pass(idat);
+	}
+	return(LGPNG_OK);
+}
+
+static enum lgpng_err
+idat_produced(struct lgpng_idat *idat, size_t produced)
+{
+	idat->done += produced;
+	if (idat->count && NULL != idat->budget) {
+		/* Not bounded by IHDR in this mode */
+		if (0 != idat->budget->chunk_bytes
+		    && idat->done > idat->budget->chunk_bytes) {
+			return(LGPNG_BUDGET_EXCEEDED);
+		}
+		if (0 != idat->budget->file_bytes && idat->budget->used_bytes
+		    + idat->done > idat->budget->file_bytes) {
+			return(LGPNG_BUDGET_EXCEEDED);
+		}
+	}
+	if (NULL == idat->rowfn) {
+		return(LGPNG_OK);
+	}
+	idat->filled += produced;
+	if (idat->filled < idat->rowz) {
+		return(LGPNG_OK);
+	}
+	return(idat_row(idat, idat->out + (idat->y & 1) * (idat->outz / 2)));
+}
+
+static uint32_t
+idat_trailer(struct lgpng_idat *idat)
+{
+	return((uint32_t)idat->tail[0] << 24 | (uint32_t)idat->tail[1] << 16
+	    | (uint32_t)idat->tail[2] << 8 | idat->tail[3]);
+}
+
+/*
+ * Feed the body of one IDAT chunk straight to the inflate context, it is
+ * consumed entirely before returning so the caller can reuse its buffer.
+ * Data after the end of the zlib stream is ignored, but an image larger
+ * than announced by IHDR yields LGPNG_TOO_LONG.
+ */
+enum lgpng_err
+lgpng_idat_feed(struct lgpng_idat *idat, uint8_t *data, size_t dataz)
+{
+	int		 zret;
+	size_t		 left, consumed;
+	uint8_t		 spare;
+	uint8_t		*dst;
+	uint64_t	 start = 0;
+	enum lgpng_err	 err = LGPNG_OK;
+	z_stream	*strm;
+
+	if (NULL == idat || (NULL == data && 0 != dataz)) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (dataz > UINT32_MAX) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (idat->ended || 0 == dataz) {
+		return(LGPNG_OK);
+	}
+	strm = &(idat->strm);
+	if (NULL != idat->budget && (0 != idat->budget->chunk_usec
+	    || 0 != idat->budget->file_usec)) {
+		/* Pretend the whole stream was inflated in one go */
+		start = inflate_cputime() - idat->usec;
+	}
+	strm->next_in = data;
+	strm->avail_in = (uInt)dataz;
+	while (0 != strm->avail_in) {
+		dst = idat_window(idat, &left);
+		if (0 == left) {
+			/* Only used to detect overlong streams */
+			strm->next_out = &spare;
+			strm->avail_out = 1;
+		} else {
+			strm->next_out = dst;
+			strm->avail_out = left > UINT32_MAX ?
+			    UINT32_MAX : (uInt)left;
+		}
+		zret = inflate(strm, Z_NO_FLUSH);
+		if (0 == left) {
+			if (strm->next_out != &spare) {
+				err = LGPNG_TOO_LONG;
+				break;
+			}
+		} else if (strm->next_out != dst) {
+			/* Before the row callback, which may unfilter it */
+			idat->adler = lgpng_adler32(idat->adler, dst,
+			    (size_t)(strm->next_out - dst));
+			err = idat_produced(idat, (size_t)(strm->next_out - dst));
+			if (LGPNG_OK != err || idat->ended) {
+				break;
+			}
+		}
+		if (Z_STREAM_END == zret) {
+			idat->ended = true;
+			idat->checked = true;
+			break;
+		}
+		if (Z_OK != zret) {
+			err = inflate_zerr(zret);
+			break;
+		}
+		if (0 != start) {
+			err = inflate_budget_check(idat->budget, 0, start);
+			if (LGPNG_OK != err) {
+				break;
+			}
+		}
+	}
+	if (0 != start) {
+		idat->usec = inflate_cputime() - start;
+	}
+	/* Remember the end of the input, the trailer may span chunks */
+	consumed = (size_t)(strm->next_in - data);
+	if (consumed >= 4) {
+		(void)memcpy(idat->tail, strm->next_in - 4, 4);
+	} else {
+		(void)memmove(idat->tail, idat->tail + consumed, 4 - consumed);
+		(void)memcpy(idat->tail + 4 - consumed, data, consumed);
+	}
+	if (LGPNG_OK == err && idat->checked
+	    && idat->adler != idat_trailer(idat)) {
+		err = LGPNG_ZLIB_ERROR;
+	}
+	strm->next_in = NULL;
+	strm->avail_in = 0;
+	return(err);
+}
+
+/*
+ * Check the stream is complete and give access to the decompressed, still
+ * filtered, scanlines. The buffer belongs to the stream and is released
+ * by lgpng_idat_free. In row mode out and outz may be NULL. In count mode
+ * out may be NULL and outz is set to the number of bytes inflated, even
+ * when LGPNG_TOO_SHORT or LGPNG_TOO_LONG are returned.
+ */
+enum lgpng_err
+lgpng_idat_finish(struct lgpng_idat *idat, uint8_t **out, size_t *outz)
+{
+	bool	 whole;
+
+	if (NULL == idat) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	whole = NULL == idat->rowfn && ! idat->count;
+	if ((whole && NULL == out) || (NULL == idat->rowfn && NULL == outz)) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (NULL != idat->budget) {
+		idat->budget->used_bytes += idat->done;
+		idat->budget->used_usec += idat->usec;
+		idat->budget = NULL;
+	}
+	if (idat->count) {
+		*outz = idat->done;
+	}
+	if (! idat->ended) {
+		return(LGPNG_TOO_SHORT);
+	}
+	if (idat->done != idat->rawz
+	    && (0 == idat->last || idat->y != idat->last)) {
+		return(idat->done < idat->rawz ? LGPNG_TOO_SHORT : LGPNG_TOO_LONG);
+	}
+	if (NULL != out) {
+		*out = whole ? idat->out : NULL;
+	}
+	if (NULL != outz && ! idat->count) {
+		*outz = whole ? idat->outz : 0;
+	}
+	return(LGPNG_OK);
+}
+
+/*
+ * Give the Adler-32 computed over the inflated data and the one stored in
+ * the trailer of the zlib stream. They are only known once the end of the
+ * stream was reached, otherwise LGPNG_TOO_SHORT is returned. A mismatch
+ * also makes lgpng_idat_feed fail with LGPNG_ZLIB_ERROR.
+ */
+enum lgpng_err
+lgpng_idat_adler32(struct lgpng_idat *idat, uint32_t *computed,
+    uint32_t *stored)
+{
+	if (NULL == idat || NULL == computed || NULL == stored) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (! idat->checked) {
+		return(LGPNG_TOO_SHORT);
+	}
+	*computed = idat->adler;
+	*stored = idat_trailer(idat);
+	return(LGPNG_OK);
+}
+
+void
+lgpng_idat_free(struct lgpng_idat *idat)
+{
+	if (NULL == idat) {
+		return;
+	}
+	(void)inflateEnd(&(idat->strm));
+	free(idat->out);
+	free(idat);
+}
+
+/*
+ * List the places where an independent deflate segment may start: right
+ * after the empty stored block emitted by a Z_FULL_FLUSH, byte aligned.
+ * These are only candidates, the same bytes can also appear by chance in
+ * compressed data or come from a Z_SYNC_FLUSH.
+ */
+size_t
+lgpng_idat_find_restarts(const uint8_t *z, size_t zz, size_t *offsets,
+    size_t max)
+{
+	size_t	 found = 0;
+	const uint8_t	*p = z, *end = z + zz;
+
+	if (NULL == z || zz < 6) {
+		return(0);
+	}
+	/* Skip the zlib header, keep the Adler-32 trailer out */
+	p += 2;
+	end -= 4;
+	while (p + 4 < end) {
+		p = memchr(p, 0x00, (size_t)(end - 4 - p));
+		if (NULL == p) {
+			break;
+		}
+		if (0x00 == p[1] && 0xff == p[2] && 0xff == p[3]) {
+			if (NULL != offsets && found < max) {
+				offsets[found] = (size_t)(p + 4 - z);
+			}
+			found++;
+			p += 4;
+		} else {
+			p++;
+		}
+	}
+	return(found);
+}
+
+struct idat_segment {
+	pthread_t	 thread;
+	const uint8_t	*in;
+	size_t		 inz;
+	uint8_t		*out;
+	size_t		 outz;
+	size_t		 limit;	/* The whole image, no segment can be bigger */
+	bool		 last;
+	uint32_t	 trailer;	/* Adler-32 read after the last segment */
+	uint64_t	 usec;	/* CPU time of the thread inflating it */
+	enum lgpng_err	 err;
+};
+
+/*
+ * Inflate one raw deflate segment without any preset window: a reference
+ * to data before its start is reported by zlib as an invalid distance,
+ * so a wrong restart point cannot go unnoticed. Every segment but the
+ * last must end on a byte aligned block boundary.
+ */
+static void *
+idat_segment_inflate(void *arg)
+{
+	int			 zret = Z_OK;
+	size_t			 allocz, inz, left;
+	uint64_t		 start;
+	uint8_t			*tmp;
+	const uint8_t		*in;
+	z_stream		 strm;
+	struct idat_segment	*seg = arg;
+
+	start = inflate_cputime();
+	(void)memset(&strm, 0, sizeof(strm));
+	if (Z_OK != inflateInit2(&strm, -15)) {
+		seg->err = LGPNG_ZLIB_ERROR;
+		seg->usec = inflate_cputime() - start;
+		return(NULL);
+	}
+	allocz = seg->inz * 4 < seg->limit ? seg->inz * 4 : seg->limit;
+	if (allocz < INFLATE_CHUNKZ) {
+		allocz = seg->limit < INFLATE_CHUNKZ ? seg->limit : INFLATE_CHUNKZ;
+	}
+	if (NULL == (seg->out = malloc(allocz))) {
+		seg->err = LGPNG_NOMEM;
+		goto out;
+	}
+	in = seg->in;
+	inz = seg->inz;
+	while (Z_STREAM_END != zret && (0 != inz || 0 != strm.avail_in)) {
+		if (0 == strm.avail_in) {
+			strm.next_in = (uint8_t *)in;
+			strm.avail_in = inz > UINT32_MAX ? UINT32_MAX : (uInt)inz;
+			in += strm.avail_in;
+			inz -= strm.avail_in;
+		}
+		if (seg->outz == allocz) {
+			if (allocz == seg->limit) {
+				seg->err = LGPNG_TOO_LONG;
+				goto out;
+			}
+			allocz = allocz * 2 < seg->limit ? allocz * 2 : seg->limit;
+			if (NULL == (tmp = realloc(seg->out, allocz))) {
+				seg->err = LGPNG_NOMEM;
+				goto out;
+			}
+			seg->out = tmp;
+		}
+		strm.next_out = seg->out + seg->outz;
+		left = allocz - seg->outz;
+		strm.avail_out = left > UINT32_MAX ? UINT32_MAX : (uInt)left;
+		zret = inflate(&strm, seg->last ? Z_NO_FLUSH : Z_BLOCK);
+		seg->outz += (size_t)(strm.next_out - (seg->out + seg->outz));
+		if (Z_OK != zret && Z_STREAM_END != zret && Z_BUF_ERROR != zret) {
+			seg->err = inflate_zerr(zret);
+			goto out;
+		}
+	}
+	if (seg->last) {
+		/* The trailer may straddle two slices, both are contiguous */
+		if (Z_STREAM_END != zret || strm.avail_in + inz < 4) {
+			seg->err = LGPNG_TOO_SHORT;
+			goto out;
+		}
+		seg->trailer = (uint32_t)strm.next_in[0] << 24
+		    | (uint32_t)strm.next_in[1] << 16
+		    | (uint32_t)strm.next_in[2] << 8 | strm.next_in[3];
+	} else if (Z_STREAM_END == zret || 0 == (strm.data_type & 128)
+	    || 0 != (strm.data_type & 63)) {
+		seg->err = LGPNG_ERROR;
+	}
+out:
+	(void)inflateEnd(&strm);
+	seg->usec = inflate_cputime() - start;
+	return(NULL);
+}
+
+/* Feed a complete zlib stream, whatever its size */
+static enum lgpng_err
+idat_feed_all(struct lgpng_idat *idat, uint8_t *z, size_t zz)
+{
+	enum lgpng_err	 err = LGPNG_OK;
+
+	for (size_t i = 0; LGPNG_OK == err && i < zz; i += UINT32_MAX) {
+		err = lgpng_idat_feed(idat, z + i,
+		    zz - i < UINT32_MAX ? zz - i : UINT32_MAX);
+	}
+	return(err);
+}
+
+/* Streaming inflate, interruptible by the CPU time limits of budget */
+static enum lgpng_err
+idat_inflate_stream(struct IHDR *ihdr, struct lgpng_budget *budget,
+    uint8_t *z, size_t zz, uint8_t **out, size_t *outz)
+{
+	enum lgpng_err		 err = LGPNG_OK;
+	struct lgpng_idat	*idat;
+
+	if (LGPNG_OK != (err = lgpng_idat_new(ihdr, budget, &idat))) {
+		return(err);
+	}
+	err = idat_feed_all(idat, z, zz);
+	if (LGPNG_OK == err
+	    && LGPNG_OK == (err = lgpng_idat_finish(idat, out, outz))) {
+		/* Steal the buffer */
+		idat->out = NULL;
+	}
+	lgpng_idat_free(idat);
+	return(err);
+}
+
+/*
+ * Inflate the concatenated data of every IDAT chunk in one go. The
+ * output size is known from IHDR so the whole buffer backend is used,
+ * unless the budget has a time limit that only the streaming inflater
+ * can enforce. The scanlines are still filtered and out must be
+ * released with free(3).
+ */
+enum lgpng_err
+lgpng_idat_inflate(struct IHDR *ihdr, struct lgpng_budget *budget,
+    uint8_t *z, size_t zz, uint8_t **out, size_t *outz)
+{
+	enum lgpng_err	 err;
+	size_t		 rawz, done;
+	uint64_t	 start;
+	uint8_t		*raw;
+
+	if (NULL == ihdr || NULL == z || NULL == out || NULL == outz) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (NULL != budget
+	    && (0 != budget->chunk_usec || 0 != budget->file_usec)) {
+		return(idat_inflate_stream(ihdr, budget, z, zz, out, outz));
+	}
+	if (LGPNG_OK != (err = lgpng_IHDR_raw_size(ihdr, &rawz))) {
+		return(err);
+	}
+	if (NULL != budget) {
+		if (0 != budget->chunk_bytes && rawz > budget->chunk_bytes) {
+			return(LGPNG_BUDGET_EXCEEDED);
+		}
+		if (0 != budget->file_bytes
+		    && budget->used_bytes + rawz > budget->file_bytes) {
+			return(LGPNG_BUDGET_EXCEEDED);
+		}
+	}
+	if (NULL == (raw = malloc(rawz))) {
+		return(LGPNG_NOMEM);
+	}
+	start = NULL != budget ? inflate_cputime() : 0;
+	err = lgpng_zlib_inflate(z, zz, raw, rawz, &done);
+	if (LGPNG_OK == err && done != rawz) {
+		err = LGPNG_TOO_SHORT;
+	}
+	if (NULL != budget) {
+		budget->used_bytes += done;
+		budget->used_usec += inflate_cputime() - start;
+	}
+	if (LGPNG_OK != err) {
+		free(raw);
+		return(err);
+	}
+	*out = raw;
+	*outz = rawz;
+	return(LGPNG_OK);
+}
+
+static void
+idat_segments_free(struct idat_segment *segs, size_t segz)
+{
+	for (size_t i = 0; i < segz; i++) {
+		free(segs[i].out);
+	}
+	free(segs);
+}
+
+/*
+ * Cut the stream at restart points close to equal distances and inflate
+ * the segments concurrently, then check their total size and the Adler-32
+ * of the zlib trailer. On success *segsp receives the *segzp segments, in
+ * order. It is left NULL when the stream has to be inflated sequentially
+ * instead: no usable restart points, fake ones, or a time limit in budget
+ * that only the streaming inflater can enforce.
+ */
+static enum lgpng_err
+idat_parallel(struct IHDR *ihdr, struct lgpng_budget *budget, uint8_t *z,
+    size_t zz, unsigned int threads, struct idat_segment **segsp,
+    size_t *segzp)
+{
+	enum lgpng_err		 err = LGPNG_OK;
+	size_t			 rawz, segz = 0, done = 0, start;
+	uint64_t		 usec = 0;
+	uLong			 adler;
+	struct idat_segment	*segs;
+
+	*segsp = NULL;
+	*segzp = 0;
+	if (LGPNG_OK != (err = lgpng_IHDR_raw_size(ihdr, &rawz))) {
+		return(err);
+	}
+	if (threads < 2 || zz < 6 || 8 != (z[0] & 0x0f)
+	    || 0 != (z[1] & 0x20) || 0 != ((z[0] << 8) | z[1]) % 31) {
+		return(LGPNG_OK);
+	}
+	if (NULL != budget
+	    && (0 != budget->chunk_usec || 0 != budget->file_usec)) {
+		return(LGPNG_OK);
+	}
+	if (NULL != budget) {
+		if (0 != budget->chunk_bytes && rawz > budget->chunk_bytes) {
+			return(LGPNG_BUDGET_EXCEEDED);
+		}
+		if (0 != budget->file_bytes
+		    && budget->used_bytes + rawz > budget->file_bytes) {
+			return(LGPNG_BUDGET_EXCEEDED);
+		}
+	}
+	if (NULL == (segs = calloc(threads, sizeof(*segs)))) {
+		return(LGPNG_NOMEM);
+	}
+	/* Cut at the first restart point after each equal share of input */
+	start = 2;
+	for (unsigned int i = 1; i <= threads; i++) {
+		size_t	 next = zz, target = zz / threads * i, offset;
+
+		if (i < threads && target > start
+		    && 0 != lgpng_idat_find_restarts(z + target - 2,
+		    zz - target + 2, &offset, 1)) {
+			next = target - 2 + offset;
+		}
+		segs[segz].in = z + start;
+		segs[segz].inz = next - start;
+		segs[segz].limit = rawz;
+		segz++;
+		if (zz == next) {
+			break;
+		}
+		start = next;
+	}
+	segs[segz - 1].last = true;
+	if (1 == segz) {
+		free(segs);
+		return(LGPNG_OK);
+	}
+	for (size_t i = 1; i < segz; i++) {
+		if (0 != pthread_create(&(segs[i].thread), NULL,
+		    idat_segment_inflate, &(segs[i]))) {
+			segs[i].thread = pthread_self();
+		}
+	}
+	(void)idat_segment_inflate(&(segs[0]));
+	/* Segments without a thread of their own are inflated here */
+	for (size_t i = 1; i < segz; i++) {
+		if (pthread_equal(segs[i].thread, pthread_self())) {
+			(void)idat_segment_inflate(&(segs[i]));
+		}
+	}
+	for (size_t i = 1; i < segz; i++) {
+		if (! pthread_equal(segs[i].thread, pthread_self())) {
+			(void)pthread_join(segs[i].thread, NULL);
+		}
+	}
+	for (size_t i = 0; i < segz; i++) {
+		if (LGPNG_OK != segs[i].err) {
+			err = segs[i].err;
+			break;
+		}
+		done += segs[i].outz;
+	}
+	if (LGPNG_OK == err && done != rawz) {
+		err = done < rawz ? LGPNG_TOO_SHORT : LGPNG_TOO_LONG;
+	}
+	if (LGPNG_OK == err) {
+		usec = inflate_cputime();
+		adler = 1;
+		for (size_t i = 0; i < segz; i++) {
+			adler = adler32_combine(adler,
+			    lgpng_adler32(1, segs[i].out, segs[i].outz),
+			    (z_off_t)segs[i].outz);
+		}
+		if (adler != segs[segz - 1].trailer) {
+			err = LGPNG_ZLIB_ERROR;
+		}
+		/* Every thread is charged, as if they had run in turn */
+		usec = inflate_cputime() - usec;
+		for (size_t i = 0; i < segz; i++) {
+			usec += segs[i].usec;
+		}
+	}
+	if (LGPNG_OK != err) {
+		idat_segments_free(segs, segz);
+		/* Out of memory is not a reason to try harder */
+		return(LGPNG_NOMEM == err ? err : LGPNG_OK);
+	}
+	if (NULL != budget) {
+		budget->used_bytes += rawz;
+		budget->used_usec += usec;
+	}
+	*segsp = segs;
+	*segzp = segz;
+	return(LGPNG_OK);
+}
+
+/*
+ * Hand the scanlines found in the inflated segments to the row callback
+ * of idat. Rows are passed in place, only the ones straddling two
+ * segments are gathered in the ring of idat first.
+ */
+static enum lgpng_err
+idat_segments_rows(struct lgpng_idat *idat, struct idat_segment *segs,
+    size_t segz)
+{
+	enum lgpng_err	 err = LGPNG_OK;
+	size_t		 left, n;
+	uint8_t		*p, *dst;
+
+	for (size_t i = 0; LGPNG_OK == err && i < segz; i++) {
+		p = segs[i].out;
+		left = segs[i].outz;
+		while (LGPNG_OK == err && 0 != left && 0 != idat->passrows) {
+			if (0 == idat->filled && left >= idat->rowz) {
+				n = idat->rowz;
+				err = idat_row(idat, p);
+			} else {
+				dst = idat_window(idat, &n);
+				n = n < left ? n : left;
+				(void)memcpy(dst, p, n);
+				err = idat_produced(idat, n);
+			}
+			p += n;
+			left -= n;
+		}
+	}
+	return(err);
+}
+
+/*
+ * Inflate the concatenated data of every IDAT chunk with up to threads
+ * workers. The stream is cut at restart points close to equal distances
+ * and the segments are inflated concurrently, then checked against the
+ * Adler-32 of the zlib trailer and moved into a single buffer. Streams
+ * without usable restart points, or with fake ones, are inflated
+ * sequentially, as are all streams when budget has a time limit. If
+ * segmentsp is not NULL it receives the number of segments, 1 when
+ * nothing ran concurrently. The scanlines are still filtered and out must
+ * be released with free(3).
+ */
+enum lgpng_err
+lgpng_idat_inflate_parallel(struct IHDR *ihdr, struct lgpng_budget *budget,
+    uint8_t *z, size_t zz, unsigned int threads, uint8_t **out, size_t *outz,
+    size_t *segmentsp)
+{
+	enum lgpng_err		 err;
+	size_t			 rawz = 0, segz, done;
+	uint8_t			*raw;
+	struct idat_segment	*segs;
+
+	if (NULL == ihdr || NULL == z || NULL == out || NULL == outz) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (NULL != segmentsp) {
+		*segmentsp = 1;
+	}
+	if (LGPNG_OK != (err = idat_parallel(ihdr, budget, z, zz, threads,
+	    &segs, &segz))) {
+		return(err);
+	}
+	if (NULL == segs) {
+		return(lgpng_idat_inflate(ihdr, budget, z, zz, out, outz));
+	}
+	/*
+	 * The first segment grows into the whole image, the others are
+	 * released as soon as they are moved in.
+	 */
+	for (size_t i = 0; i < segz; i++) {
+		rawz += segs[i].outz;
+	}
+	if (NULL == (raw = realloc(segs[0].out, rawz))) {
+		idat_segments_free(segs, segz);
+		return(LGPNG_NOMEM);
+	}
+	segs[0].out = NULL;
+	done = segs[0].outz;
+	for (size_t i = 1; i < segz; i++) {
+		(void)memcpy(raw + done, segs[i].out, segs[i].outz);
+		done += segs[i].outz;
+		free(segs[i].out);
+		segs[i].out = NULL;
+	}
+	free(segs);
+	if (NULL != segmentsp) {
+		*segmentsp = segz;
+	}
+	*out = raw;
+	*outz = rawz;
+	return(LGPNG_OK);
+}
+
+/*
+ * Same as lgpng_idat_inflate_parallel but the scanlines are handed to fn
+ * as in the row mode of lgpng_idat_new_rows, once the whole stream was
+ * inflated and checked. Rows are read in place from the buffers of the
+ * segments, no copy of the image is made, and the previous row is still
+ * intact while fn runs.
+ */
+enum lgpng_err
+lgpng_idat_inflate_parallel_rows(struct IHDR *ihdr,
+    struct lgpng_budget *budget, uint8_t *z, size_t zz, unsigned int threads,
+    lgpng_row_fn fn, void *arg, size_t *segmentsp)
+{
+	enum lgpng_err		 err;
+	size_t			 segz;
+	struct idat_segment	*segs;
+	struct lgpng_idat	*idat;
+
+	if (NULL == ihdr || NULL == z || NULL == fn) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (NULL != segmentsp) {
+		*segmentsp = 1;
+	}
+	if (LGPNG_OK != (err = idat_parallel(ihdr, budget, z, zz, threads,
+	    &segs, &segz))) {
+		return(err);
+	}
+	if (NULL == segs) {
+		err = lgpng_idat_new_rows(ihdr, budget, fn, arg, &idat);
+		if (LGPNG_OK != err) {
+			return(err);
+		}
+		if (LGPNG_OK == (err = idat_feed_all(idat, z, zz))) {
+			err = lgpng_idat_finish(idat, NULL, NULL);
+		}
+		lgpng_idat_free(idat);
+		return(err);
+	}
+	/* Already charged to budget */
+	if (LGPNG_OK == (err = lgpng_idat_new_rows(ihdr, NULL, fn, arg,
+	    &idat))) {
+		err = idat_segments_rows(idat, segs, segz);
+		lgpng_idat_free(idat);
+	}
+	idat_segments_free(segs, segz);
+	if (LGPNG_OK == err && NULL != segmentsp) {
+		*segmentsp = segz;
+	}
+	return(err);
+}
@@ -0,0 +1,464 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+# include <tmmintrin.h>
+#endif
+#if defined(__AVX2__)
+# include <immintrin.h>
+#endif
+
+#include "lgpng.h"
+
+/*
+ * The instruction set is chosen at compile time: build with -mssse3 or
+ * -mavx2 to get the wider kernels. Every filter is specialized for each
+ * possible number of bytes per pixel, which lets the compiler turn the
+ * pixel sized loads and stores into single instructions.
+ */
+#if defined(__AVX2__)
+const char *lgpng_unfilter_isa = "avx2";
+#elif defined(__SSSE3__)
+const char *lgpng_unfilter_isa = "ssse3";
+#elif defined(__SSE2__)
+const char *lgpng_unfilter_isa = "sse2";
+#else
+const char *lgpng_unfilter_isa = "scalar";
+#endif
+
+static inline uint8_t
+unfilter_paeth_predictor(int a, int b, int c)
+{
+	int	p, pa, pb, pc;
+
+	p = a + b - c;
+	pa = abs(p - a);
+	pb = abs(p - b);
+	pc = abs(p - c);
+	if (pa <= pb && pa <= pc) {
+		return((uint8_t)a);
+	} else if (pb <= pc) {
+		return((uint8_t)b);
+	}
+	return((uint8_t)c);
+}
+
+/*
+ * Reference implementation, written after the specification. A missing
+ * previous row is read as zeroes.
+ */
+static inline void
+unfilter_ref(uint8_t filter, size_t bpp, uint8_t *row, const uint8_t *prev,
+    size_t rowz)
+{
+	int	 a, b, c;
+
+	for (size_t i = 0; i < rowz; i++) {
+		a = i >= bpp ? row[i - bpp] : 0;
+		b = NULL != prev ? prev[i] : 0;
+		c = NULL != prev && i >= bpp ? prev[i - bpp] : 0;
+		switch (filter) {
+		case FILTER_TYPE_SUB:
+			row[i] = (uint8_t)(row[i] + a);
+			break;
+		case FILTER_TYPE_UP:
+			row[i] = (uint8_t)(row[i] + b);
+			break;
+		case FILTER_TYPE_AVERAGE:
+			row[i] = (uint8_t)(row[i] + ((a + b) >> 1));
+			break;
+		case FILTER_TYPE_PAETH:
+			row[i] = (uint8_t)(row[i]
+			    + unfilter_paeth_predictor(a, b, c));
+			break;
+		default:
+			return;
+		}
+	}
+}
+
+static void
+unfilter_none(uint8_t *row, const uint8_t *prev, size_t rowz)
+{
+	(void)row;
+	(void)prev;
+	(void)rowz;
+}
+
+/* Average filter on the first row, only the left neighbour counts */
+static void
+unfilter_avg_first(size_t bpp, uint8_t *row, size_t rowz)
+{
+	for (size_t i = bpp; i < rowz; i++) {
+		row[i] = (uint8_t)(row[i] + (row[i - bpp] >> 1));
+	}
+}
+
+#if defined(__SSE2__)
+
+static inline __m128i
+unfilter_load(const uint8_t *p, size_t bpp)
+{
+	uint64_t	v = 0;
+
+	(void)memcpy(&v, p, bpp);
+	return(_mm_loadl_epi64((const __m128i *)&v));
+}
+
+static inline void
+unfilter_store(uint8_t *p, __m128i x, size_t bpp)
+{
+	uint64_t	v;
+
+	_mm_storel_epi64((__m128i *)&v, x);
+	(void)memcpy(p, &v, bpp);
+}
+
+static inline __m128i
+unfilter_abs16(__m128i x)
+{
+#if defined(__SSSE3__)
+	return(_mm_abs_epi16(x));
+#else
+	return(_mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x)));
+#endif
+}
+
+/* Pick t where the mask is set and f elsewhere */
+static inline __m128i
+unfilter_select(__m128i mask, __m128i t, __m128i f)
+{
+	return(_mm_or_si128(_mm_and_si128(mask, t), _mm_andnot_si128(mask, f)));
+}
+
+static void
+unfilter_up(uint8_t *row, const uint8_t *prev, size_t rowz)
+{
+	size_t	i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 32 <= rowz; i += 32) {
+		__m256i	x, b;
+
+		x = _mm256_loadu_si256((const __m256i *)(row + i));
+		b = _mm256_loadu_si256((const __m256i *)(prev + i));
+		_mm256_storeu_si256((__m256i *)(row + i),
+		    _mm256_add_epi8(x, b));
+	}
+#endif
+	for (; i + 16 <= rowz; i += 16) {
+		__m128i	x, b;
+
+		x = _mm_loadu_si128((const __m128i *)(row + i));
+		b = _mm_loadu_si128((const __m128i *)(prev + i));
+		_mm_storeu_si128((__m128i *)(row + i), _mm_add_epi8(x, b));
+	}
+	for (; i < rowz; i++) {
+		row[i] = (uint8_t)(row[i] + prev[i]);
+	}
+}
+
+/* Broadcast the last pixel of a vector to all its lanes */
+#define UNFILTER_LAST_1(x)	_mm_shuffle_epi32(_mm_shufflehi_epi16( \
+				    _mm_unpackhi_epi8((x), (x)), 0xff), 0xff)
+#define UNFILTER_LAST_2(x)	_mm_shuffle_epi32( \
+				    _mm_shufflehi_epi16((x), 0xff), 0xff)
+#define UNFILTER_LAST_4(x)	_mm_shuffle_epi32((x), 0xff)
+#define UNFILTER_LAST_8(x)	_mm_unpackhi_epi64((x), (x))
+
+/*
+ * Sub filter for power of two pixel sizes: a prefix sum over each 16
+ * bytes block done in log2(16 / bpp) shifts, plus the last pixel of the
+ * previous block.
+ */
+#define UNFILTER_SUB_POW2(bpp)						\
+static void								\
+unfilter_sub_##bpp(uint8_t *row, const uint8_t *prev, size_t rowz)	\
+{									\
+	size_t	 i = 0;							\
+	__m128i	 x, carry = _mm_setzero_si128();			\
+									\
+	(void)prev;							\
+	for (; i + 16 <= rowz; i += 16) {				\
+		x = _mm_loadu_si128((const __m128i *)(row + i));	\
+		x = _mm_add_epi8(x, _mm_slli_si128(x, bpp));		\
+		if (bpp < 8)						\
+			x = _mm_add_epi8(x, _mm_slli_si128(x, 2 * bpp)); \
+		if (bpp < 4)						\
+			x = _mm_add_epi8(x, _mm_slli_si128(x, 4 * bpp)); \
+		if (bpp < 2)						\
+			x = _mm_add_epi8(x, _mm_slli_si128(x, 8 * bpp)); \
+		x = _mm_add_epi8(x, carry);				\
+		_mm_storeu_si128((__m128i *)(row + i), x);		\
+		carry = UNFILTER_LAST_##bpp(x);				\
+	}								\
+	for (i = i < bpp ? bpp : i; i < rowz; i++) {			\
+		row[i] = (uint8_t)(row[i] + row[i - bpp]);		\
+	}								\
+}
+
+/* Sub filter one pixel at a time, for the odd sizes */
+#define UNFILTER_SUB_PIXEL(bpp)						\
+static void								\
+unfilter_sub_##bpp(uint8_t *row, const uint8_t *prev, size_t rowz)	\
+{									\
+	__m128i	 a = _mm_setzero_si128();				\
+									\
+	(void)prev;							\
+	for (size_t i = 0; i + bpp <= rowz; i += bpp) {			\
+		a = _mm_add_epi8(unfilter_load(row + i, bpp), a);	\
+		unfilter_store(row + i, a, bpp);			\
+	}								\
+}
+
+/*
+ * Average filter, floor((a + b) / 2) is computed as the rounded up
+ * average minus the lost low bit.
+ */
+#define UNFILTER_AVG(bpp)						\
+static void								\
+unfilter_avg_##bpp(uint8_t *row, const uint8_t *prev, size_t rowz)	\
+{									\
+	__m128i	 a = _mm_setzero_si128(), b, avg;			\
+	const __m128i one = _mm_set1_epi8(1);				\
+									\
+	for (size_t i = 0; i + bpp <= rowz; i += bpp) {			\
+		b = unfilter_load(prev + i, bpp);			\
+		avg = _mm_sub_epi8(_mm_avg_epu8(a, b),			\
+		    _mm_and_si128(_mm_xor_si128(a, b), one));		\
+		a = _mm_add_epi8(unfilter_load(row + i, bpp), avg);	\
+		unfilter_store(row + i, a, bpp);			\
+	}								\
+}
+
+/*
+ * Branchless Paeth on 16 bits lanes. With p = a + b - c the distances
+ * simplify to pa = |b - c|, pb = |a - c| and pc = |a + b - 2c|.
+ */
+#define UNFILTER_PAETH(bpp)						\
+static void								\
+unfilter_paeth_##bpp(uint8_t *row, const uint8_t *prev, size_t rowz)	\
+{									\
+	const __m128i zero = _mm_setzero_si128();			\
+	__m128i	 a = zero, c = zero, b, pa, pb, pc, nota, usec, pred, r; \
+									\
+	for (size_t i = 0; i + bpp <= rowz; i += bpp) {			\
+		b = _mm_unpacklo_epi8(unfilter_load(prev + i, bpp), zero); \
+		pa = _mm_sub_epi16(b, c);				\
+		pb = _mm_sub_epi16(a, c);				\
+		pc = unfilter_abs16(_mm_add_epi16(pa, pb));		\
+		pa = unfilter_abs16(pa);				\
+		pb = unfilter_abs16(pb);				\
+		nota = _mm_or_si128(_mm_cmpgt_epi16(pa, pb),		\
+		    _mm_cmpgt_epi16(pa, pc));				\
+		usec = _mm_cmpgt_epi16(pb, pc);				\
+		pred = unfilter_select(nota,				\
+		    unfilter_select(usec, c, b), a);			\
+		r = _mm_add_epi8(unfilter_load(row + i, bpp),		\
+		    _mm_packus_epi16(pred, pred));			\
+		unfilter_store(row + i, r, bpp);			\
+		a = _mm_unpacklo_epi8(r, zero);				\
+		c = b;							\
+	}								\
+}
+
+UNFILTER_SUB_POW2(1)
+UNFILTER_SUB_POW2(2)
+UNFILTER_SUB_PIXEL(3)
+UNFILTER_SUB_POW2(4)
+UNFILTER_SUB_PIXEL(6)
+UNFILTER_SUB_POW2(8)
+
+#else /* __SSE2__ */
+
+static void
+unfilter_up(uint8_t *row, const uint8_t *prev, size_t rowz)
+{
+	unfilter_ref(FILTER_TYPE_UP, 1, row, prev, rowz);
+}
+
+/* Let the compiler specialize the reference code for each size */
+#define UNFILTER_SCALAR(name, filter, bpp)				\
+static void								\
+unfilter_##name##_##bpp(uint8_t *row, const uint8_t *prev, size_t rowz)	\
+{									\
+	unfilter_ref(filter, bpp, row, prev, rowz);			\
+}
+#define UNFILTER_AVG(bpp)	UNFILTER_SCALAR(avg, FILTER_TYPE_AVERAGE, bpp)
+#define UNFILTER_PAETH(bpp)	UNFILTER_SCALAR(paeth, FILTER_TYPE_PAETH, bpp)
+
+UNFILTER_SCALAR(sub, FILTER_TYPE_SUB, 1)
+UNFILTER_SCALAR(sub, FILTER_TYPE_SUB, 2)
+UNFILTER_SCALAR(sub, FILTER_TYPE_SUB, 3)
+UNFILTER_SCALAR(sub, FILTER_TYPE_SUB, 4)
+UNFILTER_SCALAR(sub, FILTER_TYPE_SUB, 6)
+UNFILTER_SCALAR(sub, FILTER_TYPE_SUB, 8)
+
+#endif /* __SSE2__ */
+
+UNFILTER_AVG(1)
+UNFILTER_AVG(2)
+UNFILTER_AVG(3)
+UNFILTER_AVG(4)
+UNFILTER_AVG(6)
+UNFILTER_AVG(8)
+
+UNFILTER_PAETH(1)
+UNFILTER_PAETH(2)
+UNFILTER_PAETH(3)
+UNFILTER_PAETH(4)
+UNFILTER_PAETH(6)
+UNFILTER_PAETH(8)
+
+#define UNFILTER_SIZES(name) {						\
+	NULL, unfilter_##name##_1, unfilter_##name##_2,			\
+	unfilter_##name##_3, unfilter_##name##_4, NULL,			\
+	unfilter_##name##_6, NULL, unfilter_##name##_8,			\
+}
+
+/* Indexed by filter type then by bytes per pixel */
+static const lgpng_unfilter_fn unfilter_table[FILTER_TYPE__MAX][9] = {
+	{ NULL, unfilter_none, unfilter_none, unfilter_none, unfilter_none,
+	    NULL, unfilter_none, NULL, unfilter_none },
+	UNFILTER_SIZES(sub),
+	{ NULL, unfilter_up, unfilter_up, unfilter_up, unfilter_up,
+	    NULL, unfilter_up, NULL, unfilter_up },
+	UNFILTER_SIZES(avg),
+	UNFILTER_SIZES(paeth),
+};
+
+/*
+ * Return the kernel for a filter type and a number of bytes per pixel,
+ * or NULL if there is none. Kernels expect a previous row.
+ */
+lgpng_unfilter_fn
+lgpng_unfilter_select(uint8_t filter, size_t bpp)
+{
+	if (filter >= FILTER_TYPE__MAX || bpp > 8) {
+		return(NULL);
+	}
+	return(unfilter_table[filter][bpp]);
+}
+
+static enum lgpng_err
+unfilter_check(uint8_t filter, size_t bpp, uint8_t *row, size_t rowz)
+{
+	if (NULL == row || NULL == lgpng_unfilter_select(filter, bpp)) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (0 != rowz % bpp) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	return(LGPNG_OK);
+}
+
+/*
+ * Reverse the filter of one scanline in place. The filter type byte is
+ * not part of row, and prev is NULL for the first row of an image or of
+ * an Adam7 pass. The length must be a multiple of bpp, which is always
+ * the case for PNG scanlines.
+ */
+enum lgpng_err
+lgpng_unfilter_row(uint8_t filter, size_t bpp, uint8_t *row,
+    const uint8_t *prev, size_t rowz)
+{
+	enum lgpng_err	err;
+
+	if (LGPNG_OK != (err = unfilter_check(filter, bpp, row, rowz))) {
+		return(err);
+	}
+	if (NULL == prev) {
+		switch (filter) {
+		case FILTER_TYPE_NONE:
+		case FILTER_TYPE_UP:
+			return(LGPNG_OK);
+		case FILTER_TYPE_AVERAGE:
+			unfilter_avg_first(bpp, row, rowz);
+			return(LGPNG_OK);
+		default:
+			/* Paeth degenerates into Sub */
+			filter = FILTER_TYPE_SUB;
+			break;
+		}
+	}
+	unfilter_table[filter][bpp](row, prev, rowz);
+	return(LGPNG_OK);
+}
+
+/* Same as lgpng_unfilter_row without any vector code, for testing */
+enum lgpng_err
+lgpng_unfilter_row_scalar(uint8_t filter, size_t bpp, uint8_t *row,
+    const uint8_t *prev, size_t rowz)
+{
+	enum lgpng_err	err;
+
+	if (LGPNG_OK != (err = unfilter_check(filter, bpp, row, rowz))) {
+		return(err);
+	}
+	unfilter_ref(filter, bpp, row, prev, rowz);
+	return(LGPNG_OK);
+}
+
+/*
+ * Reverse the filters of a whole decompressed image in place, pass by
+ * pass for Adam7. Scanlines keep their leading filter type byte.
+ */
+enum lgpng_err
+lgpng_unfilter_image(struct IHDR *ihdr, uint8_t *raw, size_t rawz)
+{
+	int		 passes;
+	enum lgpng_err	 err;
+	size_t		 bpp, rowz, offset = 0;
+	uint8_t		*prev;
+	uint32_t	 width, height;
+
+	if (NULL == ihdr || NULL == raw) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (0 == (bpp = ((size_t)lgpng_IHDR_bitsperpixel(ihdr) + 7) / 8)) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	passes = INTERLACE_METHOD_ADAM7 == ihdr->data.interlace ? 7 : 1;
+	for (int pass = 0; pass < passes; pass++) {
+		lgpng_IHDR_pass_size(ihdr, pass, &width, &height);
+		if (0 == width || 0 == height) {
+			continue;
+		}
+		rowz = lgpng_IHDR_rowbytes(ihdr, width);
+		prev = NULL;
+		for (uint32_t y = 0; y < height; y++) {
+			if (rawz - offset < rowz + 1) {
+				return(LGPNG_TOO_SHORT);
+			}
+			err = lgpng_unfilter_row(raw[offset], bpp,
+			    raw + offset + 1, prev, rowz);
+			if (LGPNG_OK != err) {
+				return(err);
+			}
+			prev = raw + offset + 1;
+			offset += rowz + 1;
+		}
+	}
+	return(LGPNG_OK);
+}
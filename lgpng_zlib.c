@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if HAVE_LIBDEFLATE
+# include <libdeflate.h>
+#endif
+#include <zlib.h>
+
+#include "lgpng.h"
+
+/*
+ * Whole buffer compression backend. Streaming users, like the chunk and
+ * IDAT inflaters, always go through the zlib API, either from zlib or
+ * from zlib-ng built as a drop-in replacement. When both sizes are known
+ * beforehand the work is done here instead, by libdeflate if configure
+ * found it since it is much faster on complete buffers. zlib-ng in
+ * compatibility mode exports the zlib API itself, so HAVE_ZLIB_NG only
+ * names it in lgpng_zlib_backend.
+ */
+#if HAVE_LIBDEFLATE
+const char *lgpng_zlib_backend = "libdeflate";
+#elif HAVE_ZLIB_NG
+const char *lgpng_zlib_backend = "zlib-ng";
+#else
+const char *lgpng_zlib_backend = "zlib";
+#endif
+
+#if HAVE_LIBDEFLATE
+
+enum lgpng_err
+lgpng_zlib_inflate(const uint8_t *src, size_t srcz, uint8_t *dst,
+    size_t dstz, size_t *outz)
+{
+	enum libdeflate_result			 ret;
+	struct libdeflate_decompressor		*d;
+
+	if (NULL == src || NULL == dst || NULL == outz) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (NULL == (d = libdeflate_alloc_decompressor())) {
+		return(LGPNG_NOMEM);
+	}
+	ret = libdeflate_zlib_decompress(d, src, srcz, dst, dstz, outz);
+	libdeflate_free_decompressor(d);
+	switch (ret) {
+	case LIBDEFLATE_SUCCESS:
+		return(LGPNG_OK);
+	case LIBDEFLATE_INSUFFICIENT_SPACE:
+		return(LGPNG_TOO_LONG);
+	default:
+		return(LGPNG_ZLIB_ERROR);
+	}
+}
+
+size_t
+lgpng_zlib_bound(size_t srcz)
+{
+	return(libdeflate_zlib_compress_bound(NULL, srcz));
+}
+
+enum lgpng_err
+lgpng_zlib_deflate(int level, const uint8_t *src, size_t srcz, uint8_t *dst,
+    size_t dstz, size_t *outz)
+{
+	struct libdeflate_compressor	*c;
+
+	if (NULL == src || NULL == dst || NULL == outz || level < -1
+	    || level > 9) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	/* libdeflate goes up to 12, keep the zlib scale */
+	if (NULL == (c = libdeflate_alloc_compressor(-1 == level ? 6 : level))) {
+		return(LGPNG_NOMEM);
+	}
+	*outz = libdeflate_zlib_compress(c, src, srcz, dst, dstz);
+	libdeflate_free_compressor(c);
+	return(0 == *outz ? LGPNG_TOO_LONG : LGPNG_OK);
+}
+
+#else /* HAVE_LIBDEFLATE */
+
+static enum lgpng_err
+zlib_zerr(int zret)
+{
+	switch (zret) {
+	case Z_MEM_ERROR:
+		return(LGPNG_NOMEM);
+	case Z_BUF_ERROR:
+		return(LGPNG_TOO_SHORT);
+	default:
+		return(LGPNG_ZLIB_ERROR);
+	}
+}
+
+enum lgpng_err
+lgpng_zlib_inflate(const uint8_t *src, size_t srcz, uint8_t *dst,
+    size_t dstz, size_t *outz)
+{
+	int		 zret = Z_OK;
+	enum lgpng_err	 err = LGPNG_OK;
+	uint8_t		 spare;
+	size_t		 left;
+	z_stream	 strm;
+
+	if (NULL == src || NULL == dst || NULL == outz) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	(void)memset(&strm, 0, sizeof(strm));
+	if (Z_OK != inflateInit(&strm)) {
+		return(LGPNG_ZLIB_ERROR);
+	}
+	*outz = 0;
+	while (Z_STREAM_END != zret) {
+		if (0 == strm.avail_in) {
+			strm.next_in = (uint8_t *)src;
+			strm.avail_in = srcz > UINT32_MAX ? UINT32_MAX : (uInt)srcz;
+			src += strm.avail_in;
+			srcz -= strm.avail_in;
+		}
+		left = dstz - *outz;
+		if (0 == left) {
+			/* Only used to detect overlong streams */
+			strm.next_out = &spare;
+			strm.avail_out = 1;
+		} else {
+			strm.next_out = dst + *outz;
+			strm.avail_out = left > UINT32_MAX ? UINT32_MAX : (uInt)left;
+		}
+		zret = inflate(&strm, Z_NO_FLUSH);
+		if (0 == left) {
+			if (strm.next_out != &spare) {
+				err = LGPNG_TOO_LONG;
+				break;
+			}
+		} else {
+			*outz += (size_t)(strm.next_out - (dst + *outz));
+		}
+		if (Z_OK != zret && Z_STREAM_END != zret) {
+			err = zlib_zerr(zret);
+			break;
+		}
+	}
+	(void)inflateEnd(&strm);
+	return(err);
+}
+
+size_t
+lgpng_zlib_bound(size_t srcz)
+{
+	return(compressBound((uLong)srcz));
+}
+
+enum lgpng_err
+lgpng_zlib_deflate(int level, const uint8_t *src, size_t srcz, uint8_t *dst,
+    size_t dstz, size_t *outz)
+{
+	int		 zret;
+	z_stream	 strm;
+
+	if (NULL == src || NULL == dst || NULL == outz || level < -1
+	    || level > 9) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	if (srcz > UINT32_MAX || dstz > UINT32_MAX) {
+		return(LGPNG_INVALID_PARAM);
+	}
+	(void)memset(&strm, 0, sizeof(strm));
+	if (Z_OK != deflateInit(&strm, level)) {
+		return(LGPNG_ZLIB_ERROR);
+	}
+	strm.next_in = (uint8_t *)src;
+	strm.avail_in = (uInt)srcz;
+	strm.next_out = dst;
+	strm.avail_out = (uInt)dstz;
+	zret = deflate(&strm, Z_FINISH);
+	*outz = strm.total_out;
+	(void)deflateEnd(&strm);
+	if (Z_STREAM_END != zret) {
+		return(Z_OK == zret || Z_BUF_ERROR == zret ?
+		    LGPNG_TOO_LONG : LGPNG_ZLIB_ERROR);
+	}
+	return(LGPNG_OK);
+}
+
+#endif /* HAVE_LIBDEFLATE */
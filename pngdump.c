@@ -20,16 +20,17 @@
 #if HAVE_ERR
 # include <err.h>
 #endif
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <zlib.h>
 
 #include "lgpng.h"
 
 void usage(void);
+enum lgpng_err write_sink(void *, uint8_t *, size_t);
 
 int
 main(int argc, char *argv[])
@@ -37,15 +38,17 @@ main(int argc, char *argv[])
 	int		 ch;
 	uint8_t	 	 oflag = 0, uflag = 0;
 	long		 offset;
+	long long	 mflag = 0, tflag = 0;
 	bool		 sflag = false;
 	bool		 loopexit = false;
 	const char	*errstr = NULL;
 	FILE		*source = stdin;
+	struct lgpng_budget budget;
 
 #if HAVE_PLEDGE
 	pledge("stdio rpath", NULL);
 #endif
-	while (-1 != (ch = getopt(argc, argv, "f:o:su")))
+	while (-1 != (ch = getopt(argc, argv, "f:m:o:st:u")))
 		switch (ch) {
 		case 'f':
 			if (NULL == (source = fopen(optarg, "r"))) {
@@ -58,9 +61,21 @@ main(int argc, char *argv[])
 				return(EXIT_FAILURE);
 			}
 			break;
+		case 'm':
+			mflag = strtonum(optarg, 1, LLONG_MAX, &errstr);
+			if (NULL != errstr) {
+				errx(EXIT_FAILURE, "value is %s -- m", errstr);
+			}
+			break;
 		case 's':
 			sflag = true;
 			break;
+		case 't':
+			tflag = strtonum(optarg, 1, LLONG_MAX / 1000, &errstr);
+			if (NULL != errstr) {
+				errx(EXIT_FAILURE, "value is %s -- t", errstr);
+			}
+			break;
 		case 'u':
 			uflag = true;
 			break;
@@ -76,6 +91,9 @@ main(int argc, char *argv[])
 		usage();
 	}
 
+	lgpng_budget_init(&budget, (size_t)mflag, (size_t)mflag, 0,
+	    (uint64_t)tflag * 1000);
+
 	/* Read the file byte by byte until the PNG signature is found */
 	offset = 0;
 	if (false == sflag) {
@@ -95,6 +113,7 @@ main(int argc, char *argv[])
 	}
 
 	do {
+		enum lgpng_err	 zerr;
 		uint32_t	 length = 0, crc = 0;
 		uint8_t		*data = NULL;
 		uint8_t		 type[4] = {0, 0, 0, 0};
@@ -123,25 +142,13 @@ main(int argc, char *argv[])
 				goto stop;
 			}
 			if (true == uflag) {
-				unsigned int	 retry = 2;
-				int	 zret;
-				size_t	 outz, outtmpz;
-				uint8_t	*out = NULL, *outtmp = NULL;
-				do {
-					outtmpz = (length - oflag) * retry;
-					if (NULL == (outtmp = realloc(out, outtmpz + 1))) {
-						errx(EXIT_FAILURE, "realloc(outtmpz + 1)");
-					}
-					out = outtmp;
-					outz = outtmpz;
-					zret = uncompress(out, &outz, data + oflag, length - oflag);
-					if (Z_BUF_ERROR != zret && Z_OK != zret) {
-						errx(EXIT_FAILURE, "Failed decompression");
-					}
-					out[outz] = '\0';
-					retry += 1;
-				} while (Z_OK != zret);
-				(void)fwrite(out, 1, outz, stdout);
+				zerr = lgpng_inflate_chunk(data + oflag,
+				    length - oflag, &budget, write_sink, stdout);
+				if (LGPNG_BUDGET_EXCEEDED == zerr) {
+					errx(EXIT_FAILURE, "Decompression budget exceeded");
+				} else if (LGPNG_OK != zerr) {
+					errx(EXIT_FAILURE, "Failed decompression");
+				}
 			} else {
 				(void)fwrite(data + oflag, 1, length - oflag, stdout);
 			}
@@ -157,11 +164,20 @@ stop:
 	return(EXIT_SUCCESS);
 }
 
+enum lgpng_err
+write_sink(void *arg, uint8_t *data, size_t dataz)
+{
+	if (dataz != fwrite(data, 1, dataz, (FILE *)arg)) {
+		return(LGPNG_ERROR);
+	}
+	return(LGPNG_OK);
+}
+
 void
 usage(void)
 {
-	fprintf(stderr, "usage: %s [-su] [-f file] [-o offset] chunk\n",
-	    getprogname());
+	fprintf(stderr, "usage: %s [-su] [-f file] [-m bytes] [-o offset] "
+	    "[-t msec] chunk\n", getprogname());
 	exit(EXIT_FAILURE);
 }
 
@@ -20,21 +20,40 @@
 #if HAVE_ERR
 # include <err.h>
 #endif
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
-#include <zlib.h>
 
 #include "lgpng.h"
 
+/* Filled while inflating IDAT with -z or -u */
+struct idat_stats {
+	uint64_t	 filters[FILTER_TYPE__MAX + 1];	/* Then invalid ones */
+	uint64_t	 rows;
+	uint64_t	 rawz;
+	uint64_t	 compressedz;
+	size_t		 expectedz;
+	clock_t		 ticks;
+	bool		 count;		/* Only count the bytes, -u */
+	bool		 failed;
+};
+
 void usage(void);
 void info_compression_method(uint8_t, uint8_t [4]);
 int  info_zlib(uint8_t, uint8_t, uint8_t [4]);
 void info_IHDR(struct IHDR *);
 void info_PLTE(struct PLTE *);
 void info_IDAT(uint8_t *, uint32_t, int);
+enum lgpng_err count_IDAT_row(void *, uint32_t, uint8_t *, size_t);
+void inflate_IDAT(struct lgpng_idat **, struct idat_stats *, struct IHDR *,
+    uint8_t *, uint32_t);
+bool info_IDAT_stats(struct lgpng_idat *, struct idat_stats *);
+void check_APNG(struct lgpng_apng_check *, uint8_t [4], uint8_t *, uint32_t);
+void info_APNG_check(struct lgpng_apng_check *);
 void info_tRNS(struct IHDR *, struct PLTE *, uint8_t *, uint32_t);
 void info_cHRM(uint8_t *, uint32_t);
 void info_gAMA(uint8_t *, uint32_t);
@@ -44,6 +63,7 @@ void info_sRGB(uint8_t *, uint32_t);
 void info_cICP(uint8_t *, uint32_t);
 void info_tEXt(uint8_t *, uint32_t);
 void info_zTXt(uint8_t *, uint32_t);
+void info_iTXt(uint8_t *, uint32_t);
 void info_bKGD(struct IHDR *, struct PLTE *, uint8_t *, uint32_t);
 void info_hIST(struct PLTE *, uint8_t *, uint32_t);
 void info_pHYs(uint8_t *, uint32_t);
@@ -67,26 +87,39 @@ void info_msOG(uint8_t *, uint32_t);
 void info_tpNG(uint8_t *, uint32_t);
 void info_unknown(uint8_t [4], uint8_t *, uint32_t);
 
+/* Shared by every decompressing chunk handler */
+struct lgpng_budget budget;
+
 int
 main(int argc, char *argv[])
 {
-	int		 ch, idatnum = 0;
+	int		 ch, idatnum = 0, rc = EXIT_SUCCESS;
 	long		 offset;
-	bool		 cflag = false;
-	bool		 lflag = true, sflag = false;
+	long long	 mflag = 0, tflag = 0;
+	bool		 aflag = false, cflag = false;
+	bool		 lflag = true, sflag = false, uflag = false, zflag = false;
 	bool		 loopexit = false;
 	struct IHDR	 ihdr;
 	struct PLTE	 plte;
+	struct idat_stats stats;
+	struct lgpng_apng_check check;
+	struct lgpng_idat *idat = NULL;
 	FILE		*source = stdin;
 	uint8_t		 target_chunk[4] = {0, 0, 0, 0};
+	const char	*errstr = NULL;
 
 #if HAVE_PLEDGE
 	pledge("stdio rpath", NULL);
 #endif
 	(void)memset(&ihdr, 0, sizeof(ihdr));
 	(void)memset(&plte, 0, sizeof(plte));
-	while (-1 != (ch = getopt(argc, argv, "c:df:ls")))
+	(void)memset(&stats, 0, sizeof(stats));
+	lgpng_apng_check_init(&check);
+	while (-1 != (ch = getopt(argc, argv, "ac:df:lm:st:uz")))
 		switch (ch) {
+		case 'a':
+			aflag = true;
+			break;
 		case 'c':
 			cflag = true;
 			lflag = false;
@@ -101,14 +134,46 @@ main(int argc, char *argv[])
 			cflag = false;
 			lflag = true;
 			break;
+		case 'm':
+			mflag = strtonum(optarg, 1, LLONG_MAX, &errstr);
+			if (NULL != errstr) {
+				errx(EXIT_FAILURE, "value is %s -- m", errstr);
+			}
+			break;
 		case 's':
 			sflag = true;
 			break;
+		case 't':
+			tflag = strtonum(optarg, 1, LLONG_MAX / 1000, &errstr);
+			if (NULL != errstr) {
+				errx(EXIT_FAILURE, "value is %s -- t", errstr);
+			}
+			break;
+		case 'u':
+			cflag = true;
+			lflag = false;
+			uflag = true;
+			(void)memcpy(target_chunk, "IDAT", 4);
+			break;
+		case 'z':
+			zflag = true;
+			break;
 		default:
 			usage();
 		}
 	argc -= optind;
 	argv += optind;
+	/* Inflating only makes sense for the image data */
+	if (zflag && ! cflag) {
+		cflag = true;
+		lflag = false;
+		(void)memcpy(target_chunk, "IDAT", 4);
+	} else if (zflag && 0 != memcmp(target_chunk, "IDAT", 4)) {
+		usage();
+	}
+	stats.count = uflag;
+	lgpng_budget_init(&budget, (size_t)mflag, (size_t)mflag, 0,
+	    (uint64_t)tflag * 1000);
 
 	/* Read the file byte by byte until the PNG signature is found */
 	offset = 0;
@@ -133,6 +198,8 @@ main(int argc, char *argv[])
 		uint32_t	 length = 0, chunk_crc = 0, calc_crc = 0;
 		uint8_t		*data = NULL;
 		uint8_t		 current_chunk[4] = {0, 0, 0, 0};
+		uint8_t		 peek[LGPNG_APNG_CHECKZ];
+		size_t		 peekz;
 
 		if (LGPNG_OK != lgpng_stream_get_length(source, &length)) {
 			break;
@@ -158,6 +225,14 @@ main(int argc, char *argv[])
 			if (LGPNG_OK != lgpng_stream_get_data(source, length, &data)) {
 				goto stop;
 			}
+		} else if (lflag && aflag) {
+			/* Enough for the APNG checks, fdAT bodies are skipped */
+			peekz = length < sizeof(peek) ? length : sizeof(peek);
+			if (peekz != fread(peek, 1, peekz, source)) {
+				goto stop;
+			}
+			(void)lgpng_stream_skip_data(source,
+			    length - (uint32_t)peekz);
 		} else if (lflag) {
 			(void)lgpng_stream_skip_data(source, length);
 		} else {
@@ -176,6 +251,10 @@ main(int argc, char *argv[])
 				goto stop;
 			}
 		}
+		if (aflag) {
+			check_APNG(&check, current_chunk, cflag ? data : peek,
+			    length);
+		}
 		if (lflag) {
 			/* Simply list chunks' name */
 			printf("%.4s\n", current_chunk);
@@ -216,8 +295,14 @@ main(int argc, char *argv[])
 				} else if (0 == memcmp(current_chunk, "PLTE", 4)) {
 					info_PLTE(&plte);
 				} else if (0 == memcmp(current_chunk, "IDAT", 4)) {
-					info_IDAT(data, length, idatnum);
+					if (! uflag) {
+						info_IDAT(data, length, idatnum);
+					}
 					idatnum += 1;
+					if (zflag || uflag) {
+						inflate_IDAT(&idat, &stats,
+						    &ihdr, data, length);
+					}
 				} else if (0 == memcmp(current_chunk, "tRNS", 4)) {
 					info_tRNS(&ihdr, &plte, data, length);
 				} else if (0 == memcmp(current_chunk, "cHRM", 4)) {
@@ -236,6 +321,8 @@ main(int argc, char *argv[])
 					info_tEXt(data, length);
 				} else if (0 == memcmp(current_chunk, "zTXt", 4)) {
 					info_zTXt(data, length);
+				} else if (0 == memcmp(current_chunk, "iTXt", 4)) {
+					info_iTXt(data, length);
 				} else if (0 == memcmp(current_chunk, "bKGD", 4)) {
 					info_bKGD(&ihdr, &plte, data, length);
 				} else if (0 == memcmp(current_chunk, "hIST", 4)) {
@@ -294,8 +381,21 @@ stop:
 			loopexit = true;
 		}
 	} while(! loopexit);
+	if (NULL != idat) {
+		if (! info_IDAT_stats(idat, &stats)) {
+			rc = EXIT_FAILURE;
+		}
+		lgpng_idat_free(idat);
+	}
+	/* Includes the stream that could not even be started */
+	if (stats.failed) {
+		rc = EXIT_FAILURE;
+	}
+	if (aflag) {
+		info_APNG_check(&check);
+	}
 	fclose(source);
-	return(EXIT_SUCCESS);
+	return(rc);
 }
 
 void
@@ -438,6 +538,174 @@ info_IDAT(uint8_t *data, uint32_t dataz, int idatnum)
 	}
 }
 
+enum lgpng_err
+count_IDAT_row(void *arg, uint32_t y, uint8_t *row, size_t rowz)
+{
+	struct idat_stats	*stats = arg;
+
+	(void)y;
+	if (row[0] < FILTER_TYPE__MAX) {
+		stats->filters[row[0]] += 1;
+	} else {
+		stats->filters[FILTER_TYPE__MAX] += 1;
+	}
+	stats->rows += 1;
+	stats->rawz += rowz;
+	return(LGPNG_OK);
+}
+
+/*
+ * Inflate the image data one scanline at a time, only looking at the
+ * filter type of each row: nothing but the zlib window and two rows is
+ * kept around. With -u not even the rows are looked at, the bytes are
+ * only counted.
+ */
+void
+inflate_IDAT(struct lgpng_idat **idat, struct idat_stats *stats,
+    struct IHDR *ihdr, uint8_t *data, uint32_t dataz)
+{
+	enum lgpng_err	 zerr;
+	uint32_t	 computed, stored;
+	clock_t		 start;
+
+	if (stats->failed) {
+		return;
+	}
+	if (NULL == *idat) {
+		if (stats->count) {
+			zerr = lgpng_idat_new_count(ihdr, &budget, idat);
+		} else {
+			zerr = lgpng_idat_new_rows(ihdr, &budget, count_IDAT_row,
+			    stats, idat);
+		}
+		if (LGPNG_OK != zerr) {
+			if (LGPNG_BUDGET_EXCEEDED == zerr) {
+				warnx("IDAT: decompression budget exceeded");
+			} else if (LGPNG_NOMEM == zerr) {
+				warn("lgpng_idat_new");
+			}
+			warnx("IDAT: Failed decompression");
+			stats->failed = true;
+			return;
+		}
+		(void)lgpng_IHDR_raw_size(ihdr, &stats->expectedz);
+	}
+	stats->compressedz += dataz;
+	start = clock();
+	zerr = lgpng_idat_feed(*idat, data, dataz);
+	stats->ticks += clock() - start;
+	if (LGPNG_OK != zerr) {
+		if (LGPNG_BUDGET_EXCEEDED == zerr) {
+			warnx("IDAT: decompression budget exceeded");
+		} else if (LGPNG_TOO_LONG == zerr) {
+			warnx("IDAT: more image data than announced by IHDR");
+		} else if (LGPNG_ZLIB_ERROR == zerr
+		    && LGPNG_OK == lgpng_idat_adler32(*idat, &computed, &stored)) {
+			warnx("IDAT: Adler-32 mismatch, computed %08x, stored "
+			    "%08x", computed, stored);
+		} else if (LGPNG_ZLIB_ERROR == zerr) {
+			warnx("Invalid input data");
+		}
+		warnx("IDAT: Failed decompression");
+		stats->failed = true;
+	}
+}
+
+/*
+ * Print what was learnt while inflating the image data. Return false if
+ * the zlib stream is broken: truncated, overlong or with a bad Adler-32.
+ */
+bool
+info_IDAT_stats(struct lgpng_idat *idat, struct idat_stats *stats)
+{
+	double		 seconds;
+	size_t		 outz = 0;
+	uint32_t	 computed, stored;
+	enum lgpng_err	 zerr;
+
+	zerr = lgpng_idat_finish(idat, NULL, &outz);
+	if (stats->count) {
+		stats->rawz = outz;
+	}
+	if (LGPNG_TOO_LONG == zerr) {
+		warnx("IDAT: image data longer than announced by IHDR, %ju "
+		    "extra bytes", (uintmax_t)(stats->rawz - stats->expectedz));
+	} else if (LGPNG_OK != zerr && stats->count
+	    && stats->rawz < stats->expectedz) {
+		warnx("IDAT: image data shorter than announced by IHDR, %ju "
+		    "missing bytes", (uintmax_t)(stats->expectedz - stats->rawz));
+	} else if (LGPNG_OK != zerr && stats->count && ! stats->failed) {
+		warnx("IDAT: truncated zlib stream");
+	} else if (LGPNG_OK != zerr && ! stats->failed) {
+		warnx("IDAT: image data shorter than announced by IHDR");
+	}
+	if (! stats->count) {
+		printf("IDAT: rows %ju\n", (uintmax_t)stats->rows);
+	}
+	if (LGPNG_OK == lgpng_idat_adler32(idat, &computed, &stored)) {
+		printf("IDAT: Adler-32 %08x %s\n", computed,
+		    computed == stored ? "(valid)" : "(invalid)");
+	}
+	for (int i = 0; ! stats->count && i < FILTER_TYPE__MAX; i++) {
+		printf("IDAT: filter %s: %ju rows (%.1f%%)\n",
+		    filtertypemap[i], (uintmax_t)stats->filters[i],
+		    0 == stats->rows ? 0.0
+		    : 100.0 * (double)stats->filters[i] / (double)stats->rows);
+	}
+	if (0 != stats->filters[FILTER_TYPE__MAX]) {
+		warnx("IDAT: %ju rows with an invalid filter type",
+		    (uintmax_t)stats->filters[FILTER_TYPE__MAX]);
+	}
+	printf("IDAT: total compressed bytes %ju\n",
+	    (uintmax_t)stats->compressedz);
+	printf("IDAT: total inflated bytes %ju\n", (uintmax_t)stats->rawz);
+	if (stats->count) {
+		printf("IDAT: expected inflated bytes %zu\n", stats->expectedz);
+	}
+	if (0 != stats->compressedz) {
+		printf("IDAT: compression ratio %.2f\n",
+		    (double)stats->rawz / (double)stats->compressedz);
+	}
+	seconds = (double)stats->ticks / CLOCKS_PER_SEC;
+	if (seconds > 0) {
+		printf("IDAT: inflate throughput %.1f MiB/s\n",
+		    (double)stats->rawz / seconds / (1024 * 1024));
+	}
+	return(LGPNG_OK == zerr && ! stats->failed);
+}
+
+/*
+ * Check the structure of an animated image as the chunks go by, reading
+ * no more than the first LGPNG_APNG_CHECKZ bytes of each.
+ */
+void
+check_APNG(struct lgpng_apng_check *check, uint8_t type[4], uint8_t *data,
+    uint32_t length)
+{
+	const char	*errstr;
+
+	if (LGPNG_OK != lgpng_apng_check_chunk(check, type, data, length,
+	    &errstr) && NULL != errstr) {
+		warnx("APNG: %.4s: %s", type, errstr);
+	}
+}
+
+void
+info_APNG_check(struct lgpng_apng_check *check)
+{
+	const char	*errstr;
+
+	if (LGPNG_OK != lgpng_apng_check_finish(check, &errstr)) {
+		warnx("APNG: %s", errstr);
+	}
+	if (check->hasactl) {
+		printf("APNG: frames %u, %u announced by acTL\n",
+		    check->frames, check->num_frames);
+	} else {
+		printf("APNG: not animated\n");
+	}
+}
+
 void
 info_tRNS(struct IHDR *ihdr, struct PLTE *plte, uint8_t *data, uint32_t dataz)
 {
@@ -517,6 +785,10 @@ void
 info_iCCP(uint8_t *data, uint32_t dataz)
 {
 	struct iCCP		 iccp;
+	struct icc		*icc;
+	struct icc_tag		 tag;
+	enum lgpng_err		 err;
+	uint32_t		 descz;
 
 	if (-1 == lgpng_create_iCCP_from_data(&iccp, data, dataz)) {
 		warnx("Bad iCCP chunk, skipping.");
@@ -525,6 +797,41 @@ info_iCCP(uint8_t *data, uint32_t dataz)
 	printf("iCCP: profile name: %.80s\n", iccp.data.name);
 	info_compression_method(iccp.data.compression, (uint8_t *)"iCCP");
 	info_zlib(iccp.data.profile[0], iccp.data.profile[1], (uint8_t *)"iCCP");
+	printf("iCCP: hash: %016llx\n", (unsigned long long)
+	    lgpng_icc_hash(iccp.data.profile, iccp.data.profilez));
+	err = lgpng_icc_get(&iccp, &budget, &icc);
+	if (LGPNG_BUDGET_EXCEEDED == err) {
+		warnx("iCCP: decompression budget exceeded");
+		return;
+	} else if (LGPNG_OK != err) {
+		warnx("iCCP: invalid profile");
+		return;
+	}
+	printf("iCCP: profile size: %u\n", icc->size);
+	printf("iCCP: version: %u.%u\n", icc->major, icc->minor);
+	printf("iCCP: device class: %.4s\n", icc->devclass);
+	printf("iCCP: colour space: %.4s\n", icc->colourspace);
+	printf("iCCP: connection space: %.4s\n", icc->pcs);
+	if (icc->intent < RENDERING_INTENT__MAX) {
+		printf("iCCP: rendering intent: %s\n",
+		    rendering_intentmap[icc->intent]);
+	} else {
+		printf("iCCP: rendering intent: invalid (%u)\n", icc->intent);
+	}
+	printf("iCCP: tags: %u\n", icc->tagcount);
+	if (LGPNG_OK != lgpng_icc_find_tag(icc, "desc", &tag)) {
+		return;
+	}
+	/* ICC v2 textDescriptionType: ASCII count then string */
+	if (tag.size >= 12 && 0 == memcmp(tag.data, "desc", 4)) {
+		descz = (uint32_t)tag.data[8] << 24 | (uint32_t)tag.data[9] << 16
+		    | (uint32_t)tag.data[10] << 8 | tag.data[11];
+		if (descz > tag.size - 12) {
+			descz = tag.size - 12;
+		}
+		printf("iCCP: description: %.*s\n",
+		    (int)strnlen((char *)tag.data + 12, descz), tag.data + 12);
+	}
 }
 
 void
@@ -611,11 +918,10 @@ info_tEXt(uint8_t *data, uint32_t dataz)
 void
 info_zTXt(uint8_t *data, uint32_t dataz)
 {
-	unsigned int	 retry = 2;
-	int		 zret;
-	size_t		 outz, outtmpz;
+	enum lgpng_err	 zerr;
+	size_t		 outz;
 	struct zTXt	 ztxt;
-	uint8_t		*out = NULL, *outtmp = NULL;
+	uint8_t		*out = NULL;
 
 	if (-1 == lgpng_create_zTXt_from_data(&ztxt, data, dataz)) {
 		warnx("Bad zTXt chunk, skipping.");
@@ -628,36 +934,64 @@ info_zTXt(uint8_t *data, uint32_t dataz)
 	}
 	info_compression_method(ztxt.data.compression, (uint8_t *)"zTXt");
 	info_zlib(ztxt.data.text[0], ztxt.data.text[1], (uint8_t *)"zTXt");
-	do {
-		outtmpz = ztxt.data.textz * retry;
-		if (NULL == (outtmp = realloc(out, outtmpz + 1))) {
-			warn("realloc(outtmpz + 1)");
-			goto error;
-		}
-		out = outtmp;
-		outz = outtmpz;
-		zret = uncompress(out, &outz, ztxt.data.text, ztxt.data.textz);
-		if (Z_BUF_ERROR != zret && Z_OK != zret) {
-			if (Z_MEM_ERROR == zret) {
-				warn("uncompress(ztxt.data.textz)");
-			} else if (Z_DATA_ERROR == zret) {
-				warnx("Invalid input data");
-			}
-			warnx("zTXt: Failed decompression");
-			goto error;
+	zerr = lgpng_inflate_chunk_alloc(ztxt.data.text, ztxt.data.textz,
+	    &budget, &out, &outz);
+	if (LGPNG_OK != zerr) {
+		if (LGPNG_BUDGET_EXCEEDED == zerr) {
+			warnx("zTXt: decompression budget exceeded");
+		} else if (LGPNG_NOMEM == zerr) {
+			warn("lgpng_inflate_chunk_alloc(ztxt.data.textz)");
+		} else if (LGPNG_ZLIB_ERROR == zerr) {
+			warnx("Invalid input data");
 		}
-		out[outz] = '\0';
-		retry += 1;
-	} while (Z_OK != zret);
+		warnx("zTXt: Failed decompression");
+		return;
+	}
 	if (outz > ztxt.data.textz) {
 		printf("zTXt: compressed data is bigger than uncompressed\n");
 	}
 	printf("zTXt: keyword: %s\n", ztxt.data.keyword);
 	printf("zTXt: text: %s\n", out);
-error:
 	free(out);
-	out = NULL;
-	outz = 0;
+}
+
+void
+info_iTXt(uint8_t *data, uint32_t dataz)
+{
+	enum lgpng_err	 zerr;
+	size_t		 textz;
+	struct iTXt	 itxt;
+	uint8_t		*text;
+
+	if (-1 == lgpng_create_iTXt_from_data(&itxt, data, dataz)) {
+		warnx("Bad iTXt chunk, skipping.");
+		return;
+	}
+	if (!lgpng_is_official_keyword(itxt.data.keyword,
+	    itxt.data.keywordz)) {
+		printf("iTXt: %s is not an official keyword\n",
+		    itxt.data.keyword);
+	}
+	printf("iTXt: keyword: %s\n", itxt.data.keyword);
+	printf("iTXt: compressed: %s\n", itxt.data.compressed ? "yes" : "no");
+	if (itxt.data.compressed) {
+		info_compression_method(itxt.data.compression,
+		    (uint8_t *)"iTXt");
+	}
+	printf("iTXt: language tag: %.*s\n", (int)itxt.data.languagez,
+	    itxt.data.language);
+	printf("iTXt: translated keyword: %.*s\n",
+	    (int)itxt.data.translatedz, itxt.data.translated);
+	zerr = lgpng_iTXt_get_text(&itxt, &budget, &text, &textz);
+	if (LGPNG_BUDGET_EXCEEDED == zerr) {
+		warnx("iTXt: decompression budget exceeded");
+		return;
+	} else if (LGPNG_OK != zerr) {
+		warnx("iTXt: Failed decompression");
+		return;
+	}
+	printf("iTXt: text: %.*s\n", (int)textz, text);
+	lgpng_iTXt_free(&itxt);
 }
 
 void
@@ -769,17 +1103,61 @@ info_sPLT(uint8_t *data, uint32_t dataz)
 void
 info_eXIf(uint8_t *data, uint32_t dataz)
 {
-	struct eXIf exif;
-	uint8_t little_endian[4] = { 73, 73, 42, 0};
-	uint8_t big_endian[4] = { 77, 77, 0, 42};
+	struct eXIf		 exif;
+	struct exif		 tiff;
+	struct exif_entry	*e;
+	uint32_t		 value, num, den;
 
 	lgpng_create_eXIf_from_data(&exif, data, dataz);
-	if (0 == memcmp(exif.data.profile, little_endian, 4)) {
-		printf("eXIf: endianese: little-endian\n");
-	} else if (0 == memcmp(exif.data.profile, big_endian, 4)) {
-		printf("eXIf: endianese: big-endian\n");
-	} else {
-		printf("eXIf: endianese: weird\n");
+	if (LGPNG_OK != lgpng_exif_parse(&tiff, exif.data.profile, dataz)) {
+		if (dataz < 4) {
+			printf("eXIf: endianese: weird\n");
+		} else if (0 == memcmp(exif.data.profile, "II*\0", 4)) {
+			printf("eXIf: endianese: little-endian\n");
+		} else if (0 == memcmp(exif.data.profile, "MM\0*", 4)) {
+			printf("eXIf: endianese: big-endian\n");
+		} else {
+			printf("eXIf: endianese: weird\n");
+		}
+		warnx("eXIf: invalid TIFF structure");
+		return;
+	}
+	printf("eXIf: endianese: %s\n",
+	    tiff.bigendian ? "big-endian" : "little-endian");
+	printf("eXIf: %zu IFD, %zu entries\n", tiff.ifds, tiff.entries);
+	for (int i = 0; i < EXIF_TAG__MAX; i++) {
+		if (NULL == (e = lgpng_exif_get(&tiff, i))) {
+			continue;
+		}
+		printf("eXIf: %s: ", exif_tagmap[i]);
+		switch (e->type) {
+		case EXIF_TYPE_ASCII:
+			printf("%.*s", (int)strnlen((char *)e->value, e->count),
+			    e->value);
+			break;
+		case EXIF_TYPE_BYTE:
+		case EXIF_TYPE_SHORT:
+		case EXIF_TYPE_LONG:
+			for (uint32_t j = 0; j < e->count && j < 8; j++) {
+				(void)lgpng_exif_get_integer(&tiff, i, j, &value);
+				printf("%s%u", j ? " " : "", value);
+			}
+			if (EXIF_TAG_ORIENTATION == i && 1 == e->count
+			    && value < ORIENTATION__MAX) {
+				printf(" (%s)", orientationmap[value]);
+			}
+			break;
+		case EXIF_TYPE_RATIONAL:
+			for (uint32_t j = 0; j < e->count && j < 8; j++) {
+				(void)lgpng_exif_get_rational(&tiff, i, j, &num, &den);
+				printf("%s%u/%u", j ? " " : "", num, den);
+			}
+			break;
+		default:
+			printf("%u bytes", e->count);
+			break;
+		}
+		printf("\n");
 	}
 }
 
@@ -1090,7 +1468,8 @@ info_unknown(uint8_t name[4], uint8_t *data, uint32_t dataz)
 void
 usage(void)
 {
-	fprintf(stderr, "usage: %s [-l] [-c chunk] [-f file]\n", getprogname());
+	fprintf(stderr, "usage: %s [-alsuz] [-c chunk] [-f file] [-m bytes] "
+	    "[-t msec]\n", getprogname());
 	exit(EXIT_FAILURE);
 }
 
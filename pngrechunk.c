@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lgpng.h"
+
+#define COPYZ	(64 * 1024)
+
+void	usage(void);
+
+/* The pending IDAT chunk, written once full or at the end of the run */
+struct pending {
+	uint8_t		*data;
+	uint32_t	 dataz;
+	uint32_t	 target;
+	uint32_t	 crc;
+	size_t		 written;
+};
+
+static void
+pending_flush(struct pending *p)
+{
+	if (0 == p->dataz) {
+		return;
+	}
+	if (LGPNG_OK != lgpng_stream_write_chunk(stdout, p->dataz,
+	    (uint8_t *)"IDAT", p->data, lgpng_crc_finalize(p->crc))) {
+		err(EXIT_FAILURE, "stdout");
+	}
+	p->written++;
+	p->dataz = 0;
+	p->crc = lgpng_crc_update(lgpng_crc_init(), (uint8_t *)"IDAT", 4);
+}
+
+/*
+ * Move the body of an IDAT chunk into the pending one, which is written
+ * every time it reaches the target size. The CRC of both the input and
+ * the output chunks are computed on the way. An invalid input CRC is
+ * only known at the end of the chunk, after part of it may have been
+ * written: the output is then invalid and the exit status says so.
+ */
+static void
+rechunk_idat(FILE *src, struct pending *p, uint32_t length)
+{
+	uint32_t	 crc, incrc, n;
+
+	incrc = lgpng_crc_update(lgpng_crc_init(), (uint8_t *)"IDAT", 4);
+	while (0 != length) {
+		n = p->target - p->dataz;
+		n = n < length ? n : length;
+		if (n != fread(p->data + p->dataz, 1, n, src)) {
+			errx(EXIT_FAILURE, "IDAT: truncated chunk");
+		}
+		incrc = lgpng_crc_update(incrc, p->data + p->dataz, n);
+		p->crc = lgpng_crc_update(p->crc, p->data + p->dataz, n);
+		p->dataz += n;
+		length -= n;
+		if (p->dataz == p->target) {
+			pending_flush(p);
+		}
+	}
+	if (LGPNG_OK != lgpng_stream_get_crc(src, &crc)) {
+		errx(EXIT_FAILURE, "IDAT: truncated chunk");
+	}
+	if (crc != lgpng_crc_finalize(incrc)) {
+		errx(EXIT_FAILURE, "IDAT: invalid CRC");
+	}
+}
+
+/* Copy a chunk body and its CRC as they are, through a fixed buffer */
+static void
+copy_chunk(FILE *src, uint8_t *buf, uint32_t length, uint8_t type[4])
+{
+	size_t	 n;
+
+	if (LGPNG_OK != lgpng_stream_write_integer(stdout, length)
+	    || 4 != fwrite(type, 1, 4, stdout)) {
+		err(EXIT_FAILURE, "stdout");
+	}
+	/* Four more bytes for the CRC */
+	for (size_t left = (size_t)length + 4; 0 != left; left -= n) {
+		n = left < COPYZ ? left : COPYZ;
+		if (n != fread(buf, 1, n, src)) {
+			errx(EXIT_FAILURE, "%.4s: truncated chunk", type);
+		}
+		if (n != fwrite(buf, 1, n, stdout)) {
+			err(EXIT_FAILURE, "stdout");
+		}
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	bool		 vflag = false;
+	int		 ch, rc = EXIT_SUCCESS;
+	size_t		 idats = 0;
+	uint32_t	 length;
+	uint8_t		 type[4];
+	uint8_t		*buf;
+	enum lgpng_err	 lerr;
+	const char	*errstr;
+	struct pending	 p;
+	FILE		*source = stdin;
+
+#if HAVE_PLEDGE
+	pledge("stdio rpath", NULL);
+#endif
+	(void)memset(&p, 0, sizeof(p));
+	p.target = 1024 * 1024;
+	while (-1 != (ch = getopt(argc, argv, "f:vz:")))
+		switch (ch) {
+		case 'f':
+			if (NULL == (source = fopen(optarg, "r"))) {
+				err(EXIT_FAILURE, "%s", optarg);
+			}
+			break;
+		case 'v':
+			vflag = true;
+			break;
+		case 'z':
+			p.target = (uint32_t)strtonum(optarg, 1, INT32_MAX,
+			    &errstr);
+			if (NULL != errstr) {
+				errx(EXIT_FAILURE, "size is %s: %s", errstr,
+				    optarg);
+			}
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	argv += optind;
+
+	if (NULL == (p.data = malloc(p.target))
+	    || NULL == (buf = malloc(COPYZ))) {
+		err(EXIT_FAILURE, "malloc");
+	}
+	p.crc = lgpng_crc_update(lgpng_crc_init(), (uint8_t *)"IDAT", 4);
+	if (LGPNG_OK != lgpng_stream_is_png(source)) {
+		errx(EXIT_FAILURE, "not a PNG file");
+	}
+	(void)lgpng_stream_write_sig(stdout);
+	for (;;) {
+		lerr = lgpng_stream_get_length(source, &length);
+		if (LGPNG_TOO_SHORT == lerr) {
+			/* Still write what was read, it may help */
+			warnx("missing IEND");
+			rc = EXIT_FAILURE;
+			break;
+		} else if (LGPNG_OK != lerr) {
+			errx(EXIT_FAILURE, "invalid chunk length");
+		}
+		if (LGPNG_OK != lgpng_stream_get_type(source, type)) {
+			errx(EXIT_FAILURE, "invalid chunk type");
+		}
+		if (0 == memcmp(type, "IDAT", 4)) {
+			rechunk_idat(source, &p, length);
+			idats++;
+			continue;
+		}
+		/* The IDAT run is over */
+		pending_flush(&p);
+		copy_chunk(source, buf, length, type);
+		if (0 == memcmp(type, "IEND", 4)) {
+			break;
+		}
+	}
+	pending_flush(&p);
+	if (0 != fflush(stdout)) {
+		err(EXIT_FAILURE, "stdout");
+	}
+	if (vflag) {
+		fprintf(stderr, "IDAT: %zu chunks, was %zu\n", p.written, idats);
+	}
+	(void)fclose(source);
+	free(p.data);
+	free(buf);
+	return(rc);
+}
+
+void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-v] [-f file] [-z size]\n", getprogname());
+	exit(EXIT_FAILURE);
+}
@@ -0,0 +1,619 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "lgpng.h"
+
+#define CHUNKZ		(1024 * 1024)	/* IDAT data per written chunk */
+#define SLICEZ		(64 * 1024)	/* Input between two abort checks */
+#define SAMPLEZ		(64 * 1024)	/* Filtered bytes per sample stripe */
+#define STRIPES		4
+#define SLACK		5	/* Percents a sample may lose and survive */
+
+/*
+ * Ways to filter the image: as found in the file, one of the five
+ * filters everywhere, or chosen row by row by a heuristic.
+ */
+enum filtering {
+	FILTERING_KEEP,
+	FILTERING_NONE,
+	FILTERING_SUB,
+	FILTERING_UP,
+	FILTERING_AVERAGE,
+	FILTERING_PAETH,
+	FILTERING_MINSUM,
+	FILTERING_ENTROPY,
+	FILTERING__MAX,
+};
+
+const char *filteringmap[FILTERING__MAX] = {
+	"keep",
+	"none",
+	"sub",
+	"up",
+	"average",
+	"paeth",
+	"minsum",
+	"entropy",
+};
+
+const struct {
+	int		 strategy;
+	const char	*name;
+} strategies[] = {
+	{ Z_DEFAULT_STRATEGY,	"default" },
+	{ Z_FILTERED,		"filtered" },
+	{ Z_RLE,		"rle" },
+	{ Z_HUFFMAN_ONLY,	"huffman" },
+};
+
+/* A chunk as read, written back byte for byte */
+struct kept {
+	uint32_t	 length;
+	uint8_t		 type[4];
+	uint8_t		*data;
+	uint32_t	 crc;
+};
+
+/* One scanline of the inflated image, Adam7 passes included */
+struct row {
+	size_t		 offset;	/* Of the filter type byte */
+	size_t		 rowz;
+	bool		 first;		/* Of its pass */
+};
+
+struct trial {
+	enum filtering	 filtering;
+	size_t		 strategy;
+	int		 level;
+	int		 window;
+	size_t		 samplez;
+	size_t		 z;
+	bool		 rejected;
+};
+
+struct pool {
+	pthread_mutex_t	 lock;
+	struct trial	*trials;
+	size_t		 trialz;
+	size_t		 next;
+	enum filtering	 filtering;	/* Only these trials run, unless sampling */
+	bool		 sampling;
+	uint8_t		*in[FILTERING__MAX];
+	size_t		 inz;
+	size_t		 best;		/* Smallest complete result so far */
+	uint8_t		*bestz;
+};
+
+void	usage(void);
+
+/*
+ * Deflate in with the parameters of trial, giving up as soon as the
+ * output grows past limit. Returns the output size or SIZE_MAX.
+ */
+static size_t
+trial_deflate(struct pool *pool, struct trial *trial, uint8_t *in,
+    size_t inz, uint8_t **out)
+{
+	size_t		 boundz, z = SIZE_MAX, limit;
+	z_stream	 strm;
+
+	*out = NULL;
+	(void)memset(&strm, 0, sizeof(strm));
+	if (Z_OK != deflateInit2(&strm, trial->level, Z_DEFLATED,
+	    trial->window, 9, strategies[trial->strategy].strategy)) {
+		return(SIZE_MAX);
+	}
+	boundz = deflateBound(&strm, (uLong)inz);
+	if (NULL == (*out = malloc(boundz))) {
+		(void)deflateEnd(&strm);
+		return(SIZE_MAX);
+	}
+	strm.next_out = *out;
+	strm.avail_out = (uInt)boundz;
+	for (size_t i = 0; i < inz; i += SLICEZ) {
+		strm.next_in = in + i;
+		strm.avail_in = (uInt)(inz - i < SLICEZ ? inz - i : SLICEZ);
+		if (Z_STREAM_ERROR == deflate(&strm,
+		    inz - i <= SLICEZ ? Z_FINISH : Z_NO_FLUSH)) {
+			goto out;
+		}
+		if (! pool->sampling) {
+			(void)pthread_mutex_lock(&(pool->lock));
+			limit = pool->best;
+			(void)pthread_mutex_unlock(&(pool->lock));
+			if (strm.total_out >= limit) {
+				goto out;
+			}
+		}
+	}
+	z = strm.total_out;
+out:
+	(void)deflateEnd(&strm);
+	if (SIZE_MAX == z) {
+		free(*out);
+		*out = NULL;
+	}
+	return(z);
+}
+
+static void *
+pool_worker(void *arg)
+{
+	size_t		 i, z;
+	uint8_t		*out;
+	struct trial	*trial;
+	struct pool	*pool = arg;
+
+	for (;;) {
+		(void)pthread_mutex_lock(&(pool->lock));
+		while (pool->next < pool->trialz
+		    && (pool->trials[pool->next].rejected || (! pool->sampling
+		    && pool->trials[pool->next].filtering != pool->filtering))) {
+			pool->next++;
+		}
+		i = pool->next++;
+		(void)pthread_mutex_unlock(&(pool->lock));
+		if (i >= pool->trialz) {
+			break;
+		}
+		trial = &(pool->trials[i]);
+		z = trial_deflate(pool, trial, pool->in[trial->filtering],
+		    pool->inz, &out);
+		if (pool->sampling) {
+			trial->samplez = z;
+			free(out);
+			continue;
+		}
+		trial->z = z;
+		if (NULL == out) {
+			continue;
+		}
+		(void)pthread_mutex_lock(&(pool->lock));
+		if (z < pool->best) {
+			pool->best = z;
+			free(pool->bestz);
+			pool->bestz = out;
+			out = NULL;
+		}
+		(void)pthread_mutex_unlock(&(pool->lock));
+		free(out);
+	}
+	return(NULL);
+}
+
+/* Run the remaining trials on threads workers */
+static void
+pool_run(struct pool *pool, unsigned int threads)
+{
+	pthread_t	*workers;
+	unsigned int	 started = 0;
+
+	pool->next = 0;
+	if (NULL != (workers = calloc(threads, sizeof(*workers)))) {
+		for (; started < threads - 1; started++) {
+			if (0 != pthread_create(&(workers[started]), NULL,
+			    pool_worker, pool)) {
+				break;
+			}
+		}
+	}
+	(void)pool_worker(pool);
+	for (unsigned int i = 0; i < started; i++) {
+		(void)pthread_join(workers[i], NULL);
+	}
+	free(workers);
+}
+
+/*
+ * Filter the scanlines rows[r0] to rows[r1 - 1] of the unfiltered image
+ * raw into dst, with their filter type byte.
+ */
+static void
+refilter(enum filtering filtering, struct row *rows, size_t r0, size_t r1,
+    size_t bpp, uint8_t *orig, uint8_t *raw, uint8_t *dst,
+    uint8_t *cand[FILTER_TYPE__MAX])
+{
+	uint8_t		*row, *prev;
+	uint64_t	 cost[FILTER_TYPE__MAX];
+	uint8_t		 best;
+
+	for (size_t r = r0; r < r1; r++) {
+		if (FILTERING_KEEP == filtering) {
+			(void)memcpy(dst, orig + rows[r].offset,
+			    1 + rows[r].rowz);
+			dst += 1 + rows[r].rowz;
+			continue;
+		}
+		row = raw + rows[r].offset + 1;
+		prev = rows[r].first ? NULL : raw + rows[r - 1].offset + 1;
+		if (FILTERING_MINSUM != filtering
+		    && FILTERING_ENTROPY != filtering) {
+			dst[0] = (uint8_t)(filtering - FILTERING_NONE);
+			(void)lgpng_filter_row(dst[0], bpp, dst + 1, row, prev,
+			    rows[r].rowz);
+			dst += 1 + rows[r].rowz;
+			continue;
+		}
+		(void)lgpng_filter_all(bpp, row, prev, rows[r].rowz, cand, cost);
+		best = 0;
+		for (int f = 0; f < FILTER_TYPE__MAX; f++) {
+			if (FILTERING_ENTROPY == filtering) {
+				cost[f] = lgpng_filter_entropy(cand[f],
+				    rows[r].rowz);
+			}
+			if (cost[f] < cost[best]) {
+				best = (uint8_t)f;
+			}
+		}
+		dst[0] = best;
+		(void)memcpy(dst + 1, cand[best], rows[r].rowz);
+		dst += 1 + rows[r].rowz;
+	}
+}
+
+/* List every scanline of the image in file order */
+static struct row *
+list_rows(struct IHDR *ihdr, size_t *rowsz)
+{
+	int		 passes;
+	size_t		 n = 0, offset = 0;
+	uint32_t	 width, height;
+	struct row	*rows = NULL, *tmp;
+
+	passes = INTERLACE_METHOD_ADAM7 == ihdr->data.interlace ? 7 : 1;
+	for (int pass = 0; pass < passes; pass++) {
+		lgpng_IHDR_pass_size(ihdr, pass, &width, &height);
+		if (0 == width) {
+			continue;
+		}
+		if (NULL == (tmp = reallocarray(rows, n + height,
+		    sizeof(*rows)))) {
+			free(rows);
+			return(NULL);
+		}
+		rows = tmp;
+		for (uint32_t y = 0; y < height; y++, n++) {
+			rows[n].offset = offset;
+			rows[n].rowz = lgpng_IHDR_rowbytes(ihdr, width);
+			rows[n].first = 0 == y;
+			offset += 1 + rows[n].rowz;
+		}
+	}
+	*rowsz = n;
+	return(rows);
+}
+
+static void
+write_idat(uint8_t *z, size_t zz)
+{
+	uint32_t	crc, length;
+
+	for (size_t i = 0; i < zz; i += length) {
+		length = (uint32_t)(zz - i < CHUNKZ ? zz - i : CHUNKZ);
+		lgpng_chunk_crc(length, (uint8_t *)"IDAT", z + i, &crc);
+		if (LGPNG_OK != lgpng_stream_write_chunk(stdout, length,
+		    (uint8_t *)"IDAT", z + i, crc)) {
+			err(EXIT_FAILURE, "stdout");
+		}
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	bool		 vflag = false;
+	int		 ch, onelevel = 0;
+	long		 threads;
+	size_t		 chunkz = 0, idat = SIZE_MAX, zz = 0, rawz, rowsz;
+	size_t		 bpp, maxrowz = 0, minsample = SIZE_MAX, stripez;
+	uint8_t		*z = NULL, *orig, *raw, *cand[FILTER_TYPE__MAX];
+	const char	*errstr;
+	struct IHDR	 ihdr;
+	struct kept	*chunks = NULL, *tmp;
+	struct row	*rows;
+	struct pool	 pool;
+	FILE		*source = stdin;
+
+#if HAVE_PLEDGE
+	pledge("stdio rpath", NULL);
+#endif
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+	while (-1 != (ch = getopt(argc, argv, "f:j:l:v")))
+		switch (ch) {
+		case 'f':
+			if (NULL == (source = fopen(optarg, "r"))) {
+				err(EXIT_FAILURE, "%s", optarg);
+			}
+			break;
+		case 'j':
+			threads = strtonum(optarg, 1, 256, &errstr);
+			if (NULL != errstr) {
+				errx(EXIT_FAILURE, "threads is %s: %s",
+				    errstr, optarg);
+			}
+			break;
+		case 'l':
+			onelevel = (int)strtonum(optarg, 1, 9, &errstr);
+			if (NULL != errstr) {
+				errx(EXIT_FAILURE, "level is %s: %s",
+				    errstr, optarg);
+			}
+			break;
+		case 'v':
+			vflag = true;
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	argv += optind;
+	if (threads < 1) {
+		threads = 1;
+	}
+
+	if (LGPNG_OK != lgpng_stream_is_png(source)) {
+		errx(EXIT_FAILURE, "not a PNG file");
+	}
+	/* Keep every chunk as is, the IDAT data is also concatenated */
+	for (;;) {
+		struct kept	*c;
+
+		if (NULL == (tmp = reallocarray(chunks, chunkz + 1,
+		    sizeof(*chunks)))) {
+			err(EXIT_FAILURE, "reallocarray");
+		}
+		chunks = tmp;
+		c = &(chunks[chunkz]);
+		if (LGPNG_OK != lgpng_stream_get_length(source, &(c->length))
+		    || LGPNG_OK != lgpng_stream_get_type(source, c->type)) {
+			errx(EXIT_FAILURE, "truncated file");
+		}
+		if (NULL == (c->data = malloc(c->length + 1))) {
+			err(EXIT_FAILURE, "malloc");
+		}
+		if (LGPNG_OK != lgpng_stream_get_data(source, c->length,
+		    &(c->data))
+		    || LGPNG_OK != lgpng_stream_get_crc(source, &(c->crc))) {
+			errx(EXIT_FAILURE, "truncated file");
+		}
+		chunkz++;
+		if (0 == memcmp(c->type, "IHDR", 4)
+		    && -1 == lgpng_create_IHDR_from_data(&ihdr, c->data,
+		    c->length)) {
+			errx(EXIT_FAILURE, "IHDR: invalid chunk");
+		} else if (0 == memcmp(c->type, "IDAT", 4)) {
+			if (SIZE_MAX == idat) {
+				idat = chunkz - 1;
+			}
+			if (NULL == (z = realloc(z, zz + c->length + 1))) {
+				err(EXIT_FAILURE, "realloc");
+			}
+			(void)memcpy(z + zz, c->data, c->length);
+			zz += c->length;
+		} else if (0 == memcmp(c->type, "IEND", 4)) {
+			break;
+		}
+	}
+	(void)fclose(source);
+	if (SIZE_MAX == idat || 0 != memcmp(chunks[0].type, "IHDR", 4)) {
+		errx(EXIT_FAILURE, "missing IHDR or IDAT");
+	}
+	/* Trials feed zlib in one go, which counts in 32 bits */
+	if (LGPNG_OK != lgpng_IHDR_raw_size(&ihdr, &rawz) || rawz > UINT32_MAX / 2) {
+		errx(EXIT_FAILURE, "IHDR: image too big");
+	}
+	if (LGPNG_OK != lgpng_idat_inflate(&ihdr, NULL, z, zz, &orig, &rawz)) {
+		errx(EXIT_FAILURE, "IDAT: invalid image data");
+	}
+	if (NULL == (raw = malloc(rawz))) {
+		err(EXIT_FAILURE, "malloc");
+	}
+	(void)memcpy(raw, orig, rawz);
+	if (LGPNG_OK != lgpng_unfilter_image(&ihdr, raw, rawz)) {
+		errx(EXIT_FAILURE, "IDAT: invalid filter");
+	}
+	if (NULL == (rows = list_rows(&ihdr, &rowsz))) {
+		err(EXIT_FAILURE, "reallocarray");
+	}
+	bpp = ((size_t)lgpng_IHDR_bitsperpixel(&ihdr) + 7) / 8;
+	for (size_t r = 0; r < rowsz; r++) {
+		maxrowz = rows[r].rowz > maxrowz ? rows[r].rowz : maxrowz;
+	}
+	if (NULL == (cand[0] = malloc(FILTER_TYPE__MAX * maxrowz + 1))) {
+		err(EXIT_FAILURE, "malloc");
+	}
+	for (int f = 1; f < FILTER_TYPE__MAX; f++) {
+		cand[f] = cand[f - 1] + maxrowz;
+	}
+
+	/* Every combination is a trial */
+	(void)memset(&pool, 0, sizeof(pool));
+	(void)pthread_mutex_init(&(pool.lock), NULL);
+	pool.trials = calloc(FILTERING__MAX * 4 * 2 * 2, sizeof(*pool.trials));
+	if (NULL == pool.trials) {
+		err(EXIT_FAILURE, "calloc");
+	}
+	for (int f = 0; f < FILTERING__MAX; f++) {
+		for (size_t s = 0; s < sizeof(strategies) / sizeof(strategies[0]);
+		    s++) {
+			for (int l = 0; l < 2; l++) {
+				for (int w = 0; w < 2; w++) {
+					struct trial	*t;
+
+					if (0 != onelevel && 1 == l) {
+						continue;
+					}
+					t = &(pool.trials[pool.trialz++]);
+					t->filtering = (enum filtering)f;
+					t->strategy = s;
+					t->level = 0 != onelevel ? onelevel :
+					    (0 == l ? 9 : 6);
+					t->window = 0 == w ? 15 : 12;
+					t->samplez = t->z = SIZE_MAX;
+				}
+			}
+		}
+	}
+
+	/*
+	 * Sampling pre-pass: a few stripes of scanlines spread over the
+	 * image are compressed by every trial, those losing by more than
+	 * SLACK percents against the best sample are dropped.
+	 */
+	stripez = rowsz / STRIPES;
+	if (rawz > STRIPES * SAMPLEZ * 2 && 0 != stripez) {
+		size_t	 bounds[STRIPES][2], n = 0;
+
+		for (size_t s = 0; s < STRIPES; s++) {
+			size_t	bytes = 0, r = s * stripez;
+
+			bounds[s][0] = r;
+			while (r < rowsz && bytes < SAMPLEZ) {
+				bytes += 1 + rows[r++].rowz;
+			}
+			bounds[s][1] = r;
+			n += bytes;
+		}
+		for (int f = 0; f < FILTERING__MAX; f++) {
+			uint8_t	*dst;
+
+			if (NULL == (pool.in[f] = dst = malloc(n))) {
+				err(EXIT_FAILURE, "malloc");
+			}
+			for (size_t s = 0; s < STRIPES; s++) {
+				refilter((enum filtering)f, rows, bounds[s][0],
+				    bounds[s][1], bpp, orig, raw, dst, cand);
+				dst += rows[bounds[s][1] - 1].offset
+				    + 1 + rows[bounds[s][1] - 1].rowz
+				    - rows[bounds[s][0]].offset;
+			}
+		}
+		pool.inz = n;
+		pool.sampling = true;
+		pool_run(&pool, (unsigned int)threads);
+		for (size_t i = 0; i < pool.trialz; i++) {
+			if (pool.trials[i].samplez < minsample) {
+				minsample = pool.trials[i].samplez;
+			}
+		}
+		for (size_t i = 0; i < pool.trialz; i++) {
+			pool.trials[i].rejected = SIZE_MAX == minsample
+			    || pool.trials[i].samplez > minsample
+			    + minsample * SLACK / 100;
+		}
+		for (int f = 0; f < FILTERING__MAX; f++) {
+			free(pool.in[f]);
+			pool.in[f] = NULL;
+		}
+		pool.sampling = false;
+	}
+
+	/* The survivors, one filtering at a time to bound memory usage */
+	pool.best = zz;
+	pool.inz = rawz;
+	for (int f = 0; f < FILTERING__MAX; f++) {
+		bool	 wanted = false;
+
+		for (size_t i = 0; i < pool.trialz; i++) {
+			wanted = wanted || (! pool.trials[i].rejected
+			    && pool.trials[i].filtering == (enum filtering)f);
+		}
+		if (! wanted) {
+			continue;
+		}
+		if (NULL == (pool.in[f] = malloc(rawz))) {
+			err(EXIT_FAILURE, "malloc");
+		}
+		refilter((enum filtering)f, rows, 0, rowsz, bpp, orig, raw,
+		    pool.in[f], cand);
+		pool.filtering = (enum filtering)f;
+		pool_run(&pool, (unsigned int)threads);
+		free(pool.in[f]);
+		pool.in[f] = NULL;
+	}
+	if (vflag) {
+		for (size_t i = 0; i < pool.trialz; i++) {
+			struct trial	*t = &(pool.trials[i]);
+
+			fprintf(stderr, "%s filter, %s strategy, level %d, "
+			    "window %d: ", filteringmap[t->filtering],
+			    strategies[t->strategy].name, t->level, t->window);
+			if (t->rejected) {
+				fprintf(stderr, "rejected (sample %zu)\n",
+				    t->samplez);
+			} else if (SIZE_MAX == t->z) {
+				fprintf(stderr, "abandoned\n");
+			} else {
+				fprintf(stderr, "%zu\n", t->z);
+			}
+		}
+		fprintf(stderr, "IDAT: %zu bytes, was %zu\n", pool.best, zz);
+	}
+
+	/* Other chunks are written byte for byte, CRC included */
+	if (LGPNG_OK != lgpng_stream_write_sig(stdout)) {
+		err(EXIT_FAILURE, "stdout");
+	}
+	for (size_t i = 0; i < chunkz; i++) {
+		struct kept	*c = &(chunks[i]);
+
+		if (i == idat && NULL != pool.bestz) {
+			write_idat(pool.bestz, pool.best);
+		}
+		if (0 != memcmp(c->type, "IDAT", 4) || NULL == pool.bestz) {
+			if (LGPNG_OK != lgpng_stream_write_chunk(stdout,
+			    c->length, c->type, c->data, c->crc)) {
+				err(EXIT_FAILURE, "stdout");
+			}
+		}
+		free(c->data);
+	}
+	if (0 != fflush(stdout) || ferror(stdout)) {
+		err(EXIT_FAILURE, "stdout");
+	}
+	(void)pthread_mutex_destroy(&(pool.lock));
+	free(pool.bestz);
+	free(pool.trials);
+	free(cand[0]);
+	free(rows);
+	free(raw);
+	free(orig);
+	free(chunks);
+	free(z);
+	return(EXIT_SUCCESS);
+}
+
+void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-v] [-f file] [-j threads] [-l level]\n",
+	    getprogname());
+	exit(EXIT_FAILURE);
+}
@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2026 Tristan Le Guern <tleguern@bouledef.eu>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include COMPAT_ENDIAN_H
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lgpng.h"
+
+#define COPYZ	(64 * 1024)
+
+void	usage(void);
+
+/* Chunks before the image data that every frame needs to look the same */
+static const char *shared[] = {
+	"PLTE", "tRNS", "cHRM", "gAMA", "iCCP", "sBIT", "sRGB", "cICP",
+};
+
+/* Shared chunks, kept as found in the file and written in every output */
+struct header {
+	uint8_t		*data;
+	size_t		 dataz;
+	size_t		 allocz;
+};
+
+static bool
+is_shared(uint8_t type[4])
+{
+	for (size_t i = 0; i < sizeof(shared) / sizeof(shared[0]); i++) {
+		if (0 == memcmp(type, shared[i], 4)) {
+			return(true);
+		}
+	}
+	return(false);
+}
+
+/* Read a whole control chunk and check its CRC */
+static void
+read_chunk(FILE *src, uint8_t *buf, uint32_t length, uint8_t type[4])
+{
+	uint32_t	 crc;
+
+	if (length > COPYZ - 1) {
+		errx(EXIT_FAILURE, "%.4s: chunk too large", type);
+	}
+	if (LGPNG_OK != lgpng_stream_get_data(src, length, &buf)
+	    || LGPNG_OK != lgpng_stream_get_crc(src, &crc)) {
+		errx(EXIT_FAILURE, "%.4s: truncated chunk", type);
+	}
+	if (crc != lgpng_crc_finalize(lgpng_crc_update(lgpng_crc_update(
+	    lgpng_crc_init(), type, 4), buf, length))) {
+		errx(EXIT_FAILURE, "%.4s: invalid CRC", type);
+	}
+}
+
+/* Append the chunk to the shared ones as it is, after checking its CRC */
+static void
+header_add(FILE *src, struct header *h, uint32_t length, uint8_t type[4])
+{
+	size_t		 z = (size_t)length + 12;
+	uint32_t	 crc;
+	uint8_t		*p;
+
+	if (h->dataz + z > h->allocz) {
+		h->allocz = (h->dataz + z) * 2;
+		if (NULL == (h->data = realloc(h->data, h->allocz))) {
+			err(EXIT_FAILURE, "realloc");
+		}
+	}
+	p = h->data + h->dataz;
+	p[0] = (uint8_t)(length >> 24);
+	p[1] = (uint8_t)(length >> 16);
+	p[2] = (uint8_t)(length >> 8);
+	p[3] = (uint8_t)length;
+	(void)memcpy(p + 4, type, 4);
+	if ((size_t)length + 4 != fread(p + 8, 1, (size_t)length + 4, src)) {
+		errx(EXIT_FAILURE, "%.4s: truncated chunk", type);
+	}
+	(void)memcpy(&crc, p + 8 + length, 4);
+	if (be32toh(crc) != lgpng_crc_finalize(lgpng_crc_update(
+	    lgpng_crc_init(), p + 4, (size_t)length + 4))) {
+		errx(EXIT_FAILURE, "%.4s: invalid CRC", type);
+	}
+	h->dataz += z;
+}
+
+/*
+ * Start a new PNG file for the frame described by fcTL: same IHDR but
+ * for the dimensions, followed by the shared chunks.
+ */
+static FILE *
+frame_open(const char *prefix, uint32_t n, uint8_t ihdr[13],
+    struct fcTL *fctl, struct header *h)
+{
+	char		 name[PATH_MAX];
+	uint8_t		 data[13];
+	uint32_t	 crc;
+	FILE		*f;
+
+	if ((int)sizeof(name) <= snprintf(name, sizeof(name), "%s_%03u.png",
+	    prefix, n)) {
+		errx(EXIT_FAILURE, "%s: file name too long", prefix);
+	}
+	if (NULL == (f = fopen(name, "w"))) {
+		err(EXIT_FAILURE, "%s", name);
+	}
+	(void)memcpy(data, ihdr, sizeof(data));
+	data[0] = (uint8_t)(fctl->data.width >> 24);
+	data[1] = (uint8_t)(fctl->data.width >> 16);
+	data[2] = (uint8_t)(fctl->data.width >> 8);
+	data[3] = (uint8_t)fctl->data.width;
+	data[4] = (uint8_t)(fctl->data.height >> 24);
+	data[5] = (uint8_t)(fctl->data.height >> 16);
+	data[6] = (uint8_t)(fctl->data.height >> 8);
+	data[7] = (uint8_t)fctl->data.height;
+	lgpng_chunk_crc(sizeof(data), (uint8_t *)"IHDR", data, &crc);
+	if (LGPNG_OK != lgpng_stream_write_sig(f)
+	    || LGPNG_OK != lgpng_stream_write_chunk(f, sizeof(data),
+	    (uint8_t *)"IHDR", data, crc)
+	    || h->dataz != fwrite(h->data, 1, h->dataz, f)) {
+		err(EXIT_FAILURE, "%s", name);
+	}
+	return(f);
+}
+
+static void
+frame_close(FILE *f)
+{
+	if (NULL == f) {
+		return;
+	}
+	if (LGPNG_OK != lgpng_stream_write_chunk(f, 0, (uint8_t *)"IEND",
+	    NULL, 0xae426082) || 0 != fclose(f)) {
+		err(EXIT_FAILURE, "fclose");
+	}
+}
+
+/*
+ * Copy the body of an IDAT or fdAT chunk as an IDAT chunk through a fixed
+ * buffer, without the sequence number of fdAT. The CRC of the input is
+ * checked and the one of the output computed on the way.
+ */
+static void
+copy_data(FILE *src, FILE *dst, uint8_t *buf, uint32_t length,
+    uint8_t type[4])
+{
+	bool		 fdat = 0 == memcmp(type, "fdAT", 4);
+	size_t		 n;
+	uint32_t	 crc, incrc, outcrc;
+
+	incrc = lgpng_crc_update(lgpng_crc_init(), type, 4);
+	if (fdat) {
+		if (length < 4 || 4 != fread(buf, 1, 4, src)) {
+			errx(EXIT_FAILURE, "fdAT: truncated chunk");
+		}
+		incrc = lgpng_crc_update(incrc, buf, 4);
+		length -= 4;
+	}
+	outcrc = lgpng_crc_update(lgpng_crc_init(), (uint8_t *)"IDAT", 4);
+	if (LGPNG_OK != lgpng_stream_write_integer(dst, length)
+	    || 4 != fwrite("IDAT", 1, 4, dst)) {
+		err(EXIT_FAILURE, "fwrite");
+	}
+	for (; 0 != length; length -= (uint32_t)n) {
+		n = length < COPYZ ? length : COPYZ;
+		if (n != fread(buf, 1, n, src)) {
+			errx(EXIT_FAILURE, "%.4s: truncated chunk", type);
+		}
+		incrc = lgpng_crc_update(incrc, buf, n);
+		outcrc = lgpng_crc_update(outcrc, buf, n);
+		if (n != fwrite(buf, 1, n, dst)) {
+			err(EXIT_FAILURE, "fwrite");
+		}
+	}
+	if (LGPNG_OK != lgpng_stream_get_crc(src, &crc)) {
+		errx(EXIT_FAILURE, "%.4s: truncated chunk", type);
+	}
+	if (crc != lgpng_crc_finalize(incrc)) {
+		errx(EXIT_FAILURE, "%.4s: invalid CRC", type);
+	}
+	if (LGPNG_OK != lgpng_stream_write_integer(dst,
+	    lgpng_crc_finalize(outcrc))) {
+		err(EXIT_FAILURE, "fwrite");
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	bool		 vflag = false, seenihdr = false, seendata = false;
+	bool		 pending = false;
+	int		 ch, rc = EXIT_SUCCESS;
+	uint32_t	 length, frames = 0;
+	uint8_t		 type[4], ihdr[13];
+	uint8_t		*buf;
+	enum lgpng_err	 lerr;
+	const char	*prefix = "frame";
+	struct fcTL	 fctl;
+	struct header	 h;
+	FILE		*source = stdin, *output = NULL;
+
+#if HAVE_PLEDGE
+	pledge("stdio rpath wpath cpath", NULL);
+#endif
+	while (-1 != (ch = getopt(argc, argv, "f:p:v")))
+		switch (ch) {
+		case 'f':
+			if (NULL == (source = fopen(optarg, "r"))) {
+				err(EXIT_FAILURE, "%s", optarg);
+			}
+			break;
+		case 'p':
+			prefix = optarg;
+			break;
+		case 'v':
+			vflag = true;
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	argv += optind;
+
+	(void)memset(&h, 0, sizeof(h));
+	if (NULL == (buf = malloc(COPYZ))) {
+		err(EXIT_FAILURE, "malloc");
+	}
+	if (LGPNG_OK != lgpng_stream_is_png(source)) {
+		errx(EXIT_FAILURE, "not a PNG file");
+	}
+	for (;;) {
+		lerr = lgpng_stream_get_length(source, &length);
+		if (LGPNG_TOO_SHORT == lerr) {
+			warnx("missing IEND");
+			/* The last frame may be cut short, leave it broken */
+			if (NULL != output && 0 != fclose(output)) {
+				err(EXIT_FAILURE, "fclose");
+			}
+			output = NULL;
+			rc = EXIT_FAILURE;
+			break;
+		} else if (LGPNG_OK != lerr) {
+			errx(EXIT_FAILURE, "invalid chunk length");
+		}
+		if (LGPNG_OK != lgpng_stream_get_type(source, type)) {
+			errx(EXIT_FAILURE, "invalid chunk type");
+		}
+		if (0 == memcmp(type, "IHDR", 4)) {
+			if (sizeof(ihdr) != length) {
+				errx(EXIT_FAILURE, "IHDR: invalid length");
+			}
+			read_chunk(source, buf, length, type);
+			(void)memcpy(ihdr, buf, sizeof(ihdr));
+			seenihdr = true;
+		} else if (! seenihdr) {
+			errx(EXIT_FAILURE, "IHDR is not the first chunk");
+		} else if (0 == memcmp(type, "fcTL", 4)) {
+			read_chunk(source, buf, length, type);
+			if (-1 == lgpng_create_fcTL_from_data(&fctl, buf,
+			    length) || 0 == fctl.data.width
+			    || 0 == fctl.data.height) {
+				errx(EXIT_FAILURE, "fcTL: invalid chunk");
+			}
+			/* Opened with the data, after all shared chunks */
+			frame_close(output);
+			output = NULL;
+			pending = true;
+		} else if (0 == memcmp(type, "IDAT", 4)
+		    || 0 == memcmp(type, "fdAT", 4)) {
+			seendata = true;
+			if (pending) {
+				output = frame_open(prefix, frames++, ihdr,
+				    &fctl, &h);
+				pending = false;
+			}
+			if (NULL == output) {
+				/* A default image outside of the animation */
+				if (LGPNG_OK != lgpng_stream_skip_data(source,
+				    length + 4)) {
+					errx(EXIT_FAILURE,
+					    "%.4s: truncated chunk", type);
+				}
+				continue;
+			}
+			copy_data(source, output, buf, length, type);
+		} else if (! seendata && is_shared(type)) {
+			header_add(source, &h, length, type);
+		} else if (LGPNG_OK != lgpng_stream_skip_data(source,
+		    length + 4)) {
+			errx(EXIT_FAILURE, "%.4s: truncated chunk", type);
+		}
+		if (0 == memcmp(type, "IEND", 4)) {
+			break;
+		}
+	}
+	frame_close(output);
+	if (0 == frames) {
+		warnx("not an animated PNG file");
+	}
+	if (vflag) {
+		fprintf(stderr, "frames: %u\n", frames);
+	}
+	(void)fclose(source);
+	free(h.data);
+	free(buf);
+	return(0 == frames ? EXIT_FAILURE : rc);
+}
+
+void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-v] [-f file] [-p prefix]\n",
+	    getprogname());
+	exit(EXIT_FAILURE);
+}
@@ -0,0 +1,192 @@
+#include "../config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lgpng.h"
+
+static unsigned
+getpixel(uint8_t *row, uint32_t x, uint8_t bits)
+{
+	unsigned	v = 0;
+
+	if (bits < 8) {
+		return((row[x * bits / 8] >> (8 - bits - (x * bits) % 8))
+		    & ((1u << bits) - 1));
+	}
+	for (unsigned i = 0; i < bits / 8; i++) {
+		v = v * 31 + row[x * (bits / 8) + i];
+	}
+	return(v);
+}
+
+/* Naive interlacer: every pass sweeps the whole image */
+static void
+interlace(struct IHDR *ihdr, uint8_t *image, size_t stride, uint8_t *raw)
+{
+	uint8_t		 bits = lgpng_IHDR_bitsperpixel(ihdr);
+	uint32_t	 w, h;
+	size_t		 rowz;
+	const struct lgpng_adam7 *p;
+
+	for (int i = 0; i < 7; i++) {
+		p = &(lgpng_adam7[i]);
+		lgpng_IHDR_pass_size(ihdr, i, &w, &h);
+		if (0 == w) {
+			continue;
+		}
+		rowz = lgpng_IHDR_rowbytes(ihdr, w);
+		for (uint32_t y = 0; y < h; y++) {
+			uint8_t	*src = image + (size_t)(p->y + y * p->dy) * stride;
+
+			*raw++ = 0;
+			(void)memset(raw, 0, rowz);
+			for (uint32_t x = 0; x < w; x++) {
+				uint32_t	sx = p->x + x * p->dx;
+
+				if (bits >= 8) {
+					(void)memcpy(raw + x * (bits / 8),
+					    src + sx * (bits / 8), bits / 8);
+				} else {
+					raw[x * bits / 8] |= (uint8_t)(
+					    getpixel(src, sx, bits)
+					    << (8 - bits - (x * bits) % 8));
+				}
+			}
+			raw += rowz;
+		}
+	}
+}
+
+static bool
+roundtrip(uint32_t width, uint32_t height, uint8_t depth, uint8_t colour)
+{
+	bool		 ok = true;
+	size_t		 rawz, rowz, stride;
+	uint32_t	 w, h;
+	uint8_t		*image, *raw, *out, *src;
+	struct IHDR	 ihdr;
+
+	(void)memset(&ihdr, 0, sizeof(ihdr));
+	ihdr.data.width = width;
+	ihdr.data.height = height;
+	ihdr.data.bitdepth = depth;
+	ihdr.data.colourtype = colour;
+	ihdr.data.interlace = INTERLACE_METHOD_ADAM7;
+	rowz = lgpng_IHDR_rowbytes(&ihdr, width);
+	stride = rowz + 3;
+	if (LGPNG_OK != lgpng_IHDR_raw_size(&ihdr, &rawz)) {
+		return(false);
+	}
+	image = calloc(height, stride);
+	out = calloc(height, stride);
+	raw = malloc(rawz);
+	if (NULL == image || NULL == out || NULL == raw) {
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < height * stride; i++) {
+		image[i] = (uint8_t)rand();
+	}
+	interlace(&ihdr, image, stride, raw);
+	if (LGPNG_OK != lgpng_adam7_deinterlace(&ihdr, raw, rawz, out,
+	    stride)) {
+		ok = false;
+	}
+	for (uint32_t y = 0; ok && y < height; y++) {
+		for (uint32_t x = 0; ok && x < width; x++) {
+			uint8_t	bits = lgpng_IHDR_bitsperpixel(&ihdr);
+
+			if (getpixel(image + y * stride, x, bits)
+			    != getpixel(out + y * stride, x, bits)) {
+				ok = false;
+			}
+		}
+	}
+	/* Same image, rebuilt one scanline at a time */
+	(void)memset(image, 0, height * stride);
+	src = raw;
+	for (int i = 0; ok && i < 7; i++) {
+		lgpng_IHDR_pass_size(&ihdr, i, &w, &h);
+		for (uint32_t y = 0; ok && 0 != w && y < h; y++) {
+			ok = LGPNG_OK == lgpng_adam7_scatter_row(&ihdr, i, y,
+			    src + 1, image, stride);
+			src += 1 + lgpng_IHDR_rowbytes(&ihdr, w);
+		}
+	}
+	if (ok && 0 != memcmp(image, out, height * stride)) {
+		ok = false;
+	}
+	free(image);
+	free(out);
+	free(raw);
+	return(ok);
+}
+
+int
+main(void)
+{
+	int		 rc = EXIT_SUCCESS, test = 0;
+	uint8_t		 raw[64], out[64];
+	struct IHDR	 ihdr;
+	const char	*subject, *status;
+	const struct {
+		uint8_t	depth;
+		uint8_t	colour;
+	} formats[] = {
+		{ 1, COLOUR_TYPE_GREYSCALE },
+		{ 2, COLOUR_TYPE_INDEXED },
+		{ 4, COLOUR_TYPE_GREYSCALE },
+		{ 8, COLOUR_TYPE_GREYSCALE },
+		{ 8, COLOUR_TYPE_GREYSCALE_ALPHA },
+		{ 8, COLOUR_TYPE_TRUECOLOUR },
+		{ 8, COLOUR_TYPE_TRUECOLOUR_ALPHA },
+		{ 16, COLOUR_TYPE_TRUECOLOUR },
+		{ 16, COLOUR_TYPE_TRUECOLOUR_ALPHA },
+	};
+	const size_t	 formatz = sizeof(formats) / sizeof(formats[0]);
+
+	printf("lgpng_adam7 tests\n");
+	printf("TAP version 13\n");
+	printf("1..%zu\n", 1 + formatz);
+
+	srand(7);
+	subject = "%s %d - lgpng_adam7_deinterlace on a progressive image\n";
+	(void)memset(&ihdr, 0, sizeof(ihdr));
+	ihdr.data.width = 4;
+	ihdr.data.height = 4;
+	ihdr.data.bitdepth = 8;
+	if (LGPNG_INVALID_PARAM == lgpng_adam7_deinterlace(&ihdr, raw,
+	    sizeof(raw), out, 4)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	for (size_t i = 0; i < formatz; i++) {
+		bool	ok = true;
+
+		subject = "%s %d - %u bits %s\n";
+		/* Odd sizes leave some passes empty or partial */
+		for (uint32_t w = 1; ok && w < 20; w += 3) {
+			for (uint32_t h = 1; ok && h < 20; h += 4) {
+				ok = roundtrip(w, h, formats[i].depth,
+				    formats[i].colour);
+			}
+		}
+		ok = ok && roundtrip(1029, 35, formats[i].depth,
+		    formats[i].colour);
+		if (ok) {
+			status = "ok";
+		} else {
+			status = "not ok";
+			rc = EXIT_FAILURE;
+		}
+		printf(subject, status, ++test, formats[i].depth,
+		    colourtypemap[formats[i].colour]);
+	}
+	return(rc);
+}
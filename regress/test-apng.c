@@ -0,0 +1,501 @@
+#include "../config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "../lgpng.h"
+
+#define WIDTH	16
+#define HEIGHT	12
+
+/* Frames of the test animation, the first one is also the default image */
+static const struct {
+	uint32_t	width;
+	uint32_t	height;
+	uint32_t	x;
+	uint32_t	y;
+	size_t		chunks;
+} frames[] = {
+	{ WIDTH, HEIGHT, 0, 0, 2 },
+	{ 6, 5, 3, 4, 3 },
+	{ WIDTH, HEIGHT, 0, 0, 1 },
+};
+#define FRAMEZ	(sizeof(frames) / sizeof(frames[0]))
+
+struct image {
+	uint32_t	 frame;
+	uint32_t	 rows;
+	bool		 ok;
+};
+
+static uint8_t
+pixel(uint32_t frame, uint32_t x, uint32_t y, int c)
+{
+	return((uint8_t)(frame * 61 + x * 7 + y * 13 + (uint32_t)c * 29));
+}
+
+static enum lgpng_err
+check_row(void *arg, uint32_t y, uint8_t *row, size_t rowz)
+{
+	struct image	*img = arg;
+
+	if (y != img->rows++ || rowz != frames[img->frame].width * 4) {
+		img->ok = false;
+		return(LGPNG_OK);
+	}
+	for (uint32_t x = 0; x < frames[img->frame].width; x++) {
+		for (int c = 0; c < 4; c++) {
+			if (row[x * 4 + (uint32_t)c]
+			    != pixel(img->frame, x, y, c)) {
+				img->ok = false;
+			}
+		}
+	}
+	return(LGPNG_OK);
+}
+
+static void
+put32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+static void
+write_chunk(FILE *f, const char *name, uint8_t *data, size_t dataz,
+    bool corrupt)
+{
+	uint8_t		type[4];
+	uint32_t	crc;
+
+	(void)memcpy(type, name, 4);
+	lgpng_chunk_crc((uint32_t)dataz, type, data, &crc);
+	if (LGPNG_OK != lgpng_stream_write_chunk(f, (uint32_t)dataz, type,
+	    data, corrupt ? crc ^ 1 : crc)) {
+		errx(EXIT_FAILURE, "lgpng_stream_write_chunk");
+	}
+}
+
+/* The zlib stream of a frame, without filtering */
+static uint8_t *
+compress_frame(uint32_t n, size_t *zz)
+{
+	size_t		 rowz = 1 + frames[n].width * 4, rawz;
+	uLongf		 z_len;
+	uint8_t		*raw, *z;
+
+	rawz = rowz * frames[n].height;
+	if (NULL == (raw = malloc(rawz))) {
+		errx(EXIT_FAILURE, "malloc");
+	}
+	for (uint32_t y = 0; y < frames[n].height; y++) {
+		raw[y * rowz] = 0;
+		for (uint32_t x = 0; x < frames[n].width; x++) {
+			for (int c = 0; c < 4; c++) {
+				raw[y * rowz + 1 + x * 4 + (uint32_t)c] =
+				    pixel(n, x, y, c);
+			}
+		}
+	}
+	z_len = compressBound(rawz);
+	if (NULL == (z = malloc(z_len))) {
+		errx(EXIT_FAILURE, "malloc");
+	}
+	if (Z_OK != compress(z, &z_len, raw, rawz)) {
+		errx(EXIT_FAILURE, "compress");
+	}
+	free(raw);
+	*zz = z_len;
+	return(z);
+}
+
+/*
+ * Write the test animation. Without withdefault the first fcTL comes after
+ * IDAT, whose image is then not part of the animation. With corrupt the
+ * CRC of the first fdAT chunk of frame 1 is wrong.
+ */
+static FILE *
+write_apng(bool withactl, bool withdefault, bool corrupt)
+{
+	uint32_t	 seq = 0;
+	size_t		 zz, cut;
+	uint8_t		 hdr[26], chunk[4 + 1024];
+	uint8_t		*z;
+	FILE		*f;
+
+	if (NULL == (f = tmpfile())) {
+		err(EXIT_FAILURE, "tmpfile");
+	}
+	(void)lgpng_stream_write_sig(f);
+	put32(hdr, WIDTH);
+	put32(hdr + 4, HEIGHT);
+	hdr[8] = 8;
+	hdr[9] = COLOUR_TYPE_TRUECOLOUR_ALPHA;
+	hdr[10] = hdr[11] = hdr[12] = 0;
+	write_chunk(f, "IHDR", hdr, 13, false);
+	if (withactl) {
+		put32(hdr, withdefault ? FRAMEZ : FRAMEZ - 1);
+		put32(hdr + 4, 0);
+		write_chunk(f, "acTL", hdr, 8, false);
+	}
+	/* Without acTL only the default image is written */
+	for (uint32_t n = 0; n < (withactl ? FRAMEZ : 1); n++) {
+		if (withactl && (0 != n || withdefault)) {
+			put32(hdr, seq++);
+			put32(hdr + 4, frames[n].width);
+			put32(hdr + 8, frames[n].height);
+			put32(hdr + 12, frames[n].x);
+			put32(hdr + 16, frames[n].y);
+			hdr[20] = 0;
+			hdr[21] = 1;
+			hdr[22] = 0;
+			hdr[23] = 10;
+			hdr[24] = DISPOSE_OP_NONE;
+			hdr[25] = BLEND_OP_SOURCE;
+			write_chunk(f, "fcTL", hdr, 26, false);
+		}
+		z = compress_frame(n, &zz);
+		cut = zz / frames[n].chunks + 1;
+		for (size_t i = 0; i < zz; i += cut) {
+			size_t	 len = zz - i < cut ? zz - i : cut;
+
+			if (0 == n) {
+				write_chunk(f, "IDAT", z + i, len, false);
+				continue;
+			}
+			if (len > sizeof(chunk) - 4) {
+				errx(EXIT_FAILURE, "frame too large");
+			}
+			put32(chunk, seq++);
+			(void)memcpy(chunk + 4, z + i, len);
+			write_chunk(f, "fdAT", chunk, len + 4,
+			    corrupt && 1 == n && 0 == i);
+		}
+		free(z);
+	}
+	write_chunk(f, "IEND", NULL, 0, false);
+	if (0 != fflush(f)) {
+		err(EXIT_FAILURE, "fflush");
+	}
+	return(f);
+}
+
+enum mangle {
+	MANGLE_NONE,
+	MANGLE_SEQUENCE,	/* fcTL of the last frame reuses a number */
+	MANGLE_OFFSET,		/* Frame 1 goes past the right edge */
+	MANGLE_FRAMES,		/* acTL announces one frame too many */
+};
+
+/*
+ * Replay the file through the streaming validator, altering one field on
+ * the way, and return the number of problems it found.
+ */
+static int
+validate(FILE *f, enum mangle mangle, uint32_t *framesp)
+{
+	int				 errors = 0;
+	uint32_t			 length, fctls = 0;
+	uint8_t				 type[4], buf[4 + 1024 + 1];
+	uint8_t				*data = buf;
+	const char			*errstr;
+	struct lgpng_apng_check		 check;
+
+	rewind(f);
+	if (LGPNG_OK != lgpng_stream_is_png(f)) {
+		errx(EXIT_FAILURE, "lgpng_stream_is_png");
+	}
+	lgpng_apng_check_init(&check);
+	do {
+		if (LGPNG_OK != lgpng_stream_get_length(f, &length)
+		    || length >= sizeof(buf)
+		    || LGPNG_OK != lgpng_stream_get_type(f, type)
+		    || LGPNG_OK != lgpng_stream_get_data(f, length, &data)
+		    || LGPNG_OK != lgpng_stream_skip_data(f, 4)) {
+			errx(EXIT_FAILURE, "truncated test file");
+		}
+		if (0 == memcmp(type, "acTL", 4) && MANGLE_FRAMES == mangle) {
+			data[3]++;
+		} else if (0 == memcmp(type, "fcTL", 4)) {
+			fctls++;
+			if (FRAMEZ == fctls && MANGLE_SEQUENCE == mangle) {
+				data[3]--;
+			} else if (2 == fctls && MANGLE_OFFSET == mangle) {
+				put32(data + 12, WIDTH - 1);
+			}
+		}
+		if (LGPNG_OK != lgpng_apng_check_chunk(&check, type, data,
+		    length, &errstr)) {
+			errors++;
+		}
+	} while (0 != memcmp(type, "IEND", 4));
+	if (LGPNG_OK != lgpng_apng_check_finish(&check, &errstr)) {
+		errors++;
+	}
+	*framesp = check.frames;
+	return(errors);
+}
+
+/* Every frame covers its area of the canvas, they all use BLEND_OP_SOURCE */
+static enum lgpng_err
+check_canvas(void *arg, uint32_t n, const uint8_t *canvas,
+    struct lgpng_rect *dirty)
+{
+	uint32_t	*calls = arg;
+	const uint8_t	*p;
+
+	if (n != (*calls)++) {
+		return(LGPNG_ERROR);
+	}
+	if (0 == n && (0 != dirty->x || WIDTH != dirty->width
+	    || HEIGHT != dirty->height)) {
+		return(LGPNG_ERROR);
+	}
+	if (0 != n && (frames[n].x != dirty->x || frames[n].y != dirty->y
+	    || frames[n].width != dirty->width
+	    || frames[n].height != dirty->height)) {
+		return(LGPNG_ERROR);
+	}
+	for (uint32_t y = 0; y < frames[n].height; y++) {
+		for (uint32_t x = 0; x < frames[n].width; x++) {
+			p = canvas + ((frames[n].y + y) * WIDTH + frames[n].x
+			    + x) * 4;
+			for (int c = 0; c < 4; c++) {
+				if (p[c] != pixel(n, x, y, c)) {
+					return(LGPNG_ERROR);
+				}
+			}
+		}
+	}
+	return(LGPNG_OK);
+}
+
+static bool
+decode(struct lgpng_apng *apng, uint32_t n, uint32_t frame)
+{
+	struct image	 img;
+
+	img.frame = frame;
+	img.rows = 0;
+	img.ok = true;
+	if (LGPNG_OK != lgpng_apng_decode_frame(apng, n, NULL,
+	    LGPNG_FORMAT_RGBA8, check_row, &img)) {
+		return(false);
+	}
+	return(img.ok && img.rows == frames[frame].height);
+}
+
+int
+main(void)
+{
+	int			 rc = EXIT_SUCCESS, test = 0;
+	uint32_t		 nframes;
+	bool			 ok;
+	size_t			 zz, expectz;
+	uint8_t			*z, *expect;
+	const char		*subject, *status;
+	struct acTL		 actl;
+	struct fcTL		 fctl;
+	struct lgpng_apng	*apng = NULL;
+	FILE			*f;
+
+	printf("lgpng_apng tests\n");
+	printf("TAP version 13\n");
+	printf("1..15\n");
+
+	f = write_apng(true, true, false);
+	subject = "%s %d - lgpng_apng_index\n";
+	ok = LGPNG_OK == lgpng_apng_index(fileno(f), &apng);
+	ok = ok && FRAMEZ == lgpng_apng_frames(apng)
+	    && LGPNG_OK == lgpng_apng_header(apng, NULL, &actl)
+	    && FRAMEZ == actl.data.num_frames;
+	status = ok ? "ok" : "not ok";
+	if (! ok) {
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_apng_frame\n";
+	if (ok && LGPNG_OK == lgpng_apng_frame(apng, 1, &fctl)
+	    && 1 == fctl.data.sequence_number && 6 == fctl.data.width
+	    && 5 == fctl.data.height && 3 == fctl.data.x_offset
+	    && 4 == fctl.data.y_offset && 10 == fctl.data.delay_den
+	    && LGPNG_INVALID_PARAM == lgpng_apng_frame(apng, FRAMEZ, &fctl)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_apng_read_frame\n";
+	ok = ok && LGPNG_OK == lgpng_apng_read_frame(apng, 1, &z, &zz);
+	if (ok) {
+		expect = compress_frame(1, &expectz);
+		ok = zz == expectz && 0 == memcmp(z, expect, zz);
+		free(expect);
+		free(z);
+	}
+	status = ok ? "ok" : "not ok";
+	if (! ok) {
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_apng_decode_frame out of order\n";
+	if (ok && decode(apng, 2, 2) && decode(apng, 0, 0)
+	    && decode(apng, 1, 1)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_apng_compose\n";
+	nframes = 0;
+	if (ok && LGPNG_OK == lgpng_apng_compose(apng, NULL, check_canvas,
+	    &nframes) && FRAMEZ == nframes) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_apng_compose_parallel\n";
+	for (unsigned int threads = 2; ok && threads <= 8; threads *= 2) {
+		nframes = 0;
+		ok = LGPNG_OK == lgpng_apng_compose_parallel(apng, NULL,
+		    threads, check_canvas, &nframes) && FRAMEZ == nframes;
+	}
+	status = ok ? "ok" : "not ok";
+	if (! ok) {
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+	lgpng_apng_free(apng);
+	fclose(f);
+
+	subject = "%s %d - lgpng_apng_decode_frame with a bad CRC elsewhere\n";
+	f = write_apng(true, true, true);
+	ok = LGPNG_OK == lgpng_apng_index(fileno(f), &apng);
+	if (ok && decode(apng, 2, 2) && ! decode(apng, 1, 1)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_apng_compose_parallel with a bad CRC\n";
+	nframes = 0;
+	if (ok && LGPNG_OK != lgpng_apng_compose_parallel(apng, NULL, 2,
+	    check_canvas, &nframes) && 1 == nframes) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+	if (ok) {
+		lgpng_apng_free(apng);
+	}
+	fclose(f);
+
+	subject = "%s %d - lgpng_apng_index without default image\n";
+	f = write_apng(true, false, false);
+	ok = LGPNG_OK == lgpng_apng_index(fileno(f), &apng);
+	if (ok && FRAMEZ - 1 == lgpng_apng_frames(apng)
+	    && LGPNG_OK == lgpng_apng_frame(apng, 0, &fctl)
+	    && 6 == fctl.data.width && decode(apng, 0, 1)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+	if (ok) {
+		lgpng_apng_free(apng);
+	}
+	fclose(f);
+
+	subject = "%s %d - lgpng_apng_index without acTL\n";
+	f = write_apng(false, false, false);
+	ok = LGPNG_OK == lgpng_apng_index(fileno(f), &apng);
+	if (ok && 0 == lgpng_apng_frames(apng)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+	if (ok) {
+		lgpng_apng_free(apng);
+	}
+	fclose(f);
+
+	subject = "%s %d - lgpng_apng_index with a file that is not a PNG\n";
+	if (NULL == (f = tmpfile())) {
+		err(EXIT_FAILURE, "tmpfile");
+	}
+	fprintf(f, "GIF89a, not quite a PNG file\n");
+	(void)fflush(f);
+	if (LGPNG_ERROR == lgpng_apng_index(fileno(f), &apng)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+	fclose(f);
+
+	subject = "%s %d - lgpng_apng_check_chunk\n";
+	f = write_apng(true, true, false);
+	if (0 == validate(f, MANGLE_NONE, &nframes) && FRAMEZ == nframes) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_apng_check_chunk with a sequence error\n";
+	/* The fcTL and the fdAT that follows it are both out of order */
+	if (2 == validate(f, MANGLE_SEQUENCE, &nframes)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_apng_check_chunk with a frame too large\n";
+	if (1 == validate(f, MANGLE_OFFSET, &nframes)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_apng_check_finish with a missing frame\n";
+	if (1 == validate(f, MANGLE_FRAMES, &nframes) && FRAMEZ == nframes) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+	fclose(f);
+
+	return(rc);
+}
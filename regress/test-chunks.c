@@ -0,0 +1,118 @@
+#include "../config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lgpng.h"
+
+static void
+ihdr_with(struct IHDR *ihdr, uint8_t colour)
+{
+	(void)memset(ihdr, 0, sizeof(*ihdr));
+	ihdr->data.width = 1;
+	ihdr->data.height = 1;
+	ihdr->data.bitdepth = 8;
+	ihdr->data.colourtype = colour;
+}
+
+int
+main(void)
+{
+	int		 rc = EXIT_SUCCESS, test = 0;
+	uint8_t		 grey[2] = { 0x01, 0x02 };
+	uint8_t		 rgb[6] = { 0x00, 0x12, 0x00, 0x34, 0x00, 0x56 };
+	uint8_t		 alpha[3] = { 0x00, 0x80, 0xff };
+	/* Keyword, flag, method, language, translated keyword, text */
+	uint8_t		 plain[] = "Title\0\0\5en\0Titre\0Hello";
+	uint8_t		 packed[] = "Title\0\1\5en\0Titre\0Hello";
+	uint8_t		*text;
+	size_t		 textz;
+	const char	*subject, *status;
+	struct IHDR	 ihdr;
+	struct tRNS	 trns;
+	struct iTXt	 itxt;
+
+	printf("lgpng_chunks tests\n");
+	printf("TAP version 13\n");
+	printf("1..7\n");
+
+	subject = "%s %d - lgpng_create_tRNS_from_data greyscale\n";
+	ihdr_with(&ihdr, COLOUR_TYPE_GREYSCALE);
+	if (0 == lgpng_create_tRNS_from_data(&trns, &ihdr, grey, 2)
+	    && 0x0102 == trns.data.gray) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_create_tRNS_from_data truecolour\n";
+	ihdr_with(&ihdr, COLOUR_TYPE_TRUECOLOUR);
+	if (0 == lgpng_create_tRNS_from_data(&trns, &ihdr, rgb, 6)
+	    && 0x12 == trns.data.red && 0x34 == trns.data.green
+	    && 0x56 == trns.data.blue) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_create_tRNS_from_data indexed\n";
+	ihdr_with(&ihdr, COLOUR_TYPE_INDEXED);
+	if (0 == lgpng_create_tRNS_from_data(&trns, &ihdr, alpha, 3)
+	    && 3 == trns.data.entries && 0x80 == trns.data.palette[1]
+	    && 0x00 == trns.data.palette[3]) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_create_tRNS_from_data with bad length\n";
+	ihdr_with(&ihdr, COLOUR_TYPE_TRUECOLOUR);
+	if (-1 == lgpng_create_tRNS_from_data(&trns, &ihdr, rgb, 4)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_create_iTXt_from_data uncompressed\n";
+	if (0 == lgpng_create_iTXt_from_data(&itxt, plain, sizeof(plain) - 1)
+	    && 2 == itxt.data.languagez && 5 == itxt.data.translatedz
+	    && 5 == itxt.data.textz) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_iTXt_get_text uncompressed\n";
+	if (LGPNG_OK == lgpng_iTXt_get_text(&itxt, NULL, &text, &textz)
+	    && 5 == textz && 0 == memcmp(text, "Hello", 5)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+	lgpng_iTXt_free(&itxt);
+
+	subject = "%s %d - lgpng_create_iTXt_from_data with bad method\n";
+	if (-1 == lgpng_create_iTXt_from_data(&itxt, packed,
+	    sizeof(packed) - 1)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+	return(rc);
+}
@@ -0,0 +1,210 @@
+#include "../config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lgpng.h"
+
+#define PIXELS_MAX	70
+
+static uint8_t
+alpha(void)
+{
+	/* Mostly the values with a fast path */
+	switch (rand() % 4) {
+	case 0:
+		return(0);
+	case 1:
+		return(255);
+	default:
+		return((uint8_t)rand());
+	}
+}
+
+/*
+ * Compare the selected kernel against the scalar reference for every
+ * length up to 70 pixels, over an opaque or a translucent canvas.
+ */
+static bool
+differential(bool opaque)
+{
+	uint8_t	 src[PIXELS_MAX * 4], fast[PIXELS_MAX * 4];
+	uint8_t	 slow[PIXELS_MAX * 4];
+
+	for (size_t n = 0; n <= PIXELS_MAX; n++) {
+		for (size_t i = 0; i < n * 4; i++) {
+			src[i] = 3 == i % 4 ? alpha() : (uint8_t)rand();
+			fast[i] = slow[i] = 3 == i % 4 && opaque ? 255 :
+			    (uint8_t)rand();
+		}
+		lgpng_compose_over(fast, src, n);
+		lgpng_compose_over_scalar(slow, src, n);
+		if (0 != memcmp(fast, slow, n * 4)) {
+			return(false);
+		}
+	}
+	return(true);
+}
+
+/* Compose a frame of a single colour */
+static bool
+frame(struct lgpng_compose *c, uint32_t x, uint32_t y, uint32_t w,
+    uint32_t h, uint8_t dispose, uint8_t blend, const uint8_t rgba[4])
+{
+	uint8_t		 row[4 * 4];
+	struct fcTL	 fctl;
+
+	(void)memset(&fctl, 0, sizeof(fctl));
+	fctl.data.x_offset = x;
+	fctl.data.y_offset = y;
+	fctl.data.width = w;
+	fctl.data.height = h;
+	fctl.data.dispose_op = dispose;
+	fctl.data.blend_op = blend;
+	if (LGPNG_OK != lgpng_compose_begin(c, &fctl)) {
+		return(false);
+	}
+	for (uint32_t i = 0; i < w; i++) {
+		(void)memcpy(row + i * 4, rgba, 4);
+	}
+	for (uint32_t i = 0; i < h; i++) {
+		if (LGPNG_OK != lgpng_compose_row(c, i, row, w * 4)) {
+			return(false);
+		}
+	}
+	return(true);
+}
+
+static bool
+pixel_is(struct lgpng_compose *c, uint32_t x, uint32_t y,
+    const uint8_t rgba[4])
+{
+	const uint8_t	*canvas;
+
+	(void)lgpng_compose_canvas(c, &canvas, NULL);
+	return(0 == memcmp(canvas + (y * 4 + x) * 4, rgba, 4));
+}
+
+static bool
+dirty_is(struct lgpng_compose *c, uint32_t x, uint32_t y, uint32_t w,
+    uint32_t h)
+{
+	const uint8_t		*canvas;
+	struct lgpng_rect	 r;
+
+	(void)lgpng_compose_canvas(c, &canvas, &r);
+	return(r.x == x && r.y == y && r.width == w && r.height == h);
+}
+
+int
+main(void)
+{
+	int			 rc = EXIT_SUCCESS, test = 0;
+	bool			 ok;
+	uint8_t			 dst[4] = { 0, 0, 200, 255 };
+	const uint8_t		 src[4] = { 200, 0, 0, 128 };
+	const uint8_t		 red[4] = { 255, 0, 0, 255 };
+	const uint8_t		 blue[4] = { 0, 0, 255, 255 };
+	const uint8_t		 green[4] = { 0, 255, 0, 255 };
+	const uint8_t		 none[4] = { 0, 0, 0, 0 };
+	const char		*subject, *status;
+	struct fcTL		 fctl;
+	struct lgpng_compose	*c;
+
+	printf("lgpng_compose tests\n");
+	printf("TAP version 13\n");
+	printf("1..7\n");
+
+	srand(42);
+	subject = "%s %d - lgpng_compose_over over an opaque canvas\n";
+	ok = differential(true);
+	status = ok ? "ok" : "not ok";
+	if (! ok) {
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_compose_over over a translucent canvas\n";
+	ok = differential(false);
+	status = ok ? "ok" : "not ok";
+	if (! ok) {
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_compose_over_scalar\n";
+	lgpng_compose_over_scalar(dst, src, 1);
+	if (100 == dst[0] && 0 == dst[1] && 99 == dst[2] && 255 == dst[3]) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	if (LGPNG_OK != lgpng_compose_new(4, 4, &c)) {
+		fprintf(stderr, "lgpng_compose_new\n");
+		return(EXIT_FAILURE);
+	}
+	subject = "%s %d - lgpng_compose_begin with a frame too large\n";
+	(void)memset(&fctl, 0, sizeof(fctl));
+	fctl.data.x_offset = 1;
+	fctl.data.width = 4;
+	fctl.data.height = 4;
+	if (LGPNG_INVALID_PARAM == lgpng_compose_begin(c, &fctl)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - dispose and blend ops\n";
+	ok = frame(c, 0, 0, 4, 4, DISPOSE_OP_NONE, BLEND_OP_SOURCE, red)
+	    && dirty_is(c, 0, 0, 4, 4) && pixel_is(c, 3, 3, red);
+	ok = ok && frame(c, 1, 1, 2, 2, DISPOSE_OP_PREVIOUS, BLEND_OP_OVER,
+	    blue) && dirty_is(c, 1, 1, 2, 2) && pixel_is(c, 2, 2, blue)
+	    && pixel_is(c, 0, 0, red);
+	/* The blue square goes away */
+	ok = ok && frame(c, 0, 0, 1, 1, DISPOSE_OP_BACKGROUND, BLEND_OP_OVER,
+	    green) && dirty_is(c, 0, 0, 3, 3) && pixel_is(c, 2, 2, red)
+	    && pixel_is(c, 0, 0, green);
+	ok = ok && frame(c, 3, 3, 1, 1, DISPOSE_OP_NONE, BLEND_OP_OVER, none)
+	    && dirty_is(c, 0, 0, 4, 4) && pixel_is(c, 0, 0, none)
+	    && pixel_is(c, 3, 3, red);
+	status = ok ? "ok" : "not ok";
+	if (! ok) {
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_compose_row outside of the frame\n";
+	if (LGPNG_INVALID_PARAM == lgpng_compose_row(c, 1, dst, 4)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+	lgpng_compose_free(c);
+
+	subject = "%s %d - DISPOSE_OP_PREVIOUS on the first frame\n";
+	if (LGPNG_OK != lgpng_compose_new(4, 4, &c)) {
+		fprintf(stderr, "lgpng_compose_new\n");
+		return(EXIT_FAILURE);
+	}
+	ok = frame(c, 0, 0, 4, 4, DISPOSE_OP_PREVIOUS, BLEND_OP_SOURCE, red)
+	    && frame(c, 0, 0, 1, 1, DISPOSE_OP_NONE, BLEND_OP_SOURCE, blue)
+	    && pixel_is(c, 0, 0, blue) && pixel_is(c, 3, 3, none)
+	    && dirty_is(c, 0, 0, 4, 4);
+	status = ok ? "ok" : "not ok";
+	if (! ok) {
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+	lgpng_compose_free(c);
+
+	return(rc);
+}
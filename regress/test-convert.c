@@ -0,0 +1,211 @@
+#include "../config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lgpng.h"
+
+#define WIDTH	77
+
+static unsigned
+sample(const uint8_t *row, size_t idx, unsigned depth)
+{
+	if (16 == depth) {
+		return((unsigned)row[2 * idx] << 8 | row[2 * idx + 1]);
+	}
+	return((row[idx * depth / 8] >> (8 - depth - (idx * depth) % 8))
+	    & ((1u << depth) - 1));
+}
+
+/* Straightforward conversion of pixel x, one channel at a time */
+static void
+reference(struct IHDR *ihdr, struct PLTE *plte, struct tRNS *trns,
+    enum lgpng_format format, const uint8_t *row, uint32_t x, uint8_t *out)
+{
+	unsigned	 depth = ihdr->data.bitdepth, max = (1u << depth) - 1;
+	unsigned	 c[4] = { 0, 0, 0, 0 }, ch, rgba[4];
+	uint16_t	 wide[4];
+
+	switch (ihdr->data.colourtype) {
+	case COLOUR_TYPE_GREYSCALE_ALPHA:
+		ch = 2;
+		break;
+	case COLOUR_TYPE_TRUECOLOUR:
+		ch = 3;
+		break;
+	case COLOUR_TYPE_TRUECOLOUR_ALPHA:
+		ch = 4;
+		break;
+	default:
+		ch = 1;
+		break;
+	}
+	for (unsigned i = 0; i < ch; i++) {
+		c[i] = sample(row, (size_t)x * ch + i, depth);
+	}
+	rgba[3] = 65535;
+	if (COLOUR_TYPE_INDEXED == ihdr->data.colourtype) {
+		rgba[0] = plte->data.entry[c[0]].red * 257u;
+		rgba[1] = plte->data.entry[c[0]].green * 257u;
+		rgba[2] = plte->data.entry[c[0]].blue * 257u;
+		if (NULL != trns && c[0] < trns->data.entries) {
+			rgba[3] = trns->data.palette[c[0]] * 257u;
+		}
+	} else if (ch < 3) {
+		rgba[0] = rgba[1] = rgba[2] = c[0] * 65535 / max;
+		if (2 == ch) {
+			rgba[3] = c[1] * 65535 / max;
+		} else if (NULL != trns && c[0] == trns->data.gray) {
+			rgba[3] = 0;
+		}
+	} else {
+		for (unsigned i = 0; i < ch; i++) {
+			rgba[i] = c[i] * 65535 / max;
+		}
+		if (3 == ch && NULL != trns && c[0] == trns->data.red
+		    && c[1] == trns->data.green && c[2] == trns->data.blue) {
+			rgba[3] = 0;
+		}
+	}
+	switch (format) {
+	case LGPNG_FORMAT_RGBA8:
+	case LGPNG_FORMAT_RGB8:
+		for (size_t i = 0; i < lgpng_convert_pixelz(format); i++) {
+			out[i] = (uint8_t)(rgba[i] >> 8);
+		}
+		break;
+	case LGPNG_FORMAT_RGBA16:
+		for (size_t i = 0; i < 4; i++) {
+			wide[i] = (uint16_t)rgba[i];
+		}
+		(void)memcpy(out, wide, sizeof(wide));
+		break;
+	default:
+		if (COLOUR_TYPE_GREYSCALE == ihdr->data.colourtype
+		    || COLOUR_TYPE_GREYSCALE_ALPHA == ihdr->data.colourtype) {
+			out[0] = (uint8_t)(rgba[0] >> 8);
+		} else {
+			out[0] = (uint8_t)(((rgba[0] * 6968 + rgba[1] * 23434
+			    + rgba[2] * 2366 + 16384) >> 15) >> 8);
+		}
+		break;
+	}
+}
+
+static bool
+check(uint8_t colour, uint8_t depth, struct PLTE *plte, struct tRNS *trns,
+    enum lgpng_format format)
+{
+	uint8_t		 row[WIDTH * 8], out[WIDTH * 8], expect[8];
+	size_t		 pz = lgpng_convert_pixelz(format);
+	struct IHDR	 ihdr;
+	struct lgpng_convert cv;
+
+	(void)memset(&ihdr, 0, sizeof(ihdr));
+	ihdr.data.width = WIDTH;
+	ihdr.data.height = 1;
+	ihdr.data.bitdepth = depth;
+	ihdr.data.colourtype = colour;
+	for (size_t i = 0; i < sizeof(row); i++) {
+		row[i] = (uint8_t)rand();
+	}
+	/* Make sure the colour key shows up */
+	if (NULL != trns && COLOUR_TYPE_TRUECOLOUR == colour && 8 == depth) {
+		(void)memcpy(row + 3 * 10, "\x12\x34\x56", 3);
+	}
+	if (LGPNG_OK != lgpng_convert_init(&cv, &ihdr, plte, trns, format)) {
+		return(false);
+	}
+	/* Both the whole row and a window in the middle of it */
+	for (uint32_t x0 = 0; x0 < 6; x0 += 5) {
+		uint32_t	n = WIDTH - 2 * x0;
+
+		lgpng_convert_row(&cv, out, row, x0, n);
+		for (uint32_t x = 0; x < n; x++) {
+			reference(&ihdr, plte, trns, format, row, x0 + x,
+			    expect);
+			if (0 != memcmp(out + x * pz, expect, pz)) {
+				return(false);
+			}
+		}
+	}
+	return(true);
+}
+
+int
+main(void)
+{
+	int		 rc = EXIT_SUCCESS, test = 0;
+	struct PLTE	 plte;
+	struct tRNS	 trns;
+	struct tRNS	*t;
+	const char	*subject, *status;
+	const struct {
+		uint8_t	colour;
+		uint8_t	depth;
+		bool	trns;
+	} formats[] = {
+		{ COLOUR_TYPE_GREYSCALE, 1, false },
+		{ COLOUR_TYPE_GREYSCALE, 2, true },
+		{ COLOUR_TYPE_GREYSCALE, 4, false },
+		{ COLOUR_TYPE_GREYSCALE, 4, true },
+		{ COLOUR_TYPE_GREYSCALE, 8, true },
+		{ COLOUR_TYPE_GREYSCALE, 16, true },
+		{ COLOUR_TYPE_INDEXED, 1, false },
+		{ COLOUR_TYPE_INDEXED, 4, true },
+		{ COLOUR_TYPE_INDEXED, 8, true },
+		{ COLOUR_TYPE_GREYSCALE_ALPHA, 8, false },
+		{ COLOUR_TYPE_GREYSCALE_ALPHA, 16, false },
+		{ COLOUR_TYPE_TRUECOLOUR, 8, false },
+		{ COLOUR_TYPE_TRUECOLOUR, 8, true },
+		{ COLOUR_TYPE_TRUECOLOUR, 16, false },
+		{ COLOUR_TYPE_TRUECOLOUR_ALPHA, 8, false },
+		{ COLOUR_TYPE_TRUECOLOUR_ALPHA, 16, false },
+	};
+	const size_t	 formatz = sizeof(formats) / sizeof(formats[0]);
+
+	printf("lgpng_convert tests\n");
+#if defined(__GNUC__) && defined(__SSSE3__)
+	if (! __builtin_cpu_supports("ssse3")) {
+		printf("1..0 # SKIP no SSSE3 on this CPU\n");
+		return(EXIT_SUCCESS);
+	}
+#endif
+	printf("TAP version 13\n");
+	printf("1..%zu\n", formatz * LGPNG_FORMAT__MAX);
+
+	srand(34);
+	plte.data.entries = 256;
+	for (size_t i = 0; i < 256; i++) {
+		plte.data.entry[i].red = (uint8_t)rand();
+		plte.data.entry[i].green = (uint8_t)rand();
+		plte.data.entry[i].blue = (uint8_t)rand();
+		trns.data.palette[i] = (uint8_t)rand();
+	}
+	trns.data.entries = 100;
+	trns.data.gray = 1;
+	trns.data.red = 0x12;
+	trns.data.green = 0x34;
+	trns.data.blue = 0x56;
+
+	for (size_t i = 0; i < formatz; i++) {
+		for (int f = 0; f < LGPNG_FORMAT__MAX; f++) {
+			subject = "%s %d - %u bits %s%s to %s\n";
+			t = formats[i].trns ? &trns : NULL;
+			if (check(formats[i].colour, formats[i].depth, &plte,
+			    t, f)) {
+				status = "ok";
+			} else {
+				status = "not ok";
+				rc = EXIT_FAILURE;
+			}
+			printf(subject, status, ++test, formats[i].depth,
+			    colourtypemap[formats[i].colour],
+			    formats[i].trns ? " with tRNS" : "",
+			    lgpng_formatmap[f]);
+		}
+	}
+	return(rc);
+}
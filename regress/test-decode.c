@@ -0,0 +1,506 @@
+#include "../config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "../lgpng.h"
+
+struct image {
+	uint8_t		*expect;	/* Every converted row */
+	size_t		 linez;
+	size_t		 pz;
+	uint32_t	 x0;		/* Region of interest */
+	uint32_t	 y0;
+	uint32_t	 x1;
+	uint32_t	 rows;		/* Rows received so far */
+	bool		 ok;
+};
+
+static enum lgpng_err
+check_row(void *arg, uint32_t y, uint8_t *row, size_t rowz)
+{
+	struct image	*img = arg;
+
+	if (y != img->y0 + img->rows++
+	    || rowz != (img->x1 - img->x0) * img->pz
+	    || 0 != memcmp(row, img->expect + (size_t)y * img->linez
+	    + img->x0 * img->pz, rowz)) {
+		img->ok = false;
+	}
+	return(LGPNG_OK);
+}
+
+static void
+put32(uint8_t *p, uint32_t v)
+{
+	p[0] = (uint8_t)(v >> 24);
+	p[1] = (uint8_t)(v >> 16);
+	p[2] = (uint8_t)(v >> 8);
+	p[3] = (uint8_t)v;
+}
+
+static void
+write_chunk(FILE *f, const char *name, uint8_t *data, size_t dataz)
+{
+	uint8_t		type[4];
+	uint32_t	crc;
+
+	(void)memcpy(type, name, 4);
+	lgpng_chunk_crc((uint32_t)dataz, type, data, &crc);
+	if (LGPNG_OK != lgpng_stream_write_chunk(f, (uint32_t)dataz, type,
+	    data, crc)) {
+		errx(EXIT_FAILURE, "lgpng_stream_write_chunk");
+	}
+}
+
+static void
+put_ihdr(uint8_t *hdr, struct IHDR *ihdr)
+{
+	put32(hdr, ihdr->data.width);
+	put32(hdr + 4, ihdr->data.height);
+	hdr[8] = ihdr->data.bitdepth;
+	hdr[9] = ihdr->data.colourtype;
+	hdr[10] = hdr[11] = 0;
+	hdr[12] = ihdr->data.interlace;
+}
+
+/* Write a PNG file with the image data cut in IDAT chunks of idatz */
+static FILE *
+write_png(struct IHDR *ihdr, uint8_t *z, size_t zz, size_t idatz)
+{
+	uint8_t	 hdr[13];
+	FILE	*f;
+
+	if (NULL == (f = tmpfile())) {
+		err(EXIT_FAILURE, "tmpfile");
+	}
+	put_ihdr(hdr, ihdr);
+	(void)lgpng_stream_write_sig(f);
+	write_chunk(f, "IHDR", hdr, sizeof(hdr));
+	for (size_t i = 0; i < zz; i += idatz) {
+		write_chunk(f, "IDAT", z + i, zz - i < idatz ? zz - i : idatz);
+	}
+	write_chunk(f, "IEND", NULL, 0);
+	rewind(f);
+	return(f);
+}
+
+/*
+ * Build random filtered scanlines and the rows the decoder should return,
+ * using the individual stages of the pipeline.
+ */
+static void
+prepare(struct IHDR *ihdr, enum lgpng_format format, uint8_t **rawp,
+    size_t *rawzp, struct image *img)
+{
+	size_t		 rawz, rowz, pz;
+	uint8_t		*raw, *work, *image;
+	struct lgpng_convert cv;
+
+	if (LGPNG_OK != lgpng_IHDR_raw_size(ihdr, &rawz)) {
+		errx(EXIT_FAILURE, "lgpng_IHDR_raw_size");
+	}
+	rowz = lgpng_IHDR_rowbytes(ihdr, ihdr->data.width);
+	pz = lgpng_convert_pixelz(format);
+	raw = malloc(rawz);
+	work = malloc(rawz);
+	image = malloc(rowz * ihdr->data.height);
+	img->linez = pz * ihdr->data.width;
+	img->expect = malloc(img->linez * ihdr->data.height);
+	if (NULL == raw || NULL == work || NULL == image
+	    || NULL == img->expect) {
+		errx(EXIT_FAILURE, "malloc");
+	}
+	for (size_t i = 0; i < rawz; i++) {
+		raw[i] = (uint8_t)rand();
+	}
+	/* Fix the filter bytes, assuming every row has the same size */
+	if (INTERLACE_METHOD_STANDARD == ihdr->data.interlace) {
+		for (size_t i = 0; i < rawz; i += rowz + 1) {
+			raw[i] = (uint8_t)(rand() % FILTER_TYPE__MAX);
+		}
+	} else {
+		size_t	 offset = 0;
+		uint32_t w, h;
+
+		for (int p = 0; p < 7; p++) {
+			lgpng_IHDR_pass_size(ihdr, p, &w, &h);
+			if (0 == w) {
+				continue;
+			}
+			for (uint32_t y = 0; y < h; y++) {
+				raw[offset] = (uint8_t)(rand() % FILTER_TYPE__MAX);
+				offset += lgpng_IHDR_rowbytes(ihdr, w) + 1;
+			}
+		}
+	}
+	(void)memcpy(work, raw, rawz);
+	if (LGPNG_OK != lgpng_unfilter_image(ihdr, work, rawz)) {
+		errx(EXIT_FAILURE, "lgpng_unfilter_image");
+	}
+	if (INTERLACE_METHOD_STANDARD == ihdr->data.interlace) {
+		for (uint32_t y = 0; y < ihdr->data.height; y++) {
+			(void)memcpy(image + y * rowz, work + y * (rowz + 1) + 1,
+			    rowz);
+		}
+	} else if (LGPNG_OK != lgpng_adam7_deinterlace(ihdr, work, rawz,
+	    image, rowz)) {
+		errx(EXIT_FAILURE, "lgpng_adam7_deinterlace");
+	}
+	if (LGPNG_OK != lgpng_convert_init(&cv, ihdr, NULL, NULL, format)) {
+		errx(EXIT_FAILURE, "lgpng_convert_init");
+	}
+	for (uint32_t y = 0; y < ihdr->data.height; y++) {
+		lgpng_convert_row(&cv, img->expect + y * img->linez,
+		    image + y * rowz, 0, ihdr->data.width);
+	}
+	free(work);
+	free(image);
+	*rawp = raw;
+	*rawzp = rawz;
+	img->pz = pz;
+	img->x0 = img->y0 = 0;
+	img->x1 = ihdr->data.width;
+	img->rows = 0;
+	img->ok = true;
+}
+
+/*
+ * Deflate raw with a full flush after each quarter, so interlaced images
+ * can be inflated by several threads.
+ */
+static uint8_t *
+compress_flushed(uint8_t *raw, size_t rawz, size_t *zz)
+{
+	size_t		 allocz = compressBound(rawz) + 64, step = rawz / 4 + 1;
+	uint8_t		*z;
+	z_stream	 strm;
+
+	(void)memset(&strm, 0, sizeof(strm));
+	if (NULL == (z = malloc(allocz))) {
+		errx(EXIT_FAILURE, "malloc");
+	}
+	if (Z_OK != deflateInit(&strm, Z_DEFAULT_COMPRESSION)) {
+		errx(EXIT_FAILURE, "deflateInit");
+	}
+	strm.next_out = z;
+	strm.avail_out = (uInt)allocz;
+	for (size_t i = 0; i < rawz; i += step) {
+		strm.next_in = raw + i;
+		strm.avail_in = (uInt)(rawz - i < step ? rawz - i : step);
+		if (Z_STREAM_ERROR == deflate(&strm,
+		    rawz - i <= step ? Z_FINISH : Z_FULL_FLUSH)) {
+			errx(EXIT_FAILURE, "deflate");
+		}
+	}
+	*zz = allocz - strm.avail_out;
+	(void)deflateEnd(&strm);
+	return(z);
+}
+
+/*
+ * Feed an image through lgpng_decode_chunk, in IDAT chunks of idatz, to a
+ * decoder with the given number of threads.
+ */
+static bool
+chunks(struct IHDR *ihdr, enum lgpng_format format, size_t idatz,
+    unsigned int threads)
+{
+	bool			 ok;
+	size_t			 rawz, zz;
+	uint8_t			*raw, *z;
+	uint8_t			 hdr[13];
+	struct image		 img;
+	struct lgpng_decode	*dec;
+
+	prepare(ihdr, format, &raw, &rawz, &img);
+	z = compress_flushed(raw, rawz, &zz);
+	put_ihdr(hdr, ihdr);
+	ok = LGPNG_OK == lgpng_decode_new(NULL, format, check_row, &img, &dec);
+	ok = ok && LGPNG_OK == lgpng_decode_set_threads(dec, threads);
+	ok = ok && LGPNG_OK == lgpng_decode_chunk(dec, (uint8_t *)"IHDR", hdr,
+	    sizeof(hdr));
+	for (size_t i = 0; ok && i < zz; i += idatz) {
+		ok = LGPNG_OK == lgpng_decode_chunk(dec, (uint8_t *)"IDAT",
+		    z + i, (uint32_t)(zz - i < idatz ? zz - i : idatz));
+	}
+	ok = ok && LGPNG_OK == lgpng_decode_finish(dec);
+	ok = ok && img.ok && img.rows == ihdr->data.height;
+	lgpng_decode_free(dec);
+	free(img.expect);
+	free(raw);
+	free(z);
+	return(ok);
+}
+
+/* Same but from a complete file, through lgpng_decode_stream */
+static bool
+stream(struct IHDR *ihdr, enum lgpng_format format)
+{
+	bool		 ok;
+	uLongf		 zz;
+	size_t		 rawz;
+	uint8_t		*raw, *z;
+	struct image	 img;
+	FILE		*f;
+
+	prepare(ihdr, format, &raw, &rawz, &img);
+	zz = compressBound(rawz);
+	if (NULL == (z = malloc(zz))) {
+		errx(EXIT_FAILURE, "malloc");
+	}
+	if (Z_OK != compress(z, &zz, raw, rawz)) {
+		errx(EXIT_FAILURE, "compress");
+	}
+	f = write_png(ihdr, z, zz, zz / 2 + 1);
+	ok = LGPNG_OK == lgpng_stream_is_png(f);
+	ok = ok && LGPNG_OK == lgpng_decode_stream(f, NULL, format,
+	    check_row, &img);
+	ok = ok && img.ok && img.rows == ihdr->data.height;
+	fclose(f);
+	free(img.expect);
+	free(raw);
+	free(z);
+	return(ok);
+}
+
+/*
+ * A stream with a wrong Adler-32, split across two IDAT chunks, or one
+ * cut right before its trailer must not decode.
+ */
+static bool
+trailer(struct IHDR *ihdr, bool missing)
+{
+	bool		 ok;
+	uLongf		 zz;
+	size_t		 rawz;
+	uint8_t		*raw, *z;
+	struct image	 img;
+	FILE		*f;
+
+	prepare(ihdr, LGPNG_FORMAT_RGBA8, &raw, &rawz, &img);
+	zz = compressBound(rawz);
+	if (NULL == (z = malloc(zz))) {
+		errx(EXIT_FAILURE, "malloc");
+	}
+	if (Z_OK != compress(z, &zz, raw, rawz)) {
+		errx(EXIT_FAILURE, "compress");
+	}
+	if (missing) {
+		f = write_png(ihdr, z, zz - 4, 64);
+	} else {
+		z[zz - 1] ^= 0x01;
+		f = write_png(ihdr, z, zz, zz - 2);
+	}
+	ok = LGPNG_OK == lgpng_stream_is_png(f);
+	ok = ok && LGPNG_OK != lgpng_decode_stream(f, NULL,
+	    LGPNG_FORMAT_RGBA8, check_row, &img);
+	fclose(f);
+	free(img.expect);
+	free(raw);
+	free(z);
+	return(ok);
+}
+
+/*
+ * Decode a window of the image. For progressive images the file must not
+ * be read past the chunk holding the last row of the window, whatever the
+ * number of threads.
+ */
+static bool
+roi(struct IHDR *ihdr, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
+    unsigned int threads)
+{
+	bool			 ok;
+	uLongf			 zz;
+	size_t			 rawz;
+	long			 end;
+	uint8_t			*raw, *z;
+	struct image		 img;
+	struct lgpng_decode	*dec;
+	FILE			*f;
+
+	prepare(ihdr, LGPNG_FORMAT_RGBA8, &raw, &rawz, &img);
+	img.x0 = x0;
+	img.y0 = y0;
+	img.x1 = x1;
+	zz = compressBound(rawz);
+	if (NULL == (z = malloc(zz))) {
+		errx(EXIT_FAILURE, "malloc");
+	}
+	if (Z_OK != compress(z, &zz, raw, rawz)) {
+		errx(EXIT_FAILURE, "compress");
+	}
+	f = write_png(ihdr, z, zz, 64);
+	(void)fseek(f, 0, SEEK_END);
+	end = ftell(f);
+	rewind(f);
+	ok = LGPNG_OK == lgpng_stream_is_png(f);
+	ok = ok && LGPNG_OK == lgpng_decode_new(NULL, LGPNG_FORMAT_RGBA8,
+	    check_row, &img, &dec);
+	ok = ok && LGPNG_OK == lgpng_decode_set_roi(dec, x0, y0, x1, y1);
+	ok = ok && LGPNG_OK == lgpng_decode_set_threads(dec, threads);
+	ok = ok && LGPNG_OK == lgpng_decode_read(dec, f);
+	ok = ok && img.ok && img.rows == y1 - y0;
+	if (INTERLACE_METHOD_STANDARD == ihdr->data.interlace
+	    && y1 < ihdr->data.height) {
+		ok = ok && ftell(f) < end;
+	}
+	lgpng_decode_free(dec);
+	fclose(f);
+	free(img.expect);
+	free(raw);
+	free(z);
+	return(ok);
+}
+
+/* With one thread a broken interlaced stream fails on its first IDAT */
+static bool
+early(struct IHDR *ihdr)
+{
+	bool			 ok;
+	uint8_t			 hdr[13];
+	uint8_t			 bad[] = { 0x78, 0x9c, 0xff, 0xff, 0xff, 0xff };
+	struct lgpng_decode	*dec;
+
+	put_ihdr(hdr, ihdr);
+	if (LGPNG_OK != lgpng_decode_new(NULL, LGPNG_FORMAT_RGBA8, check_row,
+	    NULL, &dec)) {
+		return(false);
+	}
+	ok = LGPNG_OK == lgpng_decode_chunk(dec, (uint8_t *)"IHDR", hdr,
+	    sizeof(hdr));
+	ok = ok && LGPNG_OK != lgpng_decode_chunk(dec, (uint8_t *)"IDAT", bad,
+	    sizeof(bad));
+	lgpng_decode_free(dec);
+	return(ok);
+}
+
+int
+main(void)
+{
+	int		 rc = EXIT_SUCCESS, test = 0;
+	bool		 ok;
+	struct IHDR	 ihdr;
+	const char	*subject, *status;
+	const struct {
+		uint8_t	depth;
+		uint8_t	colour;
+		uint8_t	interlace;
+	} formats[] = {
+		{ 1, COLOUR_TYPE_GREYSCALE, INTERLACE_METHOD_STANDARD },
+		{ 8, COLOUR_TYPE_GREYSCALE, INTERLACE_METHOD_STANDARD },
+		{ 8, COLOUR_TYPE_TRUECOLOUR, INTERLACE_METHOD_STANDARD },
+		{ 8, COLOUR_TYPE_TRUECOLOUR_ALPHA, INTERLACE_METHOD_STANDARD },
+		{ 16, COLOUR_TYPE_TRUECOLOUR, INTERLACE_METHOD_STANDARD },
+		{ 2, COLOUR_TYPE_GREYSCALE, INTERLACE_METHOD_ADAM7 },
+		{ 8, COLOUR_TYPE_TRUECOLOUR, INTERLACE_METHOD_ADAM7 },
+		{ 16, COLOUR_TYPE_GREYSCALE_ALPHA, INTERLACE_METHOD_ADAM7 },
+	};
+	const size_t	 formatz = sizeof(formats) / sizeof(formats[0]);
+
+	printf("lgpng_decode tests\n");
+	printf("TAP version 13\n");
+	printf("1..%zu\n", 2 * formatz + 5);
+
+	srand(35);
+	for (size_t i = 0; i < formatz; i++) {
+		(void)memset(&ihdr, 0, sizeof(ihdr));
+		ihdr.data.width = 61;
+		ihdr.data.height = 23;
+		ihdr.data.bitdepth = formats[i].depth;
+		ihdr.data.colourtype = formats[i].colour;
+		ihdr.data.interlace = formats[i].interlace;
+
+		subject = "%s %d - lgpng_decode_chunk %u bits %s%s\n";
+		if (chunks(&ihdr, LGPNG_FORMAT_RGBA8, 1, 1)
+		    && chunks(&ihdr, LGPNG_FORMAT_RGB8, 100, 4)
+		    && chunks(&ihdr, LGPNG_FORMAT_RGBA16, 1 << 16, 4)) {
+			status = "ok";
+		} else {
+			status = "not ok";
+			rc = EXIT_FAILURE;
+		}
+		printf(subject, status, ++test, formats[i].depth,
+		    colourtypemap[formats[i].colour],
+		    formats[i].interlace ? " interlaced" : "");
+
+		subject = "%s %d - lgpng_decode_stream %u bits %s%s\n";
+		if (stream(&ihdr, LGPNG_FORMAT_GREY8)) {
+			status = "ok";
+		} else {
+			status = "not ok";
+			rc = EXIT_FAILURE;
+		}
+		printf(subject, status, ++test, formats[i].depth,
+		    colourtypemap[formats[i].colour],
+		    formats[i].interlace ? " interlaced" : "");
+	}
+
+	(void)memset(&ihdr, 0, sizeof(ihdr));
+	ihdr.data.width = 100;
+	ihdr.data.height = 400;
+	ihdr.data.bitdepth = 8;
+	ihdr.data.colourtype = COLOUR_TYPE_TRUECOLOUR;
+	subject = "%s %d - lgpng_decode_set_roi on a progressive image\n";
+	if (roi(&ihdr, 10, 0, 90, 1, 1) && roi(&ihdr, 0, 17, 100, 40, 1)
+	    && roi(&ihdr, 99, 390, 100, 400, 1)
+	    && roi(&ihdr, 0, 17, 100, 40, 4)
+	    && roi(&ihdr, 99, 390, 100, 400, 4)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	ihdr.data.interlace = INTERLACE_METHOD_ADAM7;
+	subject = "%s %d - lgpng_decode_set_roi on an interlaced image\n";
+	if (roi(&ihdr, 10, 0, 90, 1, 1) && roi(&ihdr, 0, 17, 100, 40, 4)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_decode_stream with a bad Adler-32\n";
+	ihdr.data.interlace = INTERLACE_METHOD_STANDARD;
+	ok = trailer(&ihdr, false);
+	ihdr.data.interlace = INTERLACE_METHOD_ADAM7;
+	if (ok && trailer(&ihdr, false)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_decode_stream without Adler-32\n";
+	ihdr.data.interlace = INTERLACE_METHOD_STANDARD;
+	ok = trailer(&ihdr, true);
+	ihdr.data.interlace = INTERLACE_METHOD_ADAM7;
+	if (ok && trailer(&ihdr, true)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_decode_chunk with a broken interlaced stream\n";
+	if (early(&ihdr)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+	return(rc);
+}
@@ -0,0 +1,216 @@
+#include "../config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "../lgpng.h"
+
+struct image {
+	uint8_t		*pixels;
+	size_t		 rowz;
+	uint32_t	 rows;
+	bool		 ok;
+};
+
+static enum lgpng_err
+check_row(void *arg, uint32_t y, uint8_t *row, size_t rowz)
+{
+	struct image	*img = arg;
+
+	if (y != img->rows++ || rowz != img->rowz
+	    || 0 != memcmp(row, img->pixels + (size_t)y * rowz, rowz)) {
+		img->ok = false;
+	}
+	return(LGPNG_OK);
+}
+
+static void
+write_ihdr(FILE *f, struct IHDR *ihdr)
+{
+	uint8_t		hdr[13];
+	uint32_t	crc;
+
+	hdr[0] = (uint8_t)(ihdr->data.width >> 24);
+	hdr[1] = (uint8_t)(ihdr->data.width >> 16);
+	hdr[2] = (uint8_t)(ihdr->data.width >> 8);
+	hdr[3] = (uint8_t)ihdr->data.width;
+	hdr[4] = (uint8_t)(ihdr->data.height >> 24);
+	hdr[5] = (uint8_t)(ihdr->data.height >> 16);
+	hdr[6] = (uint8_t)(ihdr->data.height >> 8);
+	hdr[7] = (uint8_t)ihdr->data.height;
+	hdr[8] = ihdr->data.bitdepth;
+	hdr[9] = ihdr->data.colourtype;
+	hdr[10] = hdr[11] = hdr[12] = 0;
+	lgpng_chunk_crc(sizeof(hdr), (uint8_t *)"IHDR", hdr, &crc);
+	(void)lgpng_stream_write_sig(f);
+	(void)lgpng_stream_write_chunk(f, sizeof(hdr), (uint8_t *)"IHDR", hdr,
+	    crc);
+}
+
+/* Concatenate the data of every IDAT chunk of f */
+static uint8_t *
+read_idat(FILE *f, size_t *zz, size_t *chunks)
+{
+	uint32_t	 length, crc;
+	uint8_t		 type[4];
+	uint8_t		*z = NULL, *data;
+
+	*zz = 0;
+	*chunks = 0;
+	rewind(f);
+	if (LGPNG_OK != lgpng_stream_is_png(f)) {
+		errx(EXIT_FAILURE, "lgpng_stream_is_png");
+	}
+	while (LGPNG_OK == lgpng_stream_get_length(f, &length)
+	    && LGPNG_OK == lgpng_stream_get_type(f, type)) {
+		if (NULL == (z = realloc(z, *zz + length + 1))) {
+			errx(EXIT_FAILURE, "realloc");
+		}
+		data = z + *zz;
+		(void)lgpng_stream_get_data(f, length, &data);
+		(void)lgpng_stream_get_crc(f, &crc);
+		if (0 == memcmp(type, "IDAT", 4)) {
+			*zz += length;
+			*chunks += 1;
+		}
+	}
+	return(z);
+}
+
+/*
+ * Encode a pseudo random image and decode it back. Rows are made
+ * compressible so the dictionary between blocks matters.
+ */
+static bool
+roundtrip(uint32_t width, uint32_t height, unsigned int threads, int level,
+    bool restarts, enum lgpng_heuristic heuristic)
+{
+	bool			 ok = true;
+	size_t			 zz, chunks, rawz, outz, perblock, segz;
+	uLongf			 whole;
+	uint8_t			*z, *out, *ref = NULL;
+	struct IHDR		 ihdr;
+	struct image		 img;
+	struct lgpng_encode	*enc;
+	FILE			*f;
+
+	(void)memset(&ihdr, 0, sizeof(ihdr));
+	ihdr.data.width = width;
+	ihdr.data.height = height;
+	ihdr.data.bitdepth = 8;
+	ihdr.data.colourtype = COLOUR_TYPE_TRUECOLOUR;
+	img.rowz = 3 * (size_t)width;
+	img.rows = 0;
+	img.ok = true;
+	if (NULL == (img.pixels = malloc(img.rowz * height))) {
+		errx(EXIT_FAILURE, "malloc");
+	}
+	for (size_t i = 0; i < img.rowz * height; i++) {
+		img.pixels[i] = (uint8_t)(rand() % 8 + i / 1000);
+	}
+	if (NULL == (f = tmpfile())) {
+		err(EXIT_FAILURE, "tmpfile");
+	}
+	write_ihdr(f, &ihdr);
+	ok = LGPNG_OK == lgpng_encode_new(f, &ihdr, threads, &enc);
+	ok = ok && LGPNG_OK == lgpng_encode_set_level(enc, level);
+	ok = ok && LGPNG_OK == lgpng_encode_set_restarts(enc, restarts);
+	ok = ok && LGPNG_OK == lgpng_encode_set_filter(enc, heuristic,
+	    FILTER_TYPE_PAETH);
+	for (uint32_t y = 0; ok && y < height; y++) {
+		ok = LGPNG_OK == lgpng_encode_row(enc,
+		    img.pixels + y * img.rowz);
+	}
+	ok = ok && LGPNG_OK == lgpng_encode_finish(enc);
+	lgpng_encode_free(enc);
+	(void)lgpng_stream_write_chunk(f, 0, (uint8_t *)"IEND", NULL,
+	    0xae426082);
+
+	rewind(f);
+	ok = ok && LGPNG_OK == lgpng_stream_is_png(f);
+	ok = ok && LGPNG_OK == lgpng_decode_stream(f, NULL, LGPNG_FORMAT_RGB8,
+	    check_row, &img);
+	ok = ok && img.ok && img.rows == height;
+
+	/* Several IDAT chunks, which can be cut again when independent */
+	z = read_idat(f, &zz, &chunks);
+	/* Blocks of 128 KiB are cut after the scanline crossing the limit */
+	perblock = (128 * 1024 + img.rowz) / (img.rowz + 1);
+	ok = ok && chunks == (height + perblock - 1) / perblock;
+	/* zlib checks the Adler-32 and the end of the whole stream */
+	(void)lgpng_IHDR_raw_size(&ihdr, &rawz);
+	whole = rawz + 1;
+	if (ok && NULL == (ref = malloc(whole))) {
+		errx(EXIT_FAILURE, "malloc");
+	}
+	ok = ok && Z_OK == uncompress(ref, &whole, z, zz) && whole == rawz;
+	if (ok && restarts) {
+		ok = lgpng_idat_find_restarts(z, zz, NULL, 0) >= chunks - 1;
+		ok = ok && LGPNG_OK == lgpng_idat_inflate_parallel(&ihdr, NULL,
+		    z, zz, 4, &out, &outz, &segz);
+		if (ok) {
+			ok = outz == rawz && 0 == memcmp(out, ref, rawz);
+			free(out);
+		}
+		ok = ok && (1 == chunks || segz > 1);
+	}
+	free(ref);
+	free(z);
+	fclose(f);
+	free(img.pixels);
+	return(ok);
+}
+
+int
+main(void)
+{
+	int		 rc = EXIT_SUCCESS, test = 0;
+	const char	*subject, *status;
+	const struct {
+		uint32_t	width;
+		uint32_t	height;
+		unsigned int	threads;
+		int		level;
+		bool		restarts;
+		enum lgpng_heuristic heuristic;
+	} cases[] = {
+		{ 1, 1, 1, -1, false, LGPNG_HEURISTIC_MINSUM },
+		{ 100, 100, 1, 6, false, LGPNG_HEURISTIC_MINSUM },
+		{ 1000, 200, 1, 6, false, LGPNG_HEURISTIC_MINSUM },
+		{ 1000, 200, 4, 6, false, LGPNG_HEURISTIC_MINSUM },
+		{ 1000, 200, 3, 1, false, LGPNG_HEURISTIC_MINSUM },
+		{ 1000, 200, 4, 9, true, LGPNG_HEURISTIC_MINSUM },
+		{ 20000, 10, 2, 6, false, LGPNG_HEURISTIC_MINSUM },
+		{ 100, 100, 1, 6, false, LGPNG_HEURISTIC_FIXED },
+		{ 100, 100, 1, 6, false, LGPNG_HEURISTIC_ENTROPY },
+		{ 1000, 200, 2, 6, false, LGPNG_HEURISTIC_BRUTE },
+	};
+	const size_t	 casez = sizeof(cases) / sizeof(cases[0]);
+
+	printf("lgpng_encode tests\n");
+	printf("TAP version 13\n");
+	printf("1..%zu\n", casez);
+
+	srand(39);
+	for (size_t i = 0; i < casez; i++) {
+		subject = "%s %d - %ux%u with %u threads at level %d%s, %s\n";
+		if (roundtrip(cases[i].width, cases[i].height, cases[i].threads,
+		    cases[i].level, cases[i].restarts, cases[i].heuristic)) {
+			status = "ok";
+		} else {
+			status = "not ok";
+			rc = EXIT_FAILURE;
+		}
+		printf(subject, status, ++test, cases[i].width,
+		    cases[i].height, cases[i].threads, cases[i].level,
+		    cases[i].restarts ? " and restarts" : "",
+		    lgpng_heuristicmap[cases[i].heuristic]);
+	}
+	return(rc);
+}
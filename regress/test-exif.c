@@ -0,0 +1,184 @@
+#include "../config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lgpng.h"
+
+/*
+ * IFD0 with Make, Orientation and an Exif sub-IFD pointer, followed by the
+ * Exif IFD holding an FNumber rational. Offsets are identical in both byte
+ * orders.
+ */
+static uint8_t le[] = {
+	'I', 'I', 42, 0, 8, 0, 0, 0,
+	3, 0,
+	0x0f, 0x01, 2, 0, 6, 0, 0, 0, 50, 0, 0, 0,
+	0x12, 0x01, 3, 0, 1, 0, 0, 0, 6, 0, 0, 0,
+	0x69, 0x87, 4, 0, 1, 0, 0, 0, 56, 0, 0, 0,
+	0, 0, 0, 0,
+	'C', 'a', 'n', 'o', 'n', 0,
+	1, 0,
+	0x9d, 0x82, 5, 0, 1, 0, 0, 0, 74, 0, 0, 0,
+	0, 0, 0, 0,
+	28, 0, 0, 0, 10, 0, 0, 0,
+};
+
+static uint8_t be[] = {
+	'M', 'M', 0, 42, 0, 0, 0, 8,
+	0, 3,
+	0x01, 0x0f, 0, 2, 0, 0, 0, 6, 0, 0, 0, 50,
+	0x01, 0x12, 0, 3, 0, 0, 0, 1, 0, 6, 0, 0,
+	0x87, 0x69, 0, 4, 0, 0, 0, 1, 0, 0, 0, 56,
+	0, 0, 0, 0,
+	'C', 'a', 'n', 'o', 'n', 0,
+	0, 1,
+	0x82, 0x9d, 0, 5, 0, 0, 0, 1, 0, 0, 0, 74,
+	0, 0, 0, 0,
+	0, 0, 0, 28, 0, 0, 0, 10,
+};
+
+/* IFD0 whose next pointer designates itself */
+static uint8_t loop[] = {
+	'I', 'I', 42, 0, 8, 0, 0, 0,
+	1, 0,
+	0x12, 0x01, 3, 0, 1, 0, 0, 0, 3, 0, 0, 0,
+	8, 0, 0, 0,
+};
+
+/*
+ * IFD0 with Orientation, followed by the thumbnail IFD1 with its own
+ * Orientation and a GPS sub-IFD pointer that are both to be ignored.
+ */
+static uint8_t thumb[] = {
+	'I', 'I', 42, 0, 8, 0, 0, 0,
+	1, 0,
+	0x12, 0x01, 3, 0, 1, 0, 0, 0, 6, 0, 0, 0,
+	26, 0, 0, 0,
+	2, 0,
+	0x12, 0x01, 3, 0, 1, 0, 0, 0, 1, 0, 0, 0,
+	0x25, 0x88, 4, 0, 1, 0, 0, 0, 56, 0, 0, 0,
+	0, 0, 0, 0,
+	1, 0,
+	0x01, 0x00, 2, 0, 2, 0, 0, 0, 'N', 0, 0, 0,
+	0, 0, 0, 0,
+};
+
+static bool
+check(uint8_t *data, size_t dataz)
+{
+	struct exif		 exif;
+	struct exif_entry	*e;
+	uint32_t		 value, num, den;
+
+	if (LGPNG_OK != lgpng_exif_parse(&exif, data, dataz)) {
+		return(false);
+	}
+	if (2 != exif.ifds || 4 != exif.entries) {
+		return(false);
+	}
+	if (NULL == (e = lgpng_exif_get(&exif, EXIF_TAG_MAKE))) {
+		return(false);
+	}
+	if (EXIF_TYPE_ASCII != e->type || 0 != memcmp(e->value, "Canon", 6)) {
+		return(false);
+	}
+	if (LGPNG_OK != lgpng_exif_get_integer(&exif, EXIF_TAG_ORIENTATION, 0,
+	    &value) || 6 != value) {
+		return(false);
+	}
+	if (LGPNG_OK != lgpng_exif_get_rational(&exif, EXIF_TAG_FNUMBER, 0,
+	    &num, &den) || 28 != num || 10 != den) {
+		return(false);
+	}
+	if (NULL != lgpng_exif_get(&exif, EXIF_TAG_MODEL)) {
+		return(false);
+	}
+	return(true);
+}
+
+int
+main(void)
+{
+	int		 rc = EXIT_SUCCESS, test = 0;
+	uint32_t	 value;
+	struct exif	 exif;
+	const char	*subject, *status;
+
+	printf("lgpng_exif tests\n");
+	printf("TAP version 13\n");
+	printf("1..7\n");
+
+	subject = "%s %d - lgpng_exif_parse with data NULL\n";
+	if (LGPNG_INVALID_PARAM == lgpng_exif_parse(&exif, NULL, 0)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_exif_parse little-endian\n";
+	if (check(le, sizeof(le))) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_exif_parse big-endian\n";
+	if (check(be, sizeof(be))) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_exif_parse with truncated IFD\n";
+	if (LGPNG_TOO_SHORT == lgpng_exif_parse(&exif, le, 30)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_exif_parse with invalid header\n";
+	if (LGPNG_ERROR == lgpng_exif_parse(&exif, le + 1, sizeof(le) - 1)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_exif_parse visits looping IFD once\n";
+	if (LGPNG_OK == lgpng_exif_parse(&exif, loop, sizeof(loop))
+	    && 1 == exif.ifds && LGPNG_OK == lgpng_exif_get_integer(&exif,
+	    EXIF_TAG_ORIENTATION, 0, &value) && 3 == value) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_exif_parse ignores the thumbnail IFD\n";
+	if (LGPNG_OK == lgpng_exif_parse(&exif, thumb, sizeof(thumb))
+	    && 2 == exif.ifds && 3 == exif.entries
+	    && LGPNG_OK == lgpng_exif_get_integer(&exif,
+	    EXIF_TAG_ORIENTATION, 0, &value) && 6 == value
+	    && NULL == lgpng_exif_get(&exif, EXIF_TAG_GPS_LATITUDE_REF)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	return(rc);
+}
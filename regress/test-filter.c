@@ -0,0 +1,119 @@
+#include "../config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lgpng.h"
+
+#define ROWZ_MAX	(8 * 70)
+
+/*
+ * Check that the five rows produced in a single pass match the filters
+ * applied one by one, that they are undone by the inverse filters and
+ * that their costs add up.
+ */
+static bool
+roundtrip(size_t bpp, bool hasprev)
+{
+	uint8_t		 prev[ROWZ_MAX], row[ROWZ_MAX], one[ROWZ_MAX];
+	uint8_t		 all[FILTER_TYPE__MAX][ROWZ_MAX];
+	uint8_t		*out[FILTER_TYPE__MAX];
+	uint64_t	 cost[FILTER_TYPE__MAX], sum;
+	const uint8_t	*p = hasprev ? prev : NULL;
+
+	for (int f = 0; f < FILTER_TYPE__MAX; f++) {
+		out[f] = all[f];
+	}
+	for (size_t rowz = bpp; rowz <= bpp * 70; rowz += bpp) {
+		for (size_t i = 0; i < rowz; i++) {
+			prev[i] = (uint8_t)rand();
+			row[i] = (uint8_t)(i % 3 ? prev[i] + rand() % 5 : rand());
+		}
+		if (LGPNG_OK != lgpng_filter_all(bpp, row, p, rowz, out, cost)) {
+			return(false);
+		}
+		for (uint8_t f = 0; f < FILTER_TYPE__MAX; f++) {
+			if (LGPNG_OK != lgpng_filter_row(f, bpp, one, row, p,
+			    rowz) || 0 != memcmp(one, all[f], rowz)) {
+				return(false);
+			}
+			sum = 0;
+			for (size_t i = 0; i < rowz; i++) {
+				sum += one[i] < 128 ? one[i] : 256u - one[i];
+			}
+			if (sum != cost[f]) {
+				return(false);
+			}
+			(void)lgpng_unfilter_row_scalar(f, bpp, one, p, rowz);
+			if (0 != memcmp(one, row, rowz)) {
+				return(false);
+			}
+		}
+	}
+	return(true);
+}
+
+int
+main(void)
+{
+	int		 rc = EXIT_SUCCESS, test = 0;
+	uint8_t		 row[4096];
+	const size_t	 bpps[] = { 1, 2, 3, 4, 6, 8 };
+	const char	*subject, *status;
+
+	printf("lgpng_filter tests\n");
+	printf("TAP version 13\n");
+	printf("1..%zu\n", 3 + 2 * sizeof(bpps) / sizeof(bpps[0]));
+
+	srand(40);
+	subject = "%s %d - lgpng_filter_row with invalid filter\n";
+	if (LGPNG_INVALID_PARAM == lgpng_filter_row(FILTER_TYPE__MAX, 1,
+	    row, row, NULL, 16)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_filter_entropy of a constant row\n";
+	(void)memset(row, 7, sizeof(row));
+	if (0 == lgpng_filter_entropy(row, sizeof(row))) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	/* 4096 bytes evenly spread over 256 values need 8 bits each */
+	subject = "%s %d - lgpng_filter_entropy of a uniform row\n";
+	for (size_t i = 0; i < sizeof(row); i++) {
+		row[i] = (uint8_t)i;
+	}
+	if (lgpng_filter_entropy(row, sizeof(row)) > 8 * 4096 * 97 / 100
+	    && lgpng_filter_entropy(row, sizeof(row)) < 8 * 4096 * 103 / 100) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	for (size_t i = 0; i < sizeof(bpps) / sizeof(bpps[0]); i++) {
+		subject = "%s %d - all filters, %zu bytes per pixel%s\n";
+		for (int hasprev = 0; hasprev < 2; hasprev++) {
+			if (roundtrip(bpps[i], hasprev)) {
+				status = "ok";
+			} else {
+				status = "not ok";
+				rc = EXIT_FAILURE;
+			}
+			printf(subject, status, ++test, bpps[i],
+			    hasprev ? "" : ", first row");
+		}
+	}
+	return(rc);
+}
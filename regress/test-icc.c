@@ -0,0 +1,110 @@
+#include "../config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "../lgpng.h"
+
+int
+main(void)
+{
+	int		 rc = EXIT_SUCCESS, test = 0;
+	uLongf		 compressedz;
+	uint8_t		 profile[128 + 4 + 12 + 8];
+	uint8_t		 compressed[256];
+	struct iCCP	 iccp;
+	struct icc	 local;
+	struct icc	*first, *second;
+	struct icc_tag	 tag;
+	const char	*subject, *status;
+
+	printf("lgpng_icc tests\n");
+	printf("TAP version 13\n");
+	printf("1..5\n");
+
+	/* Minimal display profile with a single tag */
+	(void)memset(profile, 0, sizeof(profile));
+	profile[3] = sizeof(profile);
+	profile[8] = 4;
+	profile[9] = 0x30;
+	(void)memcpy(profile + 12, "mntr", 4);
+	(void)memcpy(profile + 16, "RGB ", 4);
+	(void)memcpy(profile + 20, "XYZ ", 4);
+	(void)memcpy(profile + 36, "acsp", 4);
+	profile[131] = 1;
+	(void)memcpy(profile + 132, "wtpt", 4);
+	profile[139] = 144;
+	profile[143] = 8;
+	compressedz = sizeof(compressed);
+	if (Z_OK != compress(compressed, &compressedz, profile,
+	    sizeof(profile))) {
+		printf("Bail out!\n");
+		errx(EXIT_FAILURE, "compress");
+	}
+	iccp.data.profile = compressed;
+	iccp.data.profilez = compressedz;
+
+	subject = "%s %d - lgpng_icc_get\n";
+	if (LGPNG_OK == lgpng_icc_get(&iccp, NULL, &first)
+	    && 4 == first->major && 3 == first->minor
+	    && 0 == memcmp(first->colourspace, "RGB ", 4)
+	    && 1 == first->tagcount) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_icc_find_tag\n";
+	if (LGPNG_OK == lgpng_icc_find_tag(first, "wtpt", &tag)
+	    && 144 == tag.offset && 8 == tag.size) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - identical profiles are served from the cache\n";
+	if (LGPNG_OK == lgpng_icc_get(&iccp, NULL, &second)
+	    && first == second) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_icc_parse without signature\n";
+	profile[36] = 'x';
+	if (LGPNG_ERROR == lgpng_icc_parse(&local, profile,
+	    sizeof(profile))) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_icc_parse with truncated tag table\n";
+	profile[36] = 'a';
+	profile[131] = 2;
+	if (LGPNG_TOO_SHORT == lgpng_icc_parse(&local, profile,
+	    128 + 4 + 12)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	lgpng_icc_cache_flush();
+	return(rc);
+}
@@ -0,0 +1,537 @@
+#include "../config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "../lgpng.h"
+
+/*
+ * Compress rawz bytes of scanlines and feed them to a new IDAT stream in
+ * slices of at most slicez bytes, as if they came from several chunks.
+ * With corrupt the last byte of the Adler-32 trailer is flipped.
+ */
+static enum lgpng_err
+roundtrip(struct IHDR *ihdr, uint8_t *raw, size_t rawz, size_t srcz,
+    size_t slicez, bool corrupt)
+{
+	enum lgpng_err		 err;
+	uLongf			 zz;
+	size_t			 outz;
+	uint32_t		 computed, stored;
+	uint8_t			*z, *out;
+	struct lgpng_idat	*idat;
+
+	zz = compressBound(rawz);
+	if (NULL == (z = malloc(zz))) {
+		errx(EXIT_FAILURE, "malloc");
+	}
+	if (Z_OK != compress(z, &zz, raw, rawz)) {
+		errx(EXIT_FAILURE, "compress");
+	}
+	if (srcz > zz) {
+		srcz = zz;
+	}
+	if (corrupt) {
+		z[zz - 1] ^= 1;
+	}
+	if (LGPNG_OK != (err = lgpng_idat_new(ihdr, NULL, &idat))) {
+		free(z);
+		return(err);
+	}
+	for (size_t i = 0; i < srcz; i += slicez) {
+		err = lgpng_idat_feed(idat, z + i,
+		    srcz - i < slicez ? srcz - i : slicez);
+		if (LGPNG_OK != err) {
+			break;
+		}
+	}
+	/* Both sums are known once the stream ended, good or bad */
+	if (srcz == zz && (LGPNG_OK == err || LGPNG_ZLIB_ERROR == err)
+	    && (LGPNG_OK != lgpng_idat_adler32(idat, &computed, &stored)
+	    || computed != adler32(1L, raw, (uInt)rawz)
+	    || stored != (corrupt ? computed ^ 1 : computed))) {
+		err = LGPNG_ERROR;
+	}
+	if (LGPNG_OK != err) {
+		goto out;
+	}
+	if (LGPNG_OK != (err = lgpng_idat_finish(idat, &out, &outz))) {
+		goto out;
+	}
+	if (outz != rawz || 0 != memcmp(out, raw, rawz)) {
+		err = LGPNG_ERROR;
+	}
+out:
+	lgpng_idat_free(idat);
+	free(z);
+	return(err);
+}
+
+/* Only count the bytes of a stream of rawz bytes, fed in slices */
+static enum lgpng_err
+counted(struct IHDR *ihdr, uint8_t *raw, size_t rawz, size_t *outz)
+{
+	enum lgpng_err		 err = LGPNG_OK;
+	uLongf			 zz;
+	uint8_t			*z;
+	struct lgpng_idat	*idat;
+
+	zz = compressBound(rawz);
+	if (NULL == (z = malloc(zz))) {
+		errx(EXIT_FAILURE, "malloc");
+	}
+	if (Z_OK != compress(z, &zz, raw, rawz)) {
+		errx(EXIT_FAILURE, "compress");
+	}
+	if (LGPNG_OK != (err = lgpng_idat_new_count(ihdr, NULL, &idat))) {
+		free(z);
+		return(err);
+	}
+	for (size_t i = 0; LGPNG_OK == err && i < zz; i += 100) {
+		err = lgpng_idat_feed(idat, z + i, zz - i < 100 ? zz - i : 100);
+	}
+	if (LGPNG_OK == err) {
+		err = lgpng_idat_finish(idat, NULL, outz);
+	}
+	lgpng_idat_free(idat);
+	free(z);
+	return(err);
+}
+
+/* Deflate raw with a flush every rows scanlines of rowz bytes */
+static uint8_t *
+flushed(uint8_t *raw, size_t rawz, size_t rowz, int flush, size_t *zz)
+{
+	size_t		 allocz = rawz * 2 + 1024;
+	uint8_t		*z;
+	z_stream	 strm;
+
+	(void)memset(&strm, 0, sizeof(strm));
+	if (NULL == (z = malloc(allocz))) {
+		errx(EXIT_FAILURE, "malloc");
+	}
+	if (Z_OK != deflateInit(&strm, Z_DEFAULT_COMPRESSION)) {
+		errx(EXIT_FAILURE, "deflateInit");
+	}
+	strm.next_out = z;
+	strm.avail_out = (uInt)allocz;
+	for (size_t i = 0; i < rawz; i += rowz * 2) {
+		strm.next_in = raw + i;
+		strm.avail_in = (uInt)(rawz - i < rowz * 2 ? rawz - i : rowz * 2);
+		if (Z_STREAM_ERROR == deflate(&strm,
+		    rawz - i <= rowz * 2 ? Z_FINISH : flush)) {
+			errx(EXIT_FAILURE, "deflate");
+		}
+	}
+	*zz = allocz - strm.avail_out;
+	(void)deflateEnd(&strm);
+	return(z);
+}
+
+static enum lgpng_err
+parallel(struct IHDR *ihdr, uint8_t *raw, size_t rawz, int flush,
+    bool corrupt, size_t *segz)
+{
+	enum lgpng_err	 err;
+	size_t		 zz, outz;
+	uint8_t		*z, *out;
+
+	z = flushed(raw, rawz, lgpng_IHDR_rowbytes(ihdr, ihdr->data.width) + 1,
+	    flush, &zz);
+	if (corrupt) {
+		z[zz - 1] ^= 1;
+	}
+	err = lgpng_idat_inflate_parallel(ihdr, NULL, z, zz, 4, &out, &outz,
+	    segz);
+	if (LGPNG_OK == err) {
+		if (outz != rawz || 0 != memcmp(out, raw, rawz)) {
+			err = LGPNG_ERROR;
+		}
+		free(out);
+	}
+	free(z);
+	return(err);
+}
+
+struct rows {
+	uint8_t		*raw;
+	size_t		 offset;	/* Of the next row in raw */
+	size_t		 prevz;
+	const uint8_t	*prev;
+	bool		 ok;
+};
+
+/* Rows must follow each other in raw, the previous one left intact */
+static enum lgpng_err
+check_row(void *arg, uint32_t y, uint8_t *row, size_t rowz)
+{
+	struct rows	*r = arg;
+
+	(void)y;
+	if (0 != memcmp(row, r->raw + r->offset, rowz)
+	    || (NULL != r->prev
+	    && 0 != memcmp(r->prev, r->raw + r->offset - r->prevz, r->prevz))) {
+		r->ok = false;
+	}
+	r->prev = row;
+	r->prevz = rowz;
+	r->offset += rowz;
+	return(LGPNG_OK);
+}
+
+/* Same as parallel but through the row callback, with a flush every cutz */
+static enum lgpng_err
+parallel_rows(struct IHDR *ihdr, uint8_t *raw, size_t cutz, size_t *segz)
+{
+	enum lgpng_err	 err;
+	size_t		 zz, rawz;
+	uint8_t		*z;
+	struct rows	 r;
+
+	if (LGPNG_OK != (err = lgpng_IHDR_raw_size(ihdr, &rawz))) {
+		return(err);
+	}
+	z = flushed(raw, rawz, cutz / 2, Z_FULL_FLUSH, &zz);
+	(void)memset(&r, 0, sizeof(r));
+	r.raw = raw;
+	r.ok = true;
+	err = lgpng_idat_inflate_parallel_rows(ihdr, NULL, z, zz, 4,
+	    check_row, &r, segz);
+	if (LGPNG_OK == err && (! r.ok || r.offset != rawz)) {
+		err = LGPNG_ERROR;
+	}
+	free(z);
+	return(err);
+}
+
+/* Round trip through the whole buffer backend */
+static enum lgpng_err
+whole(struct IHDR *ihdr, uint8_t *raw, size_t rawz, size_t cut)
+{
+	enum lgpng_err	 err;
+	size_t		 zz, outz;
+	uint8_t		*z, *out;
+
+	zz = lgpng_zlib_bound(rawz);
+	if (NULL == (z = malloc(zz))) {
+		errx(EXIT_FAILURE, "malloc");
+	}
+	err = lgpng_zlib_deflate(Z_DEFAULT_COMPRESSION, raw, rawz, z, zz, &zz);
+	if (LGPNG_OK == err) {
+		err = lgpng_idat_inflate(ihdr, NULL, z, zz - cut, &out, &outz);
+	}
+	if (LGPNG_OK == err) {
+		if (outz != rawz || 0 != memcmp(out, raw, rawz)) {
+			err = LGPNG_ERROR;
+		}
+		free(out);
+	}
+	free(z);
+	return(err);
+}
+
+int
+main(void)
+{
+	int		 rc = EXIT_SUCCESS, test = 0;
+	size_t		 rawz, outz, segz;
+	uint8_t		 raw[8192];
+	struct IHDR	 ihdr;
+	const char	*subject, *status;
+
+	printf("lgpng_idat tests (%s)\n", lgpng_zlib_backend);
+#if defined(__GNUC__) && defined(__AVX2__)
+	if (! __builtin_cpu_supports("avx2")) {
+		printf("1..0 # SKIP no AVX2 on this CPU\n");
+		return(EXIT_SUCCESS);
+	}
+#elif defined(__GNUC__) && defined(__SSSE3__)
+	if (! __builtin_cpu_supports("ssse3")) {
+		printf("1..0 # SKIP no SSSE3 on this CPU\n");
+		return(EXIT_SUCCESS);
+	}
+#endif
+	printf("TAP version 13\n");
+	printf("1..22\n");
+
+	for (size_t i = 0; i < sizeof(raw); i++) {
+		raw[i] = (uint8_t)(i * 7 + i / 13);
+	}
+	(void)memset(&ihdr, 0, sizeof(ihdr));
+	ihdr.data.width = 33;
+	ihdr.data.height = 17;
+	ihdr.data.bitdepth = 8;
+	ihdr.data.colourtype = COLOUR_TYPE_TRUECOLOUR_ALPHA;
+
+	subject = "%s %d - lgpng_adler32 at every length and alignment\n";
+	{
+		bool	 ok = true;
+
+		for (size_t i = 0; ok && i < 64; i++) {
+			for (size_t n = 0; ok && i + n <= sizeof(raw);
+			    n += 1 + n / 8) {
+				ok = lgpng_adler32(1, raw + i, n)
+				    == adler32(1L, raw + i, (uInt)n);
+			}
+		}
+		status = ok ? "ok" : "not ok";
+		if (! ok) {
+			rc = EXIT_FAILURE;
+		}
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_adler32 with large sums\n";
+	{
+		bool		 ok;
+		uint8_t		*ff;
+		size_t		 ffz = 1024 * 1024;
+
+		/* The worst case for the intermediate sums, split unevenly */
+		if (NULL == (ff = malloc(ffz))) {
+			errx(EXIT_FAILURE, "malloc");
+		}
+		(void)memset(ff, 0xff, ffz);
+		ok = lgpng_adler32(lgpng_adler32(0xfff0fff0, ff, 12345),
+		    ff + 12345, ffz - 12345) == adler32(0xfff0fff0, ff, (uInt)ffz);
+		free(ff);
+		status = ok ? "ok" : "not ok";
+		if (! ok) {
+			rc = EXIT_FAILURE;
+		}
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_IHDR_raw_size\n";
+	if (LGPNG_OK == lgpng_IHDR_raw_size(&ihdr, &rawz)
+	    && 17 * (1 + 33 * 4) == rawz) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_IHDR_raw_size with Adam7\n";
+	ihdr.data.interlace = INTERLACE_METHOD_ADAM7;
+	ihdr.data.bitdepth = 1;
+	ihdr.data.colourtype = COLOUR_TYPE_GREYSCALE;
+	/* Passes are 5x3, 4x3, 9x2, 8x5, 17x4, 16x9 and 33x8 pixels */
+	if (LGPNG_OK == lgpng_IHDR_raw_size(&ihdr, &rawz)
+	    && 3 * 2 + 3 * 2 + 2 * 3 + 5 * 2 + 4 * 4 + 9 * 3 + 8 * 6 == rawz) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_IHDR_raw_size with invalid bit depth\n";
+	ihdr.data.bitdepth = 3;
+	if (LGPNG_INVALID_PARAM == lgpng_IHDR_raw_size(&ihdr, &rawz)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	ihdr.data.interlace = INTERLACE_METHOD_STANDARD;
+	ihdr.data.bitdepth = 8;
+	ihdr.data.colourtype = COLOUR_TYPE_TRUECOLOUR_ALPHA;
+	(void)lgpng_IHDR_raw_size(&ihdr, &rawz);
+
+	subject = "%s %d - lgpng_idat_feed across many chunks\n";
+	if (LGPNG_OK == roundtrip(&ihdr, raw, rawz, SIZE_MAX, 7, false)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_finish with truncated stream\n";
+	if (LGPNG_TOO_SHORT == roundtrip(&ihdr, raw, rawz, 100, 64, false)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_feed with overlong stream\n";
+	if (LGPNG_TOO_LONG == roundtrip(&ihdr, raw, rawz + 1, SIZE_MAX, 64,
+	    false)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_finish with short image\n";
+	if (LGPNG_TOO_SHORT == roundtrip(&ihdr, raw, rawz - 1, SIZE_MAX, 64,
+	    false)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_feed with bad checksum across chunks\n";
+	if (LGPNG_ZLIB_ERROR == roundtrip(&ihdr, raw, rawz, SIZE_MAX, 3,
+	    true)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_new_count\n";
+	if (LGPNG_OK == counted(&ihdr, raw, rawz, &outz) && rawz == outz) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_new_count with overlong stream\n";
+	if (LGPNG_TOO_LONG == counted(&ihdr, raw, sizeof(raw), &outz)
+	    && sizeof(raw) == outz) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_new_count with short image\n";
+	if (LGPNG_TOO_SHORT == counted(&ihdr, raw, rawz - 5, &outz)
+	    && rawz - 5 == outz) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_find_restarts\n";
+	{
+		size_t	 zz, offsets[32], found;
+		uint8_t	*z;
+		bool	 ok;
+
+		z = flushed(raw, rawz, 33 * 4 + 1, Z_FULL_FLUSH, &zz);
+		found = lgpng_idat_find_restarts(z, zz, offsets, 32);
+		/* One flush every two of the 17 rows */
+		ok = found >= 8 && found <= 32;
+		for (size_t i = 0; ok && i < found; i++) {
+			ok = 0 == memcmp(z + offsets[i] - 4, "\0\0\xff\xff", 4);
+		}
+		status = ok ? "ok" : "not ok";
+		if (! ok) {
+			rc = EXIT_FAILURE;
+		}
+		free(z);
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_inflate_parallel with full flushes\n";
+	/* Make sure the segments really were inflated concurrently */
+	if (LGPNG_OK == parallel(&ihdr, raw, rawz, Z_FULL_FLUSH, false, &segz)
+	    && 4 == segz) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_inflate_parallel with sync flushes\n";
+	if (LGPNG_OK == parallel(&ihdr, raw, rawz, Z_SYNC_FLUSH, false, NULL)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_inflate_parallel without flushes\n";
+	if (LGPNG_OK == parallel(&ihdr, raw, rawz, Z_NO_FLUSH, false, &segz)
+	    && 1 == segz) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_inflate_parallel with bad checksum\n";
+	if (LGPNG_OK != parallel(&ihdr, raw, rawz, Z_FULL_FLUSH, true, NULL)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_inflate_parallel_rows\n";
+	{
+		bool	 ok;
+
+		/* Segments of 50 bytes cut most rows in two */
+		ok = LGPNG_OK == parallel_rows(&ihdr, raw, 50, &segz)
+		    && 4 == segz;
+		ihdr.data.interlace = INTERLACE_METHOD_ADAM7;
+		ok = ok && LGPNG_OK == parallel_rows(&ihdr, raw, 50, &segz)
+		    && 4 == segz;
+		ok = ok && LGPNG_OK == parallel_rows(&ihdr, raw, 1000, &segz)
+		    && 1 < segz;
+		ihdr.data.interlace = INTERLACE_METHOD_STANDARD;
+		status = ok ? "ok" : "not ok";
+		if (! ok) {
+			rc = EXIT_FAILURE;
+		}
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_inflate\n";
+	if (LGPNG_OK == whole(&ihdr, raw, rawz, 0)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_inflate with truncated stream\n";
+	if (LGPNG_OK != whole(&ihdr, raw, rawz, 8)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_idat_inflate with short image\n";
+	ihdr.data.height++;
+	if (LGPNG_TOO_SHORT == whole(&ihdr, raw, rawz, 0)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+	ihdr.data.height--;
+
+	return(rc);
+}
@@ -0,0 +1,218 @@
+#include "../config.h"
+
+#if HAVE_ERR
+# include <err.h>
+#endif
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "../lgpng.h"
+
+static enum lgpng_err
+count_sink(void *arg, uint8_t *data, size_t dataz)
+{
+	(void)data;
+	*(size_t *)arg += dataz;
+	return(LGPNG_OK);
+}
+
+/* Spend two milliseconds of CPU time for each piece of output */
+static enum lgpng_err
+slow_sink(void *arg, uint8_t *data, size_t dataz)
+{
+	struct timespec	 start, now;
+
+	(void)data;
+	*(size_t *)arg += dataz;
+	if (-1 == clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start)) {
+		return(LGPNG_ERROR);
+	}
+	do {
+		if (-1 == clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now)) {
+			return(LGPNG_ERROR);
+		}
+	} while ((now.tv_sec - start.tv_sec) * 1000000000L
+	    + (now.tv_nsec - start.tv_nsec) < 2000000L);
+	return(LGPNG_OK);
+}
+
+int
+main(void)
+{
+	int		 rc = EXIT_SUCCESS, test = 0;
+	size_t		 outz = 0, counted = 0;
+	uLongf		 srcz;
+	uint8_t		 text[100000];
+	uint8_t		 src[1024];
+	uint8_t		*out = NULL;
+	struct lgpng_budget budget;
+	const char	*subject, *status;
+
+	printf("lgpng_inflate tests\n");
+	printf("TAP version 13\n");
+	printf("1..14\n");
+
+	/* Highly compressible input */
+	for (size_t i = 0; i < sizeof(text); i++) {
+		text[i] = (uint8_t)('a' + i % 7);
+	}
+	srcz = sizeof(src);
+	if (Z_OK != compress(src, &srcz, text, sizeof(text))) {
+		printf("Bail out!\n");
+		errx(EXIT_FAILURE, "compress");
+	}
+
+	subject = "%s %d - lgpng_inflate_chunk with src NULL\n";
+	if (LGPNG_INVALID_PARAM == lgpng_inflate_chunk(NULL, srcz, NULL,
+	    count_sink, &counted)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_inflate_chunk with sink NULL\n";
+	if (LGPNG_INVALID_PARAM == lgpng_inflate_chunk(src, srcz, NULL,
+	    NULL, &counted)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_inflate_chunk\n";
+	if (LGPNG_OK == lgpng_inflate_chunk(src, srcz, NULL, count_sink,
+	    &counted)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - sink should receive every byte\n";
+	if (sizeof(text) == counted) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_inflate_chunk_alloc\n";
+	if (LGPNG_OK == lgpng_inflate_chunk_alloc(src, srcz, NULL, &out, &outz)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - inflated data should match\n";
+	if (NULL != out && sizeof(text) == outz
+	    && 0 == memcmp(out, text, outz) && '\0' == out[outz]) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+	free(out);
+	out = NULL;
+
+	subject = "%s %d - lgpng_inflate_chunk_alloc with small chunk budget\n";
+	lgpng_budget_init(&budget, 1000, 0, 0, 0);
+	if (LGPNG_BUDGET_EXCEEDED == lgpng_inflate_chunk_alloc(src, srcz,
+	    &budget, &out, &outz)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_inflate_chunk within file budget\n";
+	lgpng_budget_init(&budget, 0, sizeof(text) + sizeof(text) / 2, 0, 0);
+	counted = 0;
+	if (LGPNG_OK == lgpng_inflate_chunk(src, srcz, &budget, count_sink,
+	    &counted)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_inflate_chunk past file budget\n";
+	if (LGPNG_BUDGET_EXCEEDED == lgpng_inflate_chunk(src, srcz, &budget,
+	    count_sink, &counted)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_inflate_chunk past chunk time budget\n";
+	lgpng_budget_init(&budget, 0, 0, 1000, 0);
+	counted = 0;
+	if (LGPNG_BUDGET_EXCEEDED == lgpng_inflate_chunk(src, srcz, &budget,
+	    slow_sink, &counted) && counted < sizeof(text)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_inflate_chunk within time budget\n";
+	lgpng_budget_init(&budget, 0, 0, 0, 60 * 1000000);
+	counted = 0;
+	if (LGPNG_OK == lgpng_inflate_chunk(src, srcz, &budget, slow_sink,
+	    &counted) && sizeof(text) == counted && 0 != budget.used_usec) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_inflate_chunk past file time budget\n";
+	budget.used_usec = budget.file_usec;
+	if (LGPNG_BUDGET_EXCEEDED == lgpng_inflate_chunk(src, srcz, &budget,
+	    slow_sink, &counted)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_inflate_chunk_alloc with truncated src\n";
+	if (LGPNG_TOO_SHORT == lgpng_inflate_chunk_alloc(src, srcz / 2, NULL,
+	    &out, &outz)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_inflate_chunk_alloc with corrupted src\n";
+	src[0] = 0xff;
+	if (LGPNG_ZLIB_ERROR == lgpng_inflate_chunk_alloc(src, srcz, NULL,
+	    &out, &outz)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+	return(rc);
+}
@@ -0,0 +1,101 @@
+#include "../config.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../lgpng.h"
+
+#define ROWZ_MAX	(8 * 70)
+
+/*
+ * Compare the selected kernels against the scalar reference for every
+ * row length up to 70 pixels, with and without a previous row.
+ */
+static bool
+differential(uint8_t filter, size_t bpp)
+{
+	uint8_t	 prev[ROWZ_MAX], fast[ROWZ_MAX], slow[ROWZ_MAX];
+
+	for (size_t rowz = bpp; rowz <= bpp * 70; rowz += bpp) {
+		for (size_t i = 0; i < rowz; i++) {
+			prev[i] = (uint8_t)rand();
+			fast[i] = slow[i] = (uint8_t)rand();
+		}
+		if (LGPNG_OK != lgpng_unfilter_row(filter, bpp, fast, prev,
+		    rowz)) {
+			return(false);
+		}
+		(void)lgpng_unfilter_row_scalar(filter, bpp, slow, prev, rowz);
+		if (0 != memcmp(fast, slow, rowz)) {
+			return(false);
+		}
+		(void)lgpng_unfilter_row(filter, bpp, fast, NULL, rowz);
+		(void)lgpng_unfilter_row_scalar(filter, bpp, slow, NULL, rowz);
+		if (0 != memcmp(fast, slow, rowz)) {
+			return(false);
+		}
+	}
+	return(true);
+}
+
+int
+main(void)
+{
+	int		 rc = EXIT_SUCCESS, test = 0;
+	uint8_t		 row[16];
+	const size_t	 bpps[] = { 1, 2, 3, 4, 6, 8 };
+	const char	*subject, *status;
+
+	printf("lgpng_unfilter tests (%s)\n", lgpng_unfilter_isa);
+#if defined(__GNUC__) && defined(__AVX2__)
+	if (! __builtin_cpu_supports("avx2")) {
+		printf("1..0 # SKIP no AVX2 on this CPU\n");
+		return(EXIT_SUCCESS);
+	}
+#elif defined(__GNUC__) && defined(__SSSE3__)
+	if (! __builtin_cpu_supports("ssse3")) {
+		printf("1..0 # SKIP no SSSE3 on this CPU\n");
+		return(EXIT_SUCCESS);
+	}
+#endif
+	printf("TAP version 13\n");
+	printf("1..%zu\n", 2 + FILTER_TYPE__MAX * sizeof(bpps) / sizeof(bpps[0]));
+
+	srand(42);
+	subject = "%s %d - lgpng_unfilter_row with invalid filter\n";
+	if (LGPNG_INVALID_PARAM == lgpng_unfilter_row(FILTER_TYPE__MAX, 1,
+	    row, NULL, sizeof(row))) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	subject = "%s %d - lgpng_unfilter_row with 5 bytes per pixel\n";
+	if (LGPNG_INVALID_PARAM == lgpng_unfilter_row(FILTER_TYPE_SUB, 5,
+	    row, NULL, 15)) {
+		status = "ok";
+	} else {
+		status = "not ok";
+		rc = EXIT_FAILURE;
+	}
+	printf(subject, status, ++test);
+
+	for (uint8_t f = 0; f < FILTER_TYPE__MAX; f++) {
+		for (size_t i = 0; i < sizeof(bpps) / sizeof(bpps[0]); i++) {
+			subject = "%s %d - %s filter, %zu bytes per pixel\n";
+			if (differential(f, bpps[i])) {
+				status = "ok";
+			} else {
+				status = "not ok";
+				rc = EXIT_FAILURE;
+			}
+			printf(subject, status, ++test, filtertypemap[f],
+			    bpps[i]);
+		}
+	}
+	return(rc);
+}
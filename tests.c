@@ -252,6 +252,19 @@ main(void)
 	return landlock_restrict_self(fd, 0) ? 1 : 0;
 }
 #endif /* TEST_LANDLOCK */
+#if TEST_LIBDEFLATE
+#include <libdeflate.h>
+
+int
+main(void)
+{
+	struct libdeflate_decompressor *d;
+
+	d = libdeflate_alloc_decompressor();
+	libdeflate_free_decompressor(d);
+	return 0;
+}
+#endif /* TEST_LIBDEFLATE */
 #if TEST_LIB_SOCKET
 #include <sys/socket.h>
 
@@ -751,3 +764,17 @@ main(void)
 	return waitpid(WAIT_ANY, &st, WNOHANG) != -1;
 }
 #endif /* TEST_WAIT_ANY */
+#if TEST_ZLIB_NG
+#include <stddef.h>
+#include <zlib.h>
+
+#if !defined(ZLIBNG_VERSION)
+# error "zlib.h is not provided by zlib-ng"
+#endif
+
+int
+main(void)
+{
+	return(NULL == zlibVersion());
+}
+#endif /* TEST_ZLIB_NG */